@@ -0,0 +1,223 @@
+/*! \file bench-libblds-client.cc
+ *
+ * Benchmark of the throughput, allocations and latency with which a
+ * BldsClient decodes and delivers frames streamed by a mock BLDS.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#include "blds-client.h"
+#include "client-statistics.h"
+#include "mock-blds.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include <QtCore>
+
+namespace {
+
+/* Allocations made by threads which opted in, i.e. the thread decoding
+ * frames, once it delivers its first frame.
+ */
+QAtomicInteger<quint64> allocationCount(0);
+thread_local bool countAllocations = false;
+
+} // end anonymous namespace
+
+void* operator new(std::size_t size)
+{
+	if (countAllocations)
+		allocationCount.fetchAndAddRelaxed(1);
+	if (void* ptr = std::malloc(size ? size : 1))
+		return ptr;
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+namespace {
+
+/* Results of a run, measured from the end of the warm-up. These are
+ * updated in the thread decoding frames, and read from the main thread.
+ */
+struct Results {
+	QAtomicInteger<qint64> frames { 0 };
+	QAtomicInteger<qint64> missing { 0 }; // frames whose send time was not known
+	LatencyHistogram latency;
+};
+
+void printSummary(const char* name, const LatencyHistogram::Summary& summary)
+{
+	std::printf("%-24s p50 %10.1f us   p99 %10.1f us   max %10.1f us   mean %10.1f us\n",
+			name, summary.p50, summary.p99, summary.max, summary.mean);
+}
+
+} // end anonymous namespace
+
+int main(int argc, char* argv[])
+{
+	QCoreApplication app(argc, argv);
+	QCoreApplication::setApplicationName("bench-libblds-client");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Benchmark the decoding and delivery of "
+			"frames streamed by a mock BLDS.");
+	parser.addHelpOption();
+	QCommandLineOption channelsOption("channels",
+			"Number of channels of synthetic frames.", "count", "64");
+	QCommandLineOption rateOption("rate",
+			"Sample rate of synthetic frames, in Hz.", "hz", "10000");
+	QCommandLineOption intervalOption("interval",
+			"Duration of data in each frame, in milliseconds.", "msec", "10");
+	QCommandLineOption durationOption("duration",
+			"Duration of the measurement, in seconds.", "sec", "10");
+	QCommandLineOption warmupOption("warmup",
+			"Duration of the warm-up before measuring, in seconds.", "sec", "1");
+	QCommandLineOption floodOption("flood",
+			"Send frames as fast as the client reads them, rather than in real time.");
+	QCommandLineOption encodingOption("encoding",
+			"Encoding of frames: raw, delta, delta-lz4 or delta-zstd.", "name", "raw");
+	QCommandLineOption replayOption("replay",
+			"Replay frames from a recording written by a FrameRecorder.", "path");
+	QCommandLineOption ioThreadOption("io-thread",
+			"Decode frames in the client's I/O thread.");
+	QCommandLineOption floatOption("float",
+			"Convert samples to floating point.");
+	QCommandLineOption sampleMajorOption("sample-major",
+			"Provide the samples of each frame in sample-major order.");
+	QCommandLineOption jsonOption("json",
+			"Also print the client's statistics as JSON.");
+	parser.addOptions({ channelsOption, rateOption, intervalOption, durationOption,
+			warmupOption, floodOption, encodingOption, replayOption, ioThreadOption,
+			floatOption, sampleMajorOption, jsonOption });
+	parser.process(app);
+
+	MockBlds::Settings settings;
+	settings.nchannels = parser.value(channelsOption).toUInt();
+	settings.sampleRate = parser.value(rateOption).toFloat();
+	settings.interval = parser.value(intervalOption).toInt();
+	settings.paced = !parser.isSet(floodOption);
+	settings.replayPath = parser.value(replayOption);
+	bool known = false;
+	for (int e = codec::RawEncoding; e <= codec::DeltaZstdEncoding; e++) {
+		if (parser.value(encodingOption) == codec::encodingName(static_cast<codec::Encoding>(e))) {
+			settings.encoding = static_cast<codec::Encoding>(e);
+			known = true;
+		}
+	}
+	if (!known || !codec::isSupported(settings.encoding)) {
+		std::fprintf(stderr, "Unsupported encoding: %s\n",
+				qPrintable(parser.value(encodingOption)));
+		return 1;
+	}
+	const double duration = parser.value(durationOption).toDouble();
+	const double warmup = parser.value(warmupOption).toDouble();
+
+	/* Run the mock in its own thread, so that it keeps sending while
+	 * the client is busy, as the BLDS would.
+	 */
+	QThread serverThread;
+	MockBlds server(settings);
+	server.moveToThread(&serverThread);
+	serverThread.start();
+	bool listening = false;
+	QMetaObject::invokeMethod(&server, "listen", Qt::BlockingQueuedConnection,
+			Q_RETURN_ARG(bool, listening));
+	if (!listening) {
+		std::fprintf(stderr, "Mock BLDS failed to start: %s\n",
+				qPrintable(server.errorString()));
+		serverThread.quit();
+		serverThread.wait();
+		return 1;
+	}
+	const double frameDuration = server.frameDuration();
+
+	BldsClient client("localhost", server.port());
+	client.setUseIoThread(parser.isSet(ioThreadOption));
+	client.setLowLatencyMode(true);
+	client.setFloatConversion(parser.isSet(floatOption));
+	if (parser.isSet(sampleMajorOption))
+		client.setSampleLayout(BldsClient::SampleMajor);
+
+	/* Measure each frame as it is delivered, in the thread decoding it. */
+	Results results;
+	QAtomicInt measuring(0);
+	QObject::connect(&client, &BldsClient::frameReceived, &client,
+			[&](const PooledFrame& frame) -> void {
+				const auto received = MockBlds::now();
+				countAllocations = true;
+				if (!measuring.load())
+					return;
+				const auto index = static_cast<qint64>(std::llround(frame->start() / frameDuration));
+				const auto sent = server.sendTime(index);
+				if (sent < 0)
+					results.missing.fetchAndAddRelaxed(1);
+				else
+					results.latency.record(received - sent);
+				results.frames.fetchAndAddRelaxed(1);
+			}, Qt::DirectConnection);
+	QObject::connect(&client, &BldsClient::error, [](const QString& msg) -> void {
+				std::fprintf(stderr, "Client error: %s\n", qPrintable(msg));
+			});
+
+	quint64 startAllocations = 0, startPoolAllocations = 0;
+	QTimer::singleShot(static_cast<int>(warmup * 1000), [&]() -> void {
+				client.resetStatistics();
+				startAllocations = allocationCount.load();
+				startPoolAllocations = client.frameAllocationCount();
+				measuring.store(1);
+			});
+	QTimer::singleShot(static_cast<int>((warmup + duration) * 1000), [&]() -> void {
+				measuring.store(0);
+				const auto allocations = allocationCount.load() - startAllocations;
+				const auto poolAllocations = client.frameAllocationCount() - startPoolAllocations;
+				const auto statistics = client.statistics();
+				const auto frames = results.frames.load();
+				const auto perFrame = (frames > 0) ?
+					static_cast<double>(allocations) / frames : 0.;
+
+				std::printf("frames                   %lld of %.1f ms, %s, %s\n",
+						static_cast<long long>(frames), frameDuration * 1e3,
+						codec::encodingName(settings.encoding),
+						settings.paced ? "paced" : "flood");
+				std::printf("throughput               %.1f frames/s   %.2f MB/s\n",
+						statistics.framesPerSecond(), statistics.bytesPerSecond() / 1e6);
+				std::printf("allocations              %.2f per frame   %llu new pooled frames\n",
+						perFrame, static_cast<unsigned long long>(poolAllocations));
+				std::printf("dropped / unmatched      %llu / %lld\n",
+						static_cast<unsigned long long>(statistics.framesDropped),
+						static_cast<long long>(results.missing.load()));
+				std::printf("max socket backlog       %lld bytes\n",
+						static_cast<long long>(statistics.maxSocketBacklog));
+				printSummary("decode", statistics.decodeTime);
+				printSummary("end-to-end", results.latency.summary());
+				if (parser.isSet(jsonOption)) {
+					std::printf("%s\n", QJsonDocument(statistics.toJson()).toJson().constData());
+				}
+				client.disconnect();
+				app.quit();
+			});
+
+	client.connect();
+	const auto status = app.exec();
+	serverThread.quit();
+	serverThread.wait();
+	return status;
+}
+
@@ -0,0 +1,23 @@
+######################################################################
+# Benchmark of libblds-client against an in-process mock BLDS
+######################################################################
+
+TEMPLATE = app
+TARGET = bench
+INCLUDEPATH += . ../include ../../ ../../blds/include /usr/local/include/
+
+QT += network
+QT -= gui widgets
+CONFIG += c++11 release
+CONFIG -= app_bundle
+
+LIBS += -L../lib/ -lblds-client -L/usr/local/lib -larmadillo
+
+mac {
+	QMAKE_RPATHDIR += $$(PWD)/../lib
+}
+
+# Input
+HEADERS += mock-blds.h
+SOURCES += bench-libblds-client.cc \
+	mock-blds.cc
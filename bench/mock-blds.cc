@@ -0,0 +1,216 @@
+/*! \file mock-blds.cc
+ *
+ * Implementation of the MockBlds class.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#include "mock-blds.h"
+#include "frame-recorder.h"
+
+#include <chrono>
+#include <cmath>
+
+MockBlds::MockBlds(const Settings& settings, QObject* parent) :
+	QObject(parent),
+	m_settings(settings),
+	m_framesSent(0),
+	m_sendTimes(new QAtomicInteger<qint64>[SendTimeCount])
+{
+	for (int i = 0; i < SendTimeCount; i++)
+		m_sendTimes[i].store(-1);
+	m_server = new QTcpServer(this);
+	QObject::connect(m_server, &QTcpServer::newConnection,
+			this, &MockBlds::handleConnection);
+	m_timer = new QTimer(this);
+	m_timer->setTimerType(Qt::PreciseTimer);
+	QObject::connect(m_timer, &QTimer::timeout, this, &MockBlds::sendFrames);
+}
+
+bool MockBlds::listen()
+{
+	if (!buildPayloads())
+		return false;
+	if (!m_server->listen(QHostAddress::LocalHost)) {
+		m_error = m_server->errorString();
+		return false;
+	}
+	return true;
+}
+
+quint16 MockBlds::port() const
+{
+	return m_server->serverPort();
+}
+
+QString MockBlds::errorString() const
+{
+	return m_error;
+}
+
+double MockBlds::frameDuration() const
+{
+	return m_frameDuration;
+}
+
+qint64 MockBlds::framesSent() const
+{
+	return m_framesSent.load();
+}
+
+qint64 MockBlds::sendTime(qint64 index) const
+{
+	if ( (index < 0) || (index >= m_framesSent.load()) ||
+			(index + SendTimeCount <= m_framesSent.load()) )
+		return -1;
+	return m_sendTimes[index % SendTimeCount].load();
+}
+
+qint64 MockBlds::now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool MockBlds::buildPayloads()
+{
+	m_payloads.clear();
+	if (m_settings.replayPath.isEmpty()) {
+		m_nchannels = qMax<quint32>(m_settings.nchannels, 1);
+		m_nsamples = qMax<quint32>(std::lround(
+					m_settings.sampleRate * m_settings.interval / 1e3), 1);
+		m_frameDuration = m_nsamples / m_settings.sampleRate;
+
+		/* Sinusoids of a different frequency on each channel, plus a
+		 * little noise, so that delta encodings compress realistically.
+		 */
+		quint32 noise = 1;
+		for (int f = 0; f < SyntheticFrameCount; f++) {
+			DataFrame::Samples samples(m_nsamples, m_nchannels);
+			for (arma::uword c = 0; c < samples.n_cols; c++) {
+				for (arma::uword s = 0; s < samples.n_rows; s++) {
+					const double t = (f * m_nsamples + s) / m_settings.sampleRate;
+					noise = noise * 1664525u + 1013904223u;
+					samples(s, c) = static_cast<qint16>(
+							1000. * std::sin(2 * M_PI * (10. + c) * t) +
+							static_cast<int>(noise >> 26) - 32);
+				}
+			}
+			m_payloads.append(codec::encode(samples, m_settings.encoding));
+		}
+	} else {
+		RecordingReader reader(m_settings.replayPath);
+		if (!reader.open()) {
+			m_error = reader.errorString();
+			return false;
+		}
+		if (reader.frameCount() == 0) {
+			m_error = "Recording to replay is empty";
+			return false;
+		}
+
+		/* Frames must all have the shape of the first, as their times
+		 * are rewritten as if they were consecutive.
+		 */
+		const auto& first = reader.entry(0);
+		m_nsamples = first.nsamples;
+		m_nchannels = first.nchannels;
+		m_frameDuration = first.stop - first.start;
+		for (int i = 0; (i < reader.frameCount()) &&
+				(m_payloads.size() < MaxReplayFrames); i++) {
+			const auto& entry = reader.entry(i);
+			if ( (entry.nsamples != m_nsamples) || (entry.nchannels != m_nchannels) )
+				continue;
+			m_payloads.append(codec::encode(reader.frame(i).data(), m_settings.encoding));
+		}
+	}
+	for (const auto& payload : m_payloads) {
+		if (payload.isEmpty() && (m_nsamples > 0)) {
+			m_error = QString("Encoding %1 is not supported").arg(
+					codec::encodingName(m_settings.encoding));
+			return false;
+		}
+	}
+	return (m_frameDuration > 0);
+}
+
+void MockBlds::handleConnection()
+{
+	auto* socket = m_server->nextPendingConnection();
+	if (!socket)
+		return;
+	if (m_client)
+		m_client->deleteLater();
+	m_client = socket;
+	m_client->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
+	/* Requests are ignored, as frames are sent regardless. */
+	QObject::connect(m_client, &QTcpSocket::readyRead, this, [this]() -> void {
+				m_client->readAll();
+			});
+	QObject::connect(m_client, &QTcpSocket::disconnected, this, [this]() -> void {
+				m_timer->stop();
+			});
+	if (!m_settings.paced) {
+		QObject::connect(m_client, &QTcpSocket::bytesWritten,
+				this, &MockBlds::sendFrames);
+	}
+
+	m_framesSent.store(0);
+	m_clock.start();
+	m_timer->start(m_settings.paced ? qMax(m_settings.interval, 1) : 0);
+	sendFrames();
+}
+
+void MockBlds::sendFrames()
+{
+	if (!m_client || (m_client->state() != QAbstractSocket::ConnectedState))
+		return;
+	if (m_settings.paced) {
+		const auto due = static_cast<qint64>(m_clock.nsecsElapsed() / 1e9 / m_frameDuration) + 1;
+		while (m_framesSent.load() < due)
+			sendFrame();
+	} else {
+		m_timer->stop(); // only needed to send the first frames
+		while (m_client->bytesToWrite() < MaxBacklog)
+			sendFrame();
+	}
+}
+
+void MockBlds::sendFrame()
+{
+	const auto index = m_framesSent.load();
+	const auto& payload = m_payloads.at(index % m_payloads.size());
+	const bool encoded = (m_settings.encoding != codec::RawEncoding);
+	const QByteArray type = encoded ? "encoded-data\n" : "data\n";
+
+	/* Messages are laid out as the BLDS writes them: the length of the
+	 * rest of the message, its type, then the frame's header and samples.
+	 */
+	struct {
+		float start;
+		float stop;
+		quint32 nsamples;
+		quint32 nchannels;
+	} header = { static_cast<float>(index * m_frameDuration),
+			static_cast<float>((index + 1) * m_frameDuration),
+			m_nsamples, m_nchannels };
+	quint32 encoding = m_settings.encoding;
+	quint32 size = type.size() + sizeof(header) +
+		(encoded ? sizeof(encoding) : 0) + payload.size();
+
+	QByteArray prefix;
+	prefix.reserve(sizeof(size) + type.size() + sizeof(header) + sizeof(encoding));
+	prefix.resize(sizeof(size));
+	qToLittleEndian(size, prefix.data());
+	prefix.append(type);
+	prefix.append(reinterpret_cast<const char*>(&header), sizeof(header));
+	if (encoded)
+		prefix.append(reinterpret_cast<const char*>(&encoding), sizeof(encoding));
+
+	m_sendTimes[index % SendTimeCount].store(now());
+	m_framesSent.store(index + 1);
+	m_client->write(prefix);
+	m_client->write(payload);
+}
+
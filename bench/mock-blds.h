@@ -0,0 +1,138 @@
+/*! \file mock-blds.h
+ *
+ * Header file declaring the MockBlds class, an in-process stand-in for
+ * the BLDS used to benchmark the client.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#ifndef BLDS_CLIENT_MOCK_BLDS_H
+#define BLDS_CLIENT_MOCK_BLDS_H
+
+#include "frame-codec.h"
+
+#include <QtCore>
+#include <QtNetwork>
+
+/*! \class MockBlds
+ *
+ * The MockBlds class listens for a client, and streams data frames to
+ * it exactly as the BLDS does once all data is requested, without
+ * waiting for any request. Frames are either synthetic, with a given
+ * number of channels and sample rate, or replayed from a recording
+ * written by a FrameRecorder, looped as needed.
+ *
+ * Frames are sent either paced in real time, one every read interval, or
+ * as fast as the client reads them. The time at which each frame is sent
+ * is recorded, so that the latency with which the client delivers it
+ * can be measured in the same process.
+ *
+ * A mock must be used from a single thread, other than that decoding
+ * its frames, except for `sendTime()` and `framesSent()`, which may be
+ * called from any thread.
+ */
+class MockBlds : public QObject {
+	Q_OBJECT
+
+	public:
+
+		/*! Settings of the stream of frames. */
+		struct Settings {
+			/*! Number of channels of synthetic frames. */
+			quint32 nchannels = 64;
+			/*! Sample rate of synthetic frames, in Hz. */
+			float sampleRate = 10000.;
+			/*! Duration of data in each frame, in milliseconds. */
+			int interval = 10;
+			/*! True to send frames in real time, false to send them as
+			 * fast as the client reads them.
+			 */
+			bool paced = true;
+			/*! Encoding in which frames are sent. */
+			codec::Encoding encoding = codec::RawEncoding;
+			/*! Recording from which frames are replayed, or empty for
+			 * synthetic frames.
+			 */
+			QString replayPath;
+		};
+
+		/*! Construct a mock sending frames with the given settings. */
+		explicit MockBlds(const Settings& settings, QObject* parent = nullptr);
+
+		/*! Listen for a client on an ephemeral port of the local host.
+		 *
+		 * \return True on success. On failure, `errorString()` describes
+		 * 	the error.
+		 */
+		Q_INVOKABLE bool listen();
+
+		/*! Return the port on which the mock listens. */
+		quint16 port() const;
+
+		/*! Return a description of the last error. */
+		QString errorString() const;
+
+		/*! Return the duration of each frame, in seconds. */
+		double frameDuration() const;
+
+		/*! Return the number of frames sent. */
+		qint64 framesSent() const;
+
+		/*! Return the time at which a recent frame was sent, as from
+		 * `now()`, or -1 if the frame has not been sent.
+		 *
+		 * \param index The index of the frame, i.e. its start time
+		 * 	divided by the frame duration.
+		 */
+		qint64 sendTime(qint64 index) const;
+
+		/*! Return the number of nanoseconds since an arbitrary reference,
+		 * on a steady clock shared by all threads.
+		 */
+		static qint64 now();
+
+	private:
+
+		/* Number of recent send times retained. */
+		static const int SendTimeCount = 1 << 16;
+
+		/* Number of distinct synthetic frames, and most frames replayed. */
+		static const int SyntheticFrameCount = 16;
+		static const int MaxReplayFrames = 1024;
+
+		/* Most bytes left unsent by the socket before more frames are
+		 * written to it, when sending as fast as the client reads.
+		 */
+		static const qint64 MaxBacklog = 8 * 1024 * 1024;
+
+		/* Build the encoded samples sent in each frame. */
+		bool buildPayloads();
+
+		/* Accept a client, replacing any previous one. */
+		void handleConnection();
+
+		/* Send the frames now due, or as many as the socket accepts. */
+		void sendFrames();
+
+		/* Write one frame to the client. */
+		void sendFrame();
+
+		Settings m_settings;
+		QString m_error;
+		QTcpServer* m_server;
+		QTcpSocket* m_client = nullptr;
+		QTimer* m_timer;
+		QElapsedTimer m_clock;
+
+		/* Encoded samples of each distinct frame, and the shape of each. */
+		QVector<QByteArray> m_payloads;
+		quint32 m_nsamples = 0;
+		quint32 m_nchannels = 0;
+		double m_frameDuration = 0.;
+
+		QAtomicInteger<qint64> m_framesSent;
+		QScopedArrayPointer<QAtomicInteger<qint64> > m_sendTimes;
+};
+
+#endif
+
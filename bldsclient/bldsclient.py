@@ -3,12 +3,24 @@ Python client to the Baccus Lab Data Server.
 (C) 2017 Benjamin Naecker bnaecker@stanford.edu
 """
 
+import queue
 import socket
 import struct
+import threading
 
 import numpy as np
 
-_RECV_SIZE = 2048
+# Length prefix of each message, and header of each data frame.
+_SIZE = struct.Struct('<I')
+_FRAME_HEADER = struct.Struct('<ffII')
+_DATA_TYPE = b'data\n'
+
+# Initial size of the buffer into which messages are read.
+_BUFFER_SIZE = 4096
+
+# Interval at which a blocked background reader checks whether it has
+# been stopped, in seconds.
+_POLL_INTERVAL = 0.1
 
 __all__ = [ 'DataFrame', 'BldsError', 'BldsClient' ]
 
@@ -41,10 +53,13 @@ class DataFrame():
     def deserialize(buf):
         """Deserialize a DataFrame from a byte array, e.g., from a message
         recieved from the BLDS.
+
+        The frame's data is a view of `buf`, which is not copied.
         """
-        start, stop, nsamples, nchannels = struct.unpack('<ffII', buf[:16])
-        return DataFrame(start, stop, np.frombuffer(buf[16:], dtype=np.int16, 
-            count=(nsamples*nchannels)).reshape(nchannels, nsamples))
+        start, stop, nsamples, nchannels = _FRAME_HEADER.unpack_from(buf)
+        return DataFrame(start, stop, np.frombuffer(buf, dtype=np.int16, 
+            count=(nsamples*nchannels), offset=_FRAME_HEADER.size).reshape(
+            nchannels, nsamples))
 
     def serialize(self):
         """Serialize a DataFrame to bytes."""
@@ -69,7 +84,8 @@ class BldsError(Exception):
     pass
 
 class BldsClient():
-    def __init__(self, hostname='localhost', port=12345):
+    def __init__(self, hostname='localhost', port=12345, background=False,
+            queue_size=64):
         """Construct a client of the BLDS.
 
         Parameters
@@ -80,12 +96,34 @@ class BldsClient():
         
         port : int, optional
             The port number at which to connect. You shouldn't need to change this.
+
+        background : bool, optional
+            If True, read from the socket in a background thread, which
+            queues frames until they are collected with `get_data()`. This
+            lets the client keep up with the server while the caller is
+            busy processing earlier frames.
+
+        queue_size : int, optional
+            The number of frames the background thread may queue. Once
+            the queue is full, the thread stops reading until frames are
+            collected, so that the server is slowed rather than memory
+            filled. Ignored unless `background` is True.
         """
         self._sock = None
         self._hostname = hostname
         self._port = port
         self._connected = False
         self._request_all_data = False
+        self._size_buf = bytearray(_SIZE.size)
+        self._buf = bytearray(_BUFFER_SIZE)
+        self._background = background
+        self._queue_size = queue_size
+        self._reader = None
+        self._stopping = threading.Event()
+        self._frames = None
+        self._replies = None
+        self._data_requests = 0
+        self._data_lock = threading.Lock()
 
     def connect(self):
         """Connect to the BLDS."""
@@ -94,12 +132,24 @@ class BldsClient():
         self._sock = socket.socket()
         self._sock.connect((self._hostname, self._port))
         self._connected = True
+        if self._background:
+            self._stopping.clear()
+            self._frames = queue.Queue(self._queue_size)
+            self._replies = queue.Queue()
+            self._data_requests = 0
+            self._reader = threading.Thread(target=self._read_loop,
+                    name='bldsclient-reader', daemon=True)
+            self._reader.start()
 
     def disconnect(self):
         """Disconnect from the BLDS."""
         if not self._connected:
             return
+        self._stopping.set()
         self._sock.shutdown(socket.SHUT_RDWR)
+        if self._reader is not None:
+            self._reader.join()
+            self._reader = None
         self._sock.close()
         self._sock = None
         self._connected = False
@@ -184,11 +234,14 @@ class BldsClient():
         frame : DataFrame
             The frame of data.
         """
-        if self._request_all_data:
-            return self._recv_msg() # Wait for data message available
-        msg = b'get-data\n' + struct.pack('<ff', start, stop)
-        self._send_msg(msg)
-        return self._recv_msg()
+        if not self._request_all_data:
+            msg = b'get-data\n' + struct.pack('<ff', start, stop)
+            with self._data_lock:
+                self._data_requests += 1
+            self._send_msg(msg)
+        if self._reader is not None:
+            return self._take(self._frames)
+        return self._recv_msg() # Wait for data message available
 
     def request_all_data(self, request=True):
         """Request that the BLDS send all data as it becomes available. This
@@ -277,21 +330,112 @@ class BldsClient():
         self._sock.sendall(len(msg).to_bytes(4, 'little') + msg)
 
     def _recv_msg(self):
-        buf = self._sock.recv(4, socket.MSG_WAITALL)
-        if not buf:
-            raise ConnectionError('BLDS closed the connection')
-
-        msg_size = struct.unpack('<I', buf)[0]
-        buf = self._sock.recv(msg_size, socket.MSG_WAITALL)
-
-        msg_type, buf = buf.split(b'\n', maxsplit=1)
+        if self._reader is not None:
+            return self._take(self._replies)
+        return self._read_msg()
+
+    def _read_msg(self):
+        # Read the type of the message first, so that the samples of a data
+        # frame can be read straight into the array which holds them.
+        size = self._read_size()
+        view = self._buffer(size)
+        prefix = min(size, len(_DATA_TYPE))
+        self._recv_into(view[:prefix])
+        if view[:prefix] == _DATA_TYPE:
+            return self._read_frame(size - prefix)
+        self._recv_into(view[prefix:])
+
+        msg_type, buf = bytes(view).split(b'\n', maxsplit=1)
         if msg_type == b'error':
             raise BldsError(buf.decode('utf8'))
-        elif msg_type == b'data':
-            return DataFrame.deserialize(buf)
         success = struct.unpack('<?', buf[:1])[0]
         return self._parse_message_by_type(msg_type.decode('utf8'), success, buf[1:])
 
+    def _read_frame(self, size):
+        if size < _FRAME_HEADER.size:
+            raise BldsError('Malformed data frame from BLDS')
+        header = self._buffer(_FRAME_HEADER.size)
+        self._recv_into(header)
+        start, stop, nsamples, nchannels = _FRAME_HEADER.unpack(header)
+        data = np.empty((nchannels, nsamples), dtype=np.int16)
+        remaining = size - _FRAME_HEADER.size - data.nbytes
+        if remaining < 0:
+            raise BldsError('Malformed data frame from BLDS')
+        self._recv_into(data)
+        if remaining:
+            self._recv_into(self._buffer(remaining))
+        return DataFrame(start, stop, data)
+
+    def _read_size(self):
+        self._recv_into(self._size_buf)
+        return _SIZE.unpack(self._size_buf)[0]
+
+    def _buffer(self, size):
+        # Return a view of the first `size` bytes of the reusable buffer,
+        # replacing it with a larger one if needed. The buffer is replaced
+        # rather than resized, since it cannot be resized while viewed.
+        if len(self._buf) < size:
+            self._buf = bytearray(max(size, 2 * len(self._buf)))
+        return memoryview(self._buf)[:size]
+
+    def _recv_into(self, buf):
+        view = memoryview(buf).cast('B')
+        while view:
+            count = self._sock.recv_into(view)
+            if count == 0:
+                raise ConnectionError('BLDS closed the connection')
+            view = view[count:]
+
+    def _read_loop(self):
+        # Body of the background reader, which queues frames, and any
+        # errors while a frame is expected, separately from replies.
+        while not self._stopping.is_set():
+            try:
+                msg = self._read_msg()
+            except BldsError as err:
+                if self._request_all_data or self._take_data_request():
+                    self._put(self._frames, err)
+                else:
+                    self._replies.put(err)
+                continue
+            except OSError as err:
+                if not self._stopping.is_set():
+                    self._replies.put(err)
+                    self._put(self._frames, err)
+                return
+            if isinstance(msg, DataFrame):
+                self._take_data_request()
+                self._put(self._frames, msg)
+            else:
+                self._replies.put(msg)
+
+    def _take_data_request(self):
+        # Account for the reply to one outstanding `get-data` request, if any.
+        with self._data_lock:
+            if self._data_requests == 0:
+                return False
+            self._data_requests -= 1
+            return True
+
+    def _put(self, q, item):
+        # Wait for room in a queue, unless the reader is stopped.
+        while not self._stopping.is_set():
+            try:
+                q.put(item, timeout=_POLL_INTERVAL)
+                return
+            except queue.Full:
+                pass
+
+    def _take(self, q):
+        item = q.get()
+        if isinstance(item, BldsError):
+            raise item
+        if isinstance(item, Exception):
+            # The reader has stopped, so keep its failure for later calls.
+            q.put_nowait(item)
+            raise item
+        return item
+
     def _parse_message_by_type(self, msg_type, success, buf):
         if not success:
             raise BldsError(buf.decode('utf8'))
@@ -310,14 +454,10 @@ class BldsClient():
             return msg_type, buf[1:].decode('utf8') if not success else ''
 
     def _verify_reply(self, expected):
-        buf = self._sock.recv(4, socket.MSG_WAITALL)
-        if len(buf) == 0:
-            raise ConnectionError('BLDS closed the connection')
-        size = struct.unpack('<I', buf)[0]
-        buf = self._sock.recv(size, socket.MSG_WAITALL)
-        if len(buf) == 0:
-            raise ConnectionError('BLDS closed the connection')
-        msg, buf = buf.split(b'\n', maxsplit=1)
+        size = self._read_size()
+        buf = self._buffer(size)
+        self._recv_into(buf)
+        msg, buf = bytes(buf).split(b'\n', maxsplit=1)
         if msg != expected:
             raise ValueError('Message not received correctly, expected {}'.format(expected))
         success = struct.unpack('<?', buf[:1])[0]
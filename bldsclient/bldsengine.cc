@@ -0,0 +1,910 @@
+/*! \file bldsengine.cc
+ *
+ * Python extension module wrapping the streaming path of the C++
+ * BldsClient. Streamed frames are delivered as NumPy arrays which share
+ * the storage of the client's pooled frames, and the GIL is released
+ * while waiting for them.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+/* Python must be included before Qt, which defines `slots` as a macro. */
+#include <Python.h>
+#include <structmember.h>
+
+#include "blds-client.h"
+
+#include <utility>
+
+#include <QtCore>
+
+namespace {
+
+/* Longest time for which the GIL is released at once while waiting, so
+ * that signals such as KeyboardInterrupt are handled promptly.
+ */
+const int WaitSlice = 50; // msec
+
+/* Interval at which the engine checks that connected clients still are. */
+const int LivenessInterval = 200; // msec
+
+/* `numpy.asarray`, used to wrap the samples of frames as arrays. */
+PyObject* asArray = nullptr;
+
+/* Exception raised when the BLDS fails a request. */
+PyObject* BldsError = nullptr;
+
+/* The Engine runs the event loop of every client made by the module, in a
+ * thread of its own, since Python does not run a Qt event loop. Clients
+ * are created, configured and destroyed in this thread, while frames are
+ * popped from their rings directly in the calling Python thread.
+ *
+ * The engine is started when the module is imported, and lives until the
+ * process exits.
+ */
+class Engine {
+	public:
+		static Engine& instance()
+		{
+			static Engine* engine = new Engine;
+			return *engine;
+		}
+
+		/* Run a function in the engine's thread, waiting for it to
+		 * finish with the GIL released. The function must not use any
+		 * Python objects.
+		 */
+		template <typename Function>
+		void run(Function&& function)
+		{
+			Py_BEGIN_ALLOW_THREADS
+			QMetaObject::invokeMethod(m_context, std::forward<Function>(function),
+					Qt::BlockingQueuedConnection);
+			Py_END_ALLOW_THREADS
+		}
+
+	private:
+		Engine()
+		{
+			m_thread.setObjectName("bldsengine");
+			m_thread.start();
+			m_context = new QObject;
+			m_context->moveToThread(&m_thread);
+		}
+
+		QThread m_thread;
+		QObject* m_context;
+};
+
+/* Create Qt's application object, unless the process already has one.
+ * Qt requires one, though the engine never runs its event loop, and takes
+ * the thread creating it as its main thread. The module creates it when
+ * imported, so it should be imported first from Python's main thread.
+ */
+void createApplication()
+{
+	if (QCoreApplication::instance())
+		return;
+	static int argc = 1;
+	static char name[] = "bldsengine";
+	static char* argv[] = { name, nullptr };
+	new QCoreApplication(argc, argv);
+}
+
+/* Wait for a condition with the GIL released, in slices, until `ready`
+ * returns true, the timeout expires or a signal handler raises. `ready` is
+ * called without the GIL, and may block for at most the given time.
+ *
+ * \param ready Function returning true once the wait should end.
+ * \param timeout The maximum time to wait, in seconds, or negative to
+ * 	wait indefinitely.
+ * \return 1 if `ready` returned true, 0 if the timeout expired, or -1
+ * 	with a Python exception set.
+ */
+template <typename Ready>
+int waitWithoutGil(Ready&& ready, double timeout)
+{
+	const qint64 limit = static_cast<qint64>(timeout * 1000);
+	QElapsedTimer timer;
+	timer.start();
+	while (true) {
+		int slice = WaitSlice;
+		if (timeout >= 0)
+			slice = static_cast<int>(qBound<qint64>(0, limit - timer.elapsed(), WaitSlice));
+		bool done;
+		Py_BEGIN_ALLOW_THREADS
+		done = ready(slice);
+		Py_END_ALLOW_THREADS
+		if (done)
+			return 1;
+		if (PyErr_CheckSignals() < 0)
+			return -1;
+		if ( (timeout >= 0) && (timer.elapsed() >= limit) )
+			return 0;
+	}
+}
+
+/* Parse an optional timeout, in which None means to wait indefinitely. */
+bool parseTimeout(PyObject* object, double& timeout)
+{
+	if (!object || (object == Py_None)) {
+		timeout = -1.;
+		return true;
+	}
+	timeout = PyFloat_AsDouble(object);
+	if ( (timeout == -1.) && PyErr_Occurred() )
+		return false;
+	if (timeout < 0) {
+		PyErr_SetString(PyExc_ValueError, "timeout must be non-negative");
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Samples: the buffer exported for the samples of a pooled frame.
+ */
+
+/* Read-only, C-contiguous buffer of one matrix of a pooled frame. The
+ * object holds a handle to the frame, so that its storage is not returned
+ * to the pool while any array made from the buffer is alive.
+ */
+struct SamplesObject {
+	PyObject_HEAD
+	PooledFrame* frame;
+	const void* data;
+	Py_ssize_t itemsize;
+	const char* format;
+	Py_ssize_t shape[2];
+	Py_ssize_t strides[2];
+};
+
+PyTypeObject SamplesType = { PyVarObject_HEAD_INIT(nullptr, 0) };
+
+void samplesDealloc(PyObject* object)
+{
+	delete reinterpret_cast<SamplesObject*>(object)->frame;
+	PyObject_Del(object);
+}
+
+int samplesGetBuffer(PyObject* object, Py_buffer* view, int flags)
+{
+	/* Samples are shared with every other consumer of the frame. */
+	if (flags & PyBUF_WRITABLE) {
+		PyErr_SetString(PyExc_BufferError, "Samples of pooled frames are read-only");
+		view->obj = nullptr;
+		return -1;
+	}
+	auto* self = reinterpret_cast<SamplesObject*>(object);
+	Py_INCREF(object);
+	view->obj = object;
+	view->buf = const_cast<void*>(self->data);
+	view->len = self->shape[0] * self->shape[1] * self->itemsize;
+	view->readonly = 1;
+	view->itemsize = self->itemsize;
+	view->format = (flags & PyBUF_FORMAT) ? const_cast<char*>(self->format) : nullptr;
+	view->ndim = (flags & PyBUF_ND) ? 2 : 1;
+	view->shape = (flags & PyBUF_ND) ? self->shape : nullptr;
+	view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? self->strides : nullptr;
+	view->suboffsets = nullptr;
+	view->internal = nullptr;
+	return 0;
+}
+
+PyBufferProcs samplesBufferProcs = { samplesGetBuffer, nullptr };
+
+/* Return a NumPy array sharing the storage of one of a frame's matrices.
+ *
+ * Armadillo matrices are column-major, so the array has one row per
+ * column of the matrix, e.g., one row per channel of the frame's samples.
+ */
+template <typename Matrix>
+PyObject* makeArray(const PooledFrame& frame, const Matrix& samples, const char* format)
+{
+	auto* buffer = PyObject_New(SamplesObject, &SamplesType);
+	if (!buffer)
+		return nullptr;
+	buffer->frame = new PooledFrame(frame);
+	buffer->data = samples.memptr();
+	buffer->itemsize = sizeof(typename Matrix::elem_type);
+	buffer->format = format;
+	buffer->shape[0] = samples.n_cols;
+	buffer->shape[1] = samples.n_rows;
+	buffer->strides[0] = samples.n_rows * buffer->itemsize;
+	buffer->strides[1] = buffer->itemsize;
+	auto* array = PyObject_CallFunctionObjArgs(asArray,
+			reinterpret_cast<PyObject*>(buffer), nullptr);
+	Py_DECREF(buffer);
+	return array;
+}
+
+/*
+ * Frame: a streamed frame, as seen from Python.
+ */
+
+struct FrameObject {
+	PyObject_HEAD
+	double start;
+	double stop;
+	long long firstSample;
+	Py_ssize_t nchannels;
+	Py_ssize_t nsamples;
+	PyObject* data;
+	PyObject* floatData;
+	PyObject* sampleMajorData;
+};
+
+PyTypeObject FrameType = { PyVarObject_HEAD_INIT(nullptr, 0) };
+
+void frameDealloc(PyObject* object)
+{
+	auto* self = reinterpret_cast<FrameObject*>(object);
+	Py_XDECREF(self->data);
+	Py_XDECREF(self->floatData);
+	Py_XDECREF(self->sampleMajorData);
+	Py_TYPE(object)->tp_free(object);
+}
+
+PyObject* frameNchannels(PyObject* object, PyObject*)
+{
+	return PyLong_FromSsize_t(reinterpret_cast<FrameObject*>(object)->nchannels);
+}
+
+PyObject* frameNsamples(PyObject* object, PyObject*)
+{
+	return PyLong_FromSsize_t(reinterpret_cast<FrameObject*>(object)->nsamples);
+}
+
+PyObject* frameSubscript(PyObject* object, PyObject* key)
+{
+	return PyObject_GetItem(reinterpret_cast<FrameObject*>(object)->data, key);
+}
+
+PyMethodDef frameMethods[] = {
+	{ "nchannels", frameNchannels, METH_NOARGS,
+		"Return the number of channels in the frame." },
+	{ "nsamples", frameNsamples, METH_NOARGS,
+		"Return the number of samples in the frame." },
+	{ nullptr, nullptr, 0, nullptr }
+};
+
+PyMemberDef frameMembers[] = {
+	{ const_cast<char*>("start"), T_DOUBLE, offsetof(FrameObject, start), READONLY,
+		const_cast<char*>("The start time of the frame, in seconds.") },
+	{ const_cast<char*>("stop"), T_DOUBLE, offsetof(FrameObject, stop), READONLY,
+		const_cast<char*>("The stop time of the frame, in seconds.") },
+	{ const_cast<char*>("first_sample"), T_LONGLONG, offsetof(FrameObject, firstSample),
+		READONLY, const_cast<char*>("The exact index of the frame's first sample, "
+				"or -1 if it is not known.") },
+	{ const_cast<char*>("data"), T_OBJECT, offsetof(FrameObject, data), READONLY,
+		const_cast<char*>("The frame's samples, as a read-only int16 array "
+				"of shape (nchannels, nsamples).") },
+	{ const_cast<char*>("float_data"), T_OBJECT, offsetof(FrameObject, floatData),
+		READONLY, const_cast<char*>("The frame's samples converted to float32, "
+				"of shape (nchannels, nsamples), or None.") },
+	{ const_cast<char*>("sample_major_data"), T_OBJECT,
+		offsetof(FrameObject, sampleMajorData), READONLY,
+		const_cast<char*>("The frame's samples in sample-major order, of "
+				"shape (nsamples, nchannels), or None.") },
+	{ nullptr, 0, 0, 0, nullptr }
+};
+
+PyMappingMethods frameMapping = { nullptr, frameSubscript, nullptr };
+
+/* Make a Python frame from a pooled frame, without copying its samples. */
+PyObject* makeFrame(const PooledFrame& frame)
+{
+	auto* self = PyObject_New(FrameObject, &FrameType);
+	if (!self)
+		return nullptr;
+	self->start = frame->start();
+	self->stop = frame->stop();
+	self->firstSample = frame.firstSample();
+	self->nchannels = frame->nchannels();
+	self->nsamples = frame->nsamples();
+	self->floatData = nullptr;
+	self->sampleMajorData = nullptr;
+	self->data = makeArray(frame, frame->data(), "h");
+	if ( self->data && frame.hasFloatData() )
+		self->floatData = makeArray(frame, frame.floatData(), "f");
+	if ( self->data && frame.hasSampleMajorData() )
+		self->sampleMajorData = makeArray(frame, frame.sampleMajorData(), "h");
+	if ( !self->data || (frame.hasFloatData() && !self->floatData) ||
+			(frame.hasSampleMajorData() && !self->sampleMajorData) ) {
+		Py_DECREF(self);
+		return nullptr;
+	}
+	return reinterpret_cast<PyObject*>(self);
+}
+
+/*
+ * Client: a BldsClient streaming into a frame ring.
+ */
+
+/* State of a client, shared between Python and the engine's thread. */
+class ClientState {
+	public:
+		enum Status {
+			Disconnected,
+			Connecting,
+			Connected,
+			Lost // disconnected other than by request
+		};
+
+		/* Set the status, waking any thread waiting for it to change. */
+		void setStatus(Status status, const QString& msg = QString())
+		{
+			QMutexLocker lock(&m_mutex);
+			m_status = status;
+			m_message = msg;
+			m_changed.wakeAll();
+		}
+
+		/* Return the status, and the message set with it. */
+		Status status(QString* msg = nullptr)
+		{
+			QMutexLocker lock(&m_mutex);
+			if (msg)
+				*msg = m_message;
+			return m_status;
+		}
+
+		/* Wait for at most `msecs` while the status is `status`,
+		 * returning true if it is no longer.
+		 */
+		bool waitWhile(Status status, int msecs)
+		{
+			QMutexLocker lock(&m_mutex);
+			if (m_status == status)
+				m_changed.wait(&m_mutex, static_cast<unsigned long>(msecs));
+			return m_status != status;
+		}
+
+		/* The client, which lives in the engine's thread. */
+		BldsClient* client = nullptr;
+
+		/* The ring into which the client streams, opened on connecting,
+		 * and the lock guarding which ring it is.
+		 */
+		QSharedPointer<FrameRing> ring;
+		QMutex ringMutex;
+
+		/* Serializes consumers of the ring, which supports only one. */
+		QMutex popMutex;
+
+		int ringDepth = 64;
+		FrameRing::OverflowPolicy overflowPolicy = FrameRing::DropOldest;
+		bool autoReconnect = false;
+
+	private:
+		QMutex m_mutex;
+		QWaitCondition m_changed;
+		Status m_status = Disconnected;
+		QString m_message;
+};
+
+struct ClientObject {
+	PyObject_HEAD
+	ClientState* state;
+};
+
+PyTypeObject ClientType = { PyVarObject_HEAD_INIT(nullptr, 0) };
+
+/* Return the state of an initialized client, or null with an exception set. */
+ClientState* clientState(PyObject* object)
+{
+	auto* state = reinterpret_cast<ClientObject*>(object)->state;
+	if (!state)
+		PyErr_SetString(PyExc_RuntimeError, "Client is not initialized");
+	return state;
+}
+
+/* Create the BldsClient of a state in the engine's thread, and watch for
+ * its connection being made, lost and remade.
+ */
+void createClient(ClientState* state, const QString& hostname, quint16 port,
+		const std::function<void(BldsClient*)>& configure)
+{
+	Engine::instance().run([&]() -> void {
+				auto* client = new BldsClient(hostname, port);
+				configure(client);
+				QObject::connect(client, &BldsClient::connected, client,
+						[state](bool made) -> void {
+							if (made)
+								state->setStatus(ClientState::Connected);
+							else
+								state->setStatus(ClientState::Disconnected,
+										"Could not connect to BLDS");
+						});
+				QObject::connect(client, &BldsClient::reconnected, client, [state]() -> void {
+							state->setStatus(ClientState::Connected);
+						});
+
+				/* The client announces only requested disconnections, so
+				 * notice lost connections by their socket's state.
+				 */
+				auto* liveness = new QTimer(client);
+				QObject::connect(liveness, &QTimer::timeout, client, [state, client]() -> void {
+							if ( (state->status() == ClientState::Connected) &&
+									!client->isConnected() )
+								state->setStatus(ClientState::Lost, "Disconnected from BLDS");
+						});
+				liveness->start(LivenessInterval);
+				state->client = client;
+			});
+}
+
+void clientDealloc(PyObject* object)
+{
+	auto* state = reinterpret_cast<ClientObject*>(object)->state;
+	if (state) {
+		/* Closing the ring unblocks a client waiting to push into it. */
+		Engine::instance().run([state]() -> void {
+					state->client->closeFrameRing();
+					delete state->client;
+				});
+		delete state;
+	}
+	Py_TYPE(object)->tp_free(object);
+}
+
+int clientInit(PyObject* object, PyObject* args, PyObject* kwargs)
+{
+	auto* self = reinterpret_cast<ClientObject*>(object);
+	if (self->state) {
+		PyErr_SetString(PyExc_RuntimeError, "Client is already initialized");
+		return -1;
+	}
+
+	static const char* keywords[] = { "hostname", "port", "ring_depth", "overflow",
+		"io_thread", "channels", "float_conversion", "sample_major", "sample_rate",
+		"frame_pool_capacity", "low_latency", "auto_reconnect", nullptr };
+	const char* hostname = "localhost";
+	int port = 12345, ringDepth = 64, poolCapacity = 0;
+	const char* overflow = "drop-oldest";
+	int ioThread = 1, floatConversion = 0, sampleMajor = 0, lowLatency = 0,
+		autoReconnect = 0;
+	PyObject* channels = Py_None;
+	double sampleRate = 0.;
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|siispOppdipp",
+				const_cast<char**>(keywords), &hostname, &port, &ringDepth, &overflow,
+				&ioThread, &channels, &floatConversion, &sampleMajor, &sampleRate,
+				&poolCapacity, &lowLatency, &autoReconnect))
+		return -1;
+
+	if ( (port <= 0) || (port > 65535) ) {
+		PyErr_SetString(PyExc_ValueError, "port must be between 1 and 65535");
+		return -1;
+	}
+	if (ringDepth <= 0) {
+		PyErr_SetString(PyExc_ValueError, "ring_depth must be positive");
+		return -1;
+	}
+	FrameRing::OverflowPolicy policy;
+	if (qstrcmp(overflow, "drop-oldest") == 0) {
+		policy = FrameRing::DropOldest;
+	} else if (qstrcmp(overflow, "drop-newest") == 0) {
+		policy = FrameRing::DropNewest;
+	} else if (qstrcmp(overflow, "block") == 0) {
+		policy = FrameRing::Block;
+	} else {
+		PyErr_SetString(PyExc_ValueError,
+				"overflow must be one of 'drop-oldest', 'drop-newest' or 'block'");
+		return -1;
+	}
+
+	QVector<int> selection;
+	if (channels != Py_None) {
+		auto* sequence = PySequence_Fast(channels, "channels must be a sequence of integers");
+		if (!sequence)
+			return -1;
+		const auto count = PySequence_Fast_GET_SIZE(sequence);
+		selection.reserve(count);
+		for (Py_ssize_t i = 0; i < count; i++) {
+			const long channel = PyLong_AsLong(PySequence_Fast_GET_ITEM(sequence, i));
+			if ( (channel == -1) && PyErr_Occurred() ) {
+				Py_DECREF(sequence);
+				return -1;
+			}
+			selection.append(static_cast<int>(channel));
+		}
+		Py_DECREF(sequence);
+	}
+
+	auto* state = new ClientState;
+	state->ringDepth = ringDepth;
+	state->overflowPolicy = policy;
+	state->autoReconnect = autoReconnect;
+	createClient(state, QString::fromUtf8(hostname), static_cast<quint16>(port),
+			[&](BldsClient* client) -> void {
+				client->setUseIoThread(ioThread);
+				client->setLowLatencyMode(lowLatency);
+				client->setFramePoolCapacity(poolCapacity > 0 ? poolCapacity : ringDepth + 2);
+				client->setChannelSelection(selection);
+				client->setFloatConversion(floatConversion);
+				client->setSampleLayout(sampleMajor ?
+						BldsClient::SampleMajor : BldsClient::ChannelMajor);
+				client->setSampleRate(sampleRate);
+				client->setAutoReconnect(autoReconnect);
+			});
+	self->state = state;
+	return 0;
+}
+
+PyObject* clientConnect(PyObject* object, PyObject* args, PyObject* kwargs)
+{
+	auto* state = clientState(object);
+	if (!state)
+		return nullptr;
+	static const char* keywords[] = { "timeout", nullptr };
+	double timeout = 10.;
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|d", const_cast<char**>(keywords),
+				&timeout))
+		return nullptr;
+	if (state->status() != ClientState::Disconnected)
+		Py_RETURN_NONE;
+
+	/* Open the ring before connecting, so that no frame is missed. */
+	state->setStatus(ClientState::Connecting);
+	QSharedPointer<FrameRing> ring;
+	Engine::instance().run([&]() -> void {
+				ring = state->client->openFrameRing(state->ringDepth, state->overflowPolicy);
+				state->client->connect();
+			});
+	{
+		QMutexLocker lock(&state->ringMutex);
+		state->ring = ring;
+	}
+
+	const int waited = waitWithoutGil([state](int msecs) -> bool {
+				return state->waitWhile(ClientState::Connecting, msecs);
+			}, timeout);
+	QString msg;
+	if ( (waited == 1) && (state->status(&msg) == ClientState::Connected) )
+		Py_RETURN_NONE;
+
+	Engine::instance().run([state]() -> void {
+				state->client->closeFrameRing();
+				state->client->disconnect();
+			});
+	state->setStatus(ClientState::Disconnected);
+	if (waited == 0)
+		PyErr_SetString(PyExc_TimeoutError, "Timed out connecting to BLDS");
+	else if (waited == 1)
+		PyErr_SetString(PyExc_ConnectionError, msg.toUtf8().constData());
+	return nullptr;
+}
+
+PyObject* clientDisconnect(PyObject* object, PyObject*)
+{
+	auto* state = clientState(object);
+	if (!state)
+		return nullptr;
+	if (state->status() == ClientState::Disconnected)
+		Py_RETURN_NONE;
+
+	/* Frames already in the ring may still be collected. */
+	Engine::instance().run([state]() -> void {
+				state->client->closeFrameRing();
+				state->client->disconnect();
+			});
+	state->setStatus(ClientState::Disconnected);
+	Py_RETURN_NONE;
+}
+
+PyObject* clientRequestAllData(PyObject* object, PyObject* args, PyObject* kwargs)
+{
+	auto* state = clientState(object);
+	if (!state)
+		return nullptr;
+	static const char* keywords[] = { "request", "timeout", nullptr };
+	int request = 1;
+	double timeout = 10.;
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|pd", const_cast<char**>(keywords),
+				&request, &timeout))
+		return nullptr;
+	if (state->status() != ClientState::Connected) {
+		PyErr_SetString(PyExc_ConnectionError, "Not connected to BLDS");
+		return nullptr;
+	}
+
+	BldsClient::RequestFuture future;
+	Engine::instance().run([&]() -> void {
+				future = state->client->requestAllDataAsync(request);
+			});
+
+	/* The future is finished from the client's socket thread, so it can
+	 * only be polled here, rather than waited on with a timeout.
+	 */
+	const int waited = waitWithoutGil([&future](int msecs) -> bool {
+				QElapsedTimer timer;
+				timer.start();
+				while (!future.isFinished() && !timer.hasExpired(msecs))
+					QThread::msleep(1);
+				return future.isFinished();
+			}, timeout);
+	if (waited < 0)
+		return nullptr;
+	if (waited == 0) {
+		PyErr_SetString(PyExc_TimeoutError, "Timed out waiting for BLDS");
+		return nullptr;
+	}
+	if ( future.isCanceled() || (future.resultCount() == 0) ) {
+		PyErr_SetString(BldsError, "Request was canceled");
+		return nullptr;
+	}
+	const auto result = future.result();
+	if (!result.success) {
+		PyErr_SetString(BldsError, result.data.toString().toUtf8().constData());
+		return nullptr;
+	}
+	Py_RETURN_NONE;
+}
+
+/* Pop the next frame from a client's ring, waiting for at most `timeout`
+ * seconds, or indefinitely if negative.
+ *
+ * \return The frame; or None if the timeout expires or, when `stopAtEnd`
+ * 	is true, with no exception set if the ring was closed; or null
+ * 	with an exception set.
+ */
+PyObject* popFrame(ClientState* state, double timeout, bool stopAtEnd)
+{
+	QSharedPointer<FrameRing> ring;
+	{
+		QMutexLocker lock(&state->ringMutex);
+		ring = state->ring;
+	}
+	if (!ring) {
+		PyErr_SetString(PyExc_ConnectionError, "Not connected to BLDS");
+		return nullptr;
+	}
+
+	PooledFrame frame;
+	bool popped = false;
+	const int waited = waitWithoutGil([&](int msecs) -> bool {
+				{
+					QMutexLocker lock(&state->popMutex);
+					popped = ring->pop(frame, msecs);
+				}
+				return popped || ring->isClosed() ||
+					( !state->autoReconnect && (state->status() == ClientState::Lost) );
+			}, timeout);
+	if (waited < 0)
+		return nullptr;
+	if (popped)
+		return makeFrame(frame);
+	if (waited == 0)
+		Py_RETURN_NONE;
+
+	QString msg;
+	if (state->status(&msg) == ClientState::Lost) {
+		PyErr_SetString(PyExc_ConnectionError, msg.toUtf8().constData());
+		return nullptr;
+	}
+	if (stopAtEnd)
+		return nullptr;
+	PyErr_SetString(PyExc_ConnectionError, "Disconnected from BLDS");
+	return nullptr;
+}
+
+PyObject* clientNextFrame(PyObject* object, PyObject* args, PyObject* kwargs)
+{
+	auto* state = clientState(object);
+	if (!state)
+		return nullptr;
+	static const char* keywords[] = { "timeout", nullptr };
+	PyObject* timeoutObject = Py_None;
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", const_cast<char**>(keywords),
+				&timeoutObject))
+		return nullptr;
+	double timeout;
+	if (!parseTimeout(timeoutObject, timeout))
+		return nullptr;
+	return popFrame(state, timeout, false);
+}
+
+PyObject* clientIterNext(PyObject* object)
+{
+	auto* state = clientState(object);
+	if (!state)
+		return nullptr;
+	return popFrame(state, -1., true);
+}
+
+PyObject* clientStatistics(PyObject* object, PyObject*)
+{
+	auto* state = clientState(object);
+	if (!state)
+		return nullptr;
+	QByteArray json;
+	Engine::instance().run([&]() -> void {
+				json = QJsonDocument(state->client->statistics().toJson()).toJson(
+						QJsonDocument::Compact);
+			});
+	auto* module = PyImport_ImportModule("json");
+	if (!module)
+		return nullptr;
+	auto* result = PyObject_CallMethod(module, "loads", "s", json.constData());
+	Py_DECREF(module);
+	return result;
+}
+
+PyObject* clientEnter(PyObject* object, PyObject*)
+{
+	Py_INCREF(object);
+	return object;
+}
+
+PyObject* clientExit(PyObject* object, PyObject*)
+{
+	auto* result = clientDisconnect(object, nullptr);
+	if (!result)
+		return nullptr;
+	Py_DECREF(result);
+	Py_RETURN_FALSE;
+}
+
+PyObject* clientGetConnected(PyObject* object, void*)
+{
+	auto* state = clientState(object);
+	if (!state)
+		return nullptr;
+	return PyBool_FromLong(state->status() == ClientState::Connected);
+}
+
+PyObject* clientGetPending(PyObject* object, void*)
+{
+	auto* state = clientState(object);
+	if (!state)
+		return nullptr;
+	QMutexLocker lock(&state->ringMutex);
+	return PyLong_FromSize_t(state->ring ? state->ring->size() : 0);
+}
+
+PyObject* clientGetDropped(PyObject* object, void*)
+{
+	auto* state = clientState(object);
+	if (!state)
+		return nullptr;
+	QMutexLocker lock(&state->ringMutex);
+	return PyLong_FromUnsignedLongLong(state->ring ? state->ring->droppedCount() : 0);
+}
+
+PyMethodDef clientMethods[] = {
+	{ "connect", reinterpret_cast<PyCFunction>(clientConnect),
+		METH_VARARGS | METH_KEYWORDS,
+		"connect(timeout=10.0)\n\n"
+		"Connect to the BLDS, waiting at most `timeout` seconds." },
+	{ "disconnect", clientDisconnect, METH_NOARGS,
+		"disconnect()\n\n"
+		"Disconnect from the BLDS. Frames already received may still be collected." },
+	{ "request_all_data", reinterpret_cast<PyCFunction>(clientRequestAllData),
+		METH_VARARGS | METH_KEYWORDS,
+		"request_all_data(request=True, timeout=10.0)\n\n"
+		"Request that the BLDS stream all data as it becomes available." },
+	{ "next_frame", reinterpret_cast<PyCFunction>(clientNextFrame),
+		METH_VARARGS | METH_KEYWORDS,
+		"next_frame(timeout=None)\n\n"
+		"Return the next streamed frame, waiting at most `timeout` seconds, or\n"
+		"indefinitely if None. Returns None if the timeout expires, and raises\n"
+		"ConnectionError once disconnected and no frames remain." },
+	{ "statistics", clientStatistics, METH_NOARGS,
+		"statistics()\n\n"
+		"Return the client's throughput and latency statistics, as a dict." },
+	{ "__enter__", clientEnter, METH_NOARGS, nullptr },
+	{ "__exit__", clientExit, METH_VARARGS, nullptr },
+	{ nullptr, nullptr, 0, nullptr }
+};
+
+PyGetSetDef clientGetSet[] = {
+	{ const_cast<char*>("connected"), clientGetConnected, nullptr,
+		const_cast<char*>("True if the client is connected to the BLDS."), nullptr },
+	{ const_cast<char*>("pending"), clientGetPending, nullptr,
+		const_cast<char*>("The approximate number of frames waiting to be collected."),
+		nullptr },
+	{ const_cast<char*>("dropped"), clientGetDropped, nullptr,
+		const_cast<char*>("The number of frames dropped because the ring was full."),
+		nullptr },
+	{ nullptr, nullptr, nullptr, nullptr, nullptr }
+};
+
+const char clientDoc[] =
+	"Client(hostname='localhost', port=12345, ring_depth=64, overflow='drop-oldest',\n"
+	"       io_thread=True, channels=None, float_conversion=False,\n"
+	"       sample_major=False, sample_rate=0.0, frame_pool_capacity=0,\n"
+	"       low_latency=False, auto_reconnect=False)\n\n"
+	"Client of the BLDS, streaming frames with the C++ BldsClient.\n\n"
+	"Frames are decoded by the C++ client, in its I/O thread if `io_thread` is\n"
+	"True, into storage recycled from its frame pool, and queued in a ring of\n"
+	"`ring_depth` frames. When the ring is full, the oldest or newest frame is\n"
+	"dropped, or, with the 'block' policy, the client stops reading so that\n"
+	"the BLDS is slowed. Collect frames with `next_frame()`, or by iterating\n"
+	"over the client, which ends once it is disconnected.\n\n"
+	"The arrays of each frame share memory with the pooled frame, and so are\n"
+	"read-only; the storage is recycled once no array refers to it. Frames\n"
+	"contain only the `channels` selected, if any. If `sample_rate` is given,\n"
+	"frames carry the exact index of their first sample.";
+
+/*
+ * Module
+ */
+
+bool readyTypes()
+{
+	SamplesType.tp_name = "bldsengine._Samples";
+	SamplesType.tp_basicsize = sizeof(SamplesObject);
+	SamplesType.tp_dealloc = samplesDealloc;
+	SamplesType.tp_as_buffer = &samplesBufferProcs;
+	SamplesType.tp_flags = Py_TPFLAGS_DEFAULT;
+	SamplesType.tp_doc = "Samples of a pooled frame, exported with the buffer protocol.";
+
+	FrameType.tp_name = "bldsengine.Frame";
+	FrameType.tp_basicsize = sizeof(FrameObject);
+	FrameType.tp_dealloc = frameDealloc;
+	FrameType.tp_as_mapping = &frameMapping;
+	FrameType.tp_flags = Py_TPFLAGS_DEFAULT;
+	FrameType.tp_doc = "A frame of data streamed from the BLDS.";
+	FrameType.tp_methods = frameMethods;
+	FrameType.tp_members = frameMembers;
+
+	ClientType.tp_name = "bldsengine.Client";
+	ClientType.tp_basicsize = sizeof(ClientObject);
+	ClientType.tp_dealloc = clientDealloc;
+	ClientType.tp_flags = Py_TPFLAGS_DEFAULT;
+	ClientType.tp_doc = clientDoc;
+	ClientType.tp_iter = PyObject_SelfIter;
+	ClientType.tp_iternext = clientIterNext;
+	ClientType.tp_methods = clientMethods;
+	ClientType.tp_getset = clientGetSet;
+	ClientType.tp_init = clientInit;
+	ClientType.tp_new = PyType_GenericNew;
+
+	return (PyType_Ready(&SamplesType) == 0) && (PyType_Ready(&FrameType) == 0) &&
+		(PyType_Ready(&ClientType) == 0);
+}
+
+PyModuleDef moduleDef = {
+	PyModuleDef_HEAD_INIT,
+	"bldsengine",
+	"Streaming client of the BLDS, built on the C++ BldsClient.",
+	-1,
+	nullptr, nullptr, nullptr, nullptr, nullptr
+};
+
+} // end anonymous namespace
+
+PyMODINIT_FUNC PyInit_bldsengine()
+{
+	if (!readyTypes())
+		return nullptr;
+	auto* numpy = PyImport_ImportModule("numpy");
+	if (!numpy)
+		return nullptr;
+	asArray = PyObject_GetAttrString(numpy, "asarray");
+	Py_DECREF(numpy);
+	if (!asArray)
+		return nullptr;
+
+	createApplication();
+	Engine::instance();
+
+	auto* module = PyModule_Create(&moduleDef);
+	if (!module)
+		return nullptr;
+	BldsError = PyErr_NewException(const_cast<char*>("bldsengine.BldsError"),
+			nullptr, nullptr);
+	Py_INCREF(BldsError);
+	Py_INCREF(&FrameType);
+	Py_INCREF(&ClientType);
+	if ( (PyModule_AddObject(module, "BldsError", BldsError) < 0) ||
+			(PyModule_AddObject(module, "Frame",
+					reinterpret_cast<PyObject*>(&FrameType)) < 0) ||
+			(PyModule_AddObject(module, "Client",
+					reinterpret_cast<PyObject*>(&ClientType)) < 0) ) {
+		Py_DECREF(module);
+		return nullptr;
+	}
+	return module;
+}
+
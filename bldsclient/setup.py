@@ -1,4 +1,55 @@
-from setuptools import setup
+import os
+import subprocess
+
+from setuptools import setup, Extension
+
+# The engine module links against libblds-client, built in the parent
+# directory, and finds its headers as the library's own build does.
+_here = os.path.dirname(os.path.abspath(__file__))
+_root = os.path.dirname(_here)
+
+def _pkg_config(flag, *packages):
+    try:
+        out = subprocess.check_output(['pkg-config', flag] + list(packages))
+    except (OSError, subprocess.CalledProcessError):
+        return []
+    return out.decode('utf8').split()
+
+# The engine invokes functors in Qt's event loops, which requires Qt 5.10.
+_qt = ('Qt5Core >= 5.10', 'Qt5Network')
+
+def _require_qt():
+    try:
+        subprocess.check_call(['pkg-config', '--exists', 'Qt5Core'])
+    except (OSError, subprocess.CalledProcessError):
+        return # no pkg-config, so rely on the default search paths
+    try:
+        subprocess.check_call(['pkg-config', '--print-errors', '--exists'] + list(_qt))
+    except subprocess.CalledProcessError:
+        raise SystemExit('bldsengine requires Qt 5.10 or later')
+
+# Use C++11 at least, as the library does, unless a standard is given by
+# Qt or by the compiler flags in the environment.
+def _std_flags(cflags):
+    given = cflags + os.environ.get('CFLAGS', '').split() + \
+            os.environ.get('CXXFLAGS', '').split()
+    if any(flag.startswith('-std=') for flag in given):
+        return []
+    return ['-std=c++11']
+
+_require_qt()
+_qt_cflags = _pkg_config('--cflags', *_qt)
+_engine = Extension('bldsengine',
+        sources=['bldsengine.cc'],
+        include_dirs=[os.path.join(_root, 'include'), os.path.dirname(_root),
+            os.path.join(os.path.dirname(_root), 'blds', 'include'),
+            '/usr/local/include'],
+        library_dirs=[os.path.join(_root, 'lib'), '/usr/local/lib'],
+        runtime_library_dirs=[os.path.join(_root, 'lib')],
+        libraries=['blds-client', 'armadillo'],
+        extra_compile_args=_std_flags(_qt_cflags) + ['-fPIC'] + _qt_cflags,
+        extra_link_args=_pkg_config('--libs', *_qt),
+        language='c++')
 
 setup(name='bldsclient',
         version='0.0.1',
@@ -12,7 +63,9 @@ setup(name='bldsclient',
             manipulate the managed data source. This includes creating and deleting
             sources, setting server or recording parameters, setting data source
             parameters, starting/stopping recordings, and collecting data from
-            the server.
+            the server. The bldsengine extension module streams data using
+            the C++ libblds-client, delivering frames as NumPy arrays which
+            share memory with the library's pooled frames.
             ''',
         classifiers=[
             'Intended Audience :: Science/Research',
@@ -21,6 +74,7 @@ setup(name='bldsclient',
             'Operating System :: OS Independent',
             'Programming Language :: Python :: 3'
         ],
-        install_requires=['numpy>=1.11']
+        install_requires=['numpy>=1.11'],
+        ext_modules=[_engine]
     )
 
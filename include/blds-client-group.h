@@ -0,0 +1,205 @@
+/*! \file blds-client-group.h
+ *
+ * Header file declaring the BldsClientGroup class, which manages
+ * connections to several BLDS instances and aligns their data.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#ifndef BLDS_CLIENT_GROUP_H
+#define BLDS_CLIENT_GROUP_H
+
+#include "libblds-client-global.h"
+#include "blds-client.h"
+#include "frame-pool.h"
+
+#include <QtCore>
+
+/*! \class BldsClientGroup
+ *
+ * The BldsClientGroup class manages a set of BldsClients, each connected
+ * to a separate BLDS, e.g., one per recording rig or array, and presents
+ * the data streamed from all of them through a single interface.
+ *
+ * Each client in the group is identified by its source ID, the index at
+ * which it was added. Every client reads from its socket in its own I/O
+ * thread, so that all servers are read concurrently. Each received frame
+ * is emitted via `frameReceived()`, tagged with its source ID.
+ *
+ * Frames are also aligned across sources by their start time. Once every
+ * source has delivered a frame starting within `alignmentTolerance()`
+ * of the others, the set is emitted via `framesAligned()`, in order of
+ * source ID. Frames from a source with no counterpart in the other
+ * sources are dropped and counted. If merging is enabled, each aligned
+ * set is also concatenated into a single frame containing the channels
+ * of all sources, in order of source ID, and emitted via `frameMerged()`.
+ *
+ * All frame signals are emitted from the I/O thread of whichever client
+ * completed the aligned set, after the group's internal lock is released,
+ * so that handlers connected directly may call back into the group. As
+ * the sets completed by different clients are emitted from their own
+ * threads, consecutive sets may be emitted concurrently, and should be
+ * ordered by their start time where order matters. Handlers connected
+ * directly should be brief, as they delay reading from the client.
+ */
+class LIBBLDS_CLIENT_VISIBILITY BldsClientGroup : public QObject {
+	Q_OBJECT
+
+	public:
+
+		/*! Construct an empty group.
+		 *
+		 * \param parent The parent QObject.
+		 */
+		explicit BldsClientGroup(QObject* parent = nullptr);
+
+		/*! Destroy a group, disconnecting and deleting all its clients. */
+		~BldsClientGroup();
+
+		/* Copying is not supported */
+		BldsClientGroup(const BldsClientGroup&) = delete;
+		BldsClientGroup& operator=(const BldsClientGroup&) = delete;
+
+		/*! Add a client for a BLDS to the group.
+		 *
+		 * The client is created with an I/O thread, and owned by the
+		 * group. Clients may only be added while no frames are streaming.
+		 *
+		 * \param hostname The hostname or IP address of the BLDS.
+		 * \param port The port at which to connect to the BLDS.
+		 * \return The source ID of the client.
+		 */
+		int addClient(const QString& hostname = "localhost", quint16 port = 12345);
+
+		/*! Return the number of clients in the group. */
+		int count() const;
+
+		/*! Return the client with a source ID, which may be used to make
+		 * requests of a single BLDS.
+		 */
+		BldsClient* client(int source) const;
+
+		/*! Return the maximum difference in start time between frames
+		 * considered aligned, in seconds.
+		 */
+		float alignmentTolerance() const;
+
+		/*! Set the maximum difference in start time between frames
+		 * considered aligned, in seconds.
+		 */
+		void setAlignmentTolerance(float tolerance);
+
+		/*! Return the maximum number of frames held per source while
+		 * waiting for the other sources.
+		 */
+		int maxPendingFrames() const;
+
+		/*! Set the maximum number of frames held per source while waiting
+		 * for the other sources. When exceeded, e.g., because another
+		 * source has stopped sending, the oldest frame is dropped.
+		 */
+		void setMaxPendingFrames(int count);
+
+		/*! Return true if aligned frames are merged. */
+		bool mergeFrames() const;
+
+		/*! Set whether each set of aligned frames is merged into a single
+		 * frame and emitted via `frameMerged()`. Merging requires that
+		 * aligned frames contain the same number of samples.
+		 */
+		void setMergeFrames(bool merge);
+
+		/*! Return the number of frames dropped because they could not
+		 * be aligned with frames from every other source.
+		 */
+		quint64 droppedCount() const;
+
+	public slots:
+
+		/*! Connect all clients to their BLDS. */
+		void connect();
+
+		/*! Disconnect all clients from their BLDS. */
+		void disconnect();
+
+		/*! Request that every BLDS send all data as it is available.
+		 *
+		 * Any frames awaiting alignment are discarded.
+		 *
+		 * \param request True to request all data, false to cancel.
+		 */
+		void requestAllData(bool request = true);
+
+	signals:
+
+		/*! Emitted when any client receives a frame.
+		 *
+		 * \param source The source ID of the client.
+		 * \param frame The received frame.
+		 */
+		void frameReceived(int source, const PooledFrame& frame);
+
+		/*! Emitted when frames with aligned start times have been received
+		 * from every source.
+		 *
+		 * \param frames One frame from each source, in order of source ID.
+		 */
+		void framesAligned(const QVector<PooledFrame>& frames);
+
+		/*! Emitted after `framesAligned()` if merging is enabled.
+		 *
+		 * \param frame A frame containing the channels of each aligned
+		 * 	frame, in order of source ID, with the time range of the frame
+		 * 	from the first source.
+		 */
+		void frameMerged(const PooledFrame& frame);
+
+		/*! Emitted when any client emits an error.
+		 *
+		 * \param source The source ID of the client, or -1 for an error
+		 * 	in the group itself, such as failing to merge frames.
+		 * \param msg The error message.
+		 */
+		void error(int source, const QString& msg);
+
+	private:
+
+		/* Queue a frame from a source, and emit any sets now aligned. */
+		void handleFrame(int source, const PooledFrame& frame);
+
+		/* Queue a frame from a source, and collect any sets now aligned.
+		 * Must be called with the lock held.
+		 */
+		void collectAligned(int source, const PooledFrame& frame,
+				QVector<QVector<PooledFrame> >& sets);
+
+		/* Concatenate the channels of a set of aligned frames, returning
+		 * a null frame and describing the error if they cannot be.
+		 */
+		PooledFrame merge(const QVector<PooledFrame>& frames, QString& msg);
+
+		/* Discard all frames awaiting alignment. */
+		void clearPending();
+
+		/* Clients in the group, by source ID. */
+		QVector<BldsClient*> m_clients;
+
+		/* Guards the fields below, which are accessed from the I/O
+		 * threads of all clients.
+		 */
+		mutable QMutex m_lock;
+
+		/* Frames from each source awaiting alignment. */
+		QVector<QQueue<PooledFrame> > m_pending;
+
+		float m_tolerance = 1e-3;
+		int m_maxPending = 16;
+		bool m_merge = false;
+		quint64 m_dropped = 0;
+
+		/* Pool from which merged frames are allocated. */
+		FramePool m_mergePool;
+};
+
+#endif
+
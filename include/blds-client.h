@@ -9,19 +9,32 @@
 #ifndef BLDS_CLIENT_H
 #define BLDS_CLIENT_H
 
-#ifdef COMPILE_LIBBLDS_CLIENT
-# define LIBBLDS_CLIENT_VISIBILITY Q_DECL_EXPORT
-#else
-# define LIBBLDS_CLIENT_VISIBILITY Q_DECL_IMPORT
-#endif
+#include "libblds-client-global.h"
+#include "channel-processor.h"
+#include "client-statistics.h"
+#include "data-cache.h"
+#include "frame-codec.h"
+#include "frame-pool.h"
+#include "frame-recorder.h"
+#include "preprocessor.h"
+#include "ring-buffer.h"
+#include "sample-clock.h"
+#include "spike-detector.h"
 
 #include "blds/include/data-frame.h"
 
+#include <functional>
+
 #include <armadillo>
 
 #include <QtCore>
 #include <QtNetwork>
 
+/*! Ring buffer type used to deliver frames from a BldsClient to a
+ * consuming thread without the Qt event loop.
+ */
+typedef RingBuffer<PooledFrame> FrameRing;
+
 /*! \class BldsClient
  *
  * The BldsClient class supports remote communication with the Baccus Lab
@@ -58,7 +71,9 @@ class LIBBLDS_CLIENT_VISIBILITY BldsClient : public QObject {
 		BldsClient(const QString& hostname = "localhost", 
 				quint16 port = 12345, QObject *parent = nullptr);
 
-		/*! Delete a client object. */
+		/*! Delete a client object, closing any ring opened with
+		 * `openFrameRing()` before stopping the I/O thread.
+		 */
 		~BldsClient();
 
 		/* Copying is not supported */
@@ -83,6 +98,553 @@ class LIBBLDS_CLIENT_VISIBILITY BldsClient : public QObject {
 		 */
 		QString address() const;
 
+		/*! Return true if the client communicates with the BLDS from
+		 * an internal I/O thread.
+		 */
+		bool usesIoThread() const;
+
+		/*! Set whether the client communicates with the BLDS from an
+		 * internal I/O thread.
+		 *
+		 * By default, the client's socket is read and all messages are
+		 * decoded in the thread owning the client. When using an I/O
+		 * thread, these happen in a separate thread owned by the client,
+		 * so that a busy owning thread does not stall the connection.
+		 *
+		 * In either case, all responses to requests, and the `connected()`,
+		 * `disconnected()` and `error()` signals, are emitted from the thread
+		 * owning the client. The `data()` and `frameReceived()` signals are
+		 * emitted from the thread in which frames are decoded, so that
+		 * consumers may use a direct connection to handle frames on the
+		 * I/O thread, or a queued connection to handle them elsewhere.
+		 *
+		 * This may only be changed while disconnected, and must be called
+		 * from the thread owning the client. Stopping the I/O thread closes
+		 * any ring opened with `openFrameRing()`, into which the thread may
+		 * be blocked pushing.
+		 */
+		void setUseIoThread(bool use);
+
+		/*! Return the maximum number of idle frames retained by the
+		 * client's frame pool.
+		 */
+		int framePoolCapacity() const;
+
+		/*! Set the maximum number of idle frames retained by the client's
+		 * frame pool.
+		 *
+		 * Received frames are decoded into storage recycled from this pool,
+		 * and are returned to it once all PooledFrame handles to them are
+		 * released. The capacity should be at least the number of frames
+		 * consumers hold at once, or frames will be reallocated.
+		 */
+		void setFramePoolCapacity(int capacity);
+
+		/*! Return the total number of allocations made by the client's
+		 * frame pool, of new frames or of their storage when its shape
+		 * changes. This stops increasing once streaming reaches a
+		 * steady state.
+		 */
+		quint64 frameAllocationCount() const;
+
+		/*! Return true if the client's socket is in low-latency mode. */
+		bool lowLatencyMode() const;
+
+		/*! Set whether the client's socket is in low-latency mode.
+		 *
+		 * In low-latency mode, Nagle's algorithm is disabled on the socket,
+		 * so that each request is sent as soon as it is made, rather than
+		 * waiting to be coalesced with later writes. Each request is always
+		 * written to the socket as a single buffer.
+		 */
+		void setLowLatencyMode(bool enable);
+
+		/*! Set the sizes of the operating system's send and receive buffers
+		 * for the client's socket.
+		 *
+		 * \param sendSize The size of the send buffer, in bytes, or 0 to
+		 * 	use the system default.
+		 * \param receiveSize The size of the receive buffer, in bytes, or
+		 * 	0 to use the system default. A receive buffer large enough for
+		 * 	several data frames lets the BLDS keep sending while the client
+		 * 	is briefly busy.
+		 */
+		void setSocketBufferSizes(int sendSize, int receiveSize);
+
+		/*! Return true if the client reconnects automatically. */
+		bool autoReconnect() const;
+
+		/*! Set whether the client reconnects automatically if its
+		 * connection to the BLDS is lost.
+		 *
+		 * Once connected, if the connection drops other than through
+		 * `disconnect()`, the client tries to connect again after a delay,
+		 * doubling the delay after each failed attempt up to a maximum.
+		 * Each attempt is announced with `reconnecting()`, and success
+		 * with `reconnected()`.
+		 *
+		 * If all data was requested when the connection dropped, the
+		 * stream is resumed once reconnected. The data missed while
+		 * disconnected, from the stop time of the last streamed frame to
+		 * the current position of the recording, is first requested with
+		 * an internal `get` of `recording-position` and `getData()`, and
+		 * delivered exactly as if it had been streamed, including any
+		 * preprocessing, hooks and spike detection, whose state persists
+		 * across the gap. Live frames overlapping data already delivered
+		 * are then trimmed or dropped, so that each sample is delivered
+		 * once. Requests outstanding when the connection is lost fail.
+		 *
+		 * \param enable True to reconnect automatically.
+		 * \param initialDelay The delay before the first attempt, in
+		 * 	milliseconds.
+		 * \param maxDelay The maximum delay between attempts, in milliseconds.
+		 */
+		void setAutoReconnect(bool enable, int initialDelay = 500, int maxDelay = 30000);
+
+		/*! Return the channels selected with `setChannelSelection()`,
+		 * in ascending order. An empty selection means all channels.
+		 */
+		QVector<int> channelSelection() const;
+
+		/*! Select a subset of channels to be decoded from received data.
+		 *
+		 * Frames received after the selection is made, whether streamed
+		 * after `requestAllData()` or in response to `getData()`, contain
+		 * only the selected channels, in ascending order of channel index.
+		 * Unselected channels are skipped as they are read from the socket,
+		 * and are never copied. Channels not present in a received frame
+		 * are ignored.
+		 *
+		 * The BLDS protocol provides no way to request a subset of channels,
+		 * so the server still sends all channels over the network.
+		 *
+		 * \param channels The indices of the channels to decode. Duplicate
+		 * 	and negative indices are ignored. An empty list selects all
+		 * 	channels.
+		 */
+		void setChannelSelection(const QVector<int>& channels);
+
+		/*! Select all channels to be decoded from received data. */
+		void clearChannelSelection();
+
+		/*! Return the maximum duration of data held in the data cache,
+		 * in seconds, or 0 if unbounded.
+		 */
+		float dataCacheDuration() const;
+
+		/*! Set the maximum duration of data held in the data cache.
+		 *
+		 * The data cache retains recently received frames, whether
+		 * streamed after `requestAllData()` or received in response to
+		 * `getData()`, so that later calls to `getData()` for overlapping
+		 * ranges can be served locally. The cache is disabled unless its
+		 * duration or size is bounded.
+		 *
+		 * \param seconds The maximum duration, or 0 to remove the bound.
+		 */
+		void setDataCacheDuration(float seconds);
+
+		/*! Return the maximum size of data held in the data cache, in
+		 * bytes, or 0 if unbounded.
+		 */
+		qint64 dataCacheSize() const;
+
+		/*! Set the maximum size of data held in the data cache.
+		 *
+		 * \param bytes The maximum size, or 0 to remove the bound.
+		 */
+		void setDataCacheSize(qint64 bytes);
+
+		/*! Remove all data from the data cache. */
+		void clearDataCache();
+
+		/*! Layouts in which the samples of received frames may be delivered. */
+		enum SampleLayout {
+			/*! The samples of each channel are contiguous. This is the
+			 * layout of DataFrame, and of samples sent by the BLDS.
+			 */
+			ChannelMajor,
+			/*! The channels of each sample are contiguous. */
+			SampleMajor
+		};
+
+		/*! Return the preferred layout of received frames. */
+		SampleLayout sampleLayout() const;
+
+		/*! Set the preferred layout of received frames.
+		 *
+		 * Frames are always delivered with their samples in channel-major
+		 * order, via `data()` and `frameReceived()`. With the SampleMajor
+		 * layout, frames delivered via `frameReceived()` also carry their
+		 * samples in sample-major order, available from
+		 * `PooledFrame::sampleMajorData()`. The transpose is done with a
+		 * cache-blocked kernel as groups of channels are read from the
+		 * socket, rather than in a separate pass once the frame is complete.
+		 */
+		void setSampleLayout(SampleLayout layout);
+
+		/*! Return the settings of the preprocessing applied to streamed frames. */
+		Preprocessor::Settings preprocessing() const;
+
+		/*! Set the preprocessing applied to streamed frames.
+		 *
+		 * Frames streamed after `requestAllData()` may be preprocessed
+		 * with a common-average reference and a band-pass filter, whose
+		 * state persists from frame to frame, so that the common steps
+		 * used by most consumers are computed only once, in the thread
+		 * in which frames are decoded.
+		 *
+		 * Preprocessing operates on the floating-point samples, as
+		 * described for `setFloatConversion()`, which are provided whenever
+		 * any preprocessing is enabled. The preprocessed samples replace
+		 * the converted samples available from `PooledFrame::floatData()`
+		 * of frames delivered via `frameReceived()` and any frame ring.
+		 * The raw samples, and frames received in response to `getData()`,
+		 * are not preprocessed.
+		 *
+		 * The filter state is reset on reconnecting, and when the channel
+		 * selection changes.
+		 */
+		void setPreprocessing(const Preprocessor::Settings& settings);
+
+		/*! Function processing a range of channels of a streamed frame.
+		 *
+		 * \param frame The frame being processed. Only the columns of
+		 * 	the given channels of its samples, or of its floating-point
+		 * 	samples, may be modified.
+		 * \param first The first channel of the range.
+		 * \param count The number of channels in the range.
+		 */
+		typedef std::function<void(PooledFrame& frame, quint32 first, quint32 count)> ChannelHook;
+
+		/*! Add a hook run over the channels of each streamed frame.
+		 *
+		 * Once a frame streamed after `requestAllData()` is decoded and
+		 * preprocessed, its channels are partitioned into ranges, which are
+		 * processed in parallel by a pool of threads owned by the client.
+		 * All hooks are called for each range, in the order in which they
+		 * were added. The frame is published, e.g., via `frameReceived()`,
+		 * only once all ranges are processed.
+		 *
+		 * Hooks are called from the I/O thread and the client's worker
+		 * threads concurrently, and so must be thread-safe. Frames received
+		 * in response to `getData()` are not processed.
+		 *
+		 * \return An ID which may be used to remove the hook.
+		 */
+		int addChannelHook(const ChannelHook& hook);
+
+		/*! Remove a hook added with `addChannelHook()`. */
+		void removeChannelHook(int id);
+
+		/*! Return the number of threads processing channel hooks. */
+		int channelHookThreads() const;
+
+		/*! Set the number of threads processing channel hooks, including
+		 * the thread in which frames are decoded, or 0 to use one per
+		 * processor core.
+		 */
+		void setChannelHookThreads(int threads);
+
+		/*! Set the number of channels in each range passed to channel
+		 * hooks, or 0 to choose a size giving several ranges per thread.
+		 */
+		void setChannelHookGrain(int channels);
+
+		/*! Return the current spike detection settings. */
+		SpikeDetector::Settings spikeDetection() const;
+
+		/*! Set the spike detection applied to streamed frames.
+		 *
+		 * When enabled, each frame streamed after `requestAllData()` is
+		 * searched for threshold crossings once it is preprocessed and
+		 * all channel hooks have run, and the events found are emitted
+		 * via `spikesDetected()`, together with snippets of the samples
+		 * around each event, if requested. Detection operates on the
+		 * floating-point samples, which are provided whenever detection
+		 * is enabled.
+		 *
+		 * The noise estimate of each channel and the samples carried
+		 * between frames are reset on reconnecting, and when the channel
+		 * selection changes.
+		 */
+		void setSpikeDetection(const SpikeDetector::Settings& settings);
+
+		/*! Return true if streamed frames are published. */
+		bool frameDelivery() const;
+
+		/*! Set whether frames streamed after `requestAllData()` are
+		 * published via `data()`, `frameReceived()` and any frame ring.
+		 *
+		 * Consumers interested only in detected spikes may disable
+		 * delivery, so that the full-bandwidth frames are not passed
+		 * across threads at all. Streamed frames are still cached and
+		 * recorded, and frames requested with `getData()` are always
+		 * delivered. Delivery is enabled by default.
+		 */
+		void setFrameDelivery(bool enable);
+
+		/*! Return true if received frames are converted to floating point. */
+		bool floatConversion() const;
+
+		/*! Set whether received frames are converted to floating point.
+		 *
+		 * When enabled, each frame delivered via `frameReceived()` also
+		 * carries its samples scaled to floating point, available from
+		 * `PooledFrame::floatData()`. Samples are converted with vector
+		 * instructions as they are read from the socket, while still in
+		 * cache, rather than in a separate pass over the whole frame.
+		 * The raw samples remain available as usual.
+		 *
+		 * Each converted sample is `gain * sample + offset`, using the
+		 * gain and offset of its channel set with `setChannelScaling()`,
+		 * or else those set with `setScaling()`.
+		 */
+		void setFloatConversion(bool enable);
+
+		/*! Set the gain and offset used to convert the samples of all
+		 * channels without their own scaling.
+		 */
+		void setScaling(float gain, float offset = 0.);
+
+		/*! Set the gain and offset used to convert the samples of each
+		 * channel.
+		 *
+		 * \param gains The gain of each channel, indexed by channel in the
+		 * 	frames sent by the BLDS, regardless of the channel selection.
+		 * 	Channels beyond the end use the gain set with `setScaling()`.
+		 * \param offsets The offset of each channel, indexed likewise.
+		 */
+		void setChannelScaling(const QVector<float>& gains,
+				const QVector<float>& offsets = QVector<float>());
+
+		/*! Request the ADC range of the source, and use it to set the
+		 * gain used to convert all channels without their own scaling.
+		 *
+		 * The gain is set such that the full range of the raw samples
+		 * maps to the source's `adc-range` parameter, i.e., to
+		 * `adc-range / 32768`. The response is also emitted via the
+		 * `getSourceResponse()` signal as usual.
+		 *
+		 * \return The ID of the request for the source's ADC range.
+		 */
+		quint64 requestSourceScaling();
+
+		/*! Return the sample rate of the source, in Hz, or 0 if unknown. */
+		double sampleRate() const;
+
+		/*! Set the sample rate of the source, in Hz, or 0 if unknown.
+		 *
+		 * The times sent by the BLDS are single-precision seconds, which
+		 * cannot distinguish neighbouring samples after the first minutes
+		 * of a recording. With the sample rate known, the client instead
+		 * tracks the exact 64-bit index of each frame's first sample,
+		 * available from `PooledFrame::firstSample()`. Streamed frames are
+		 * indexed by counting samples from the first frame received, and
+		 * frames requested with `getDataSamples()` carry the requested
+		 * index. The data cache matches ranges of samples exactly, and the
+		 * stream is resumed after reconnecting at exactly the next sample.
+		 *
+		 * Changing the sample rate clears the data cache.
+		 */
+		void setSampleRate(double rate);
+
+		/*! Request the sample rate of the source, and use it as with
+		 * `setSampleRate()`. The response is also emitted via the
+		 * `getSourceResponse()` signal as usual.
+		 *
+		 * \return The ID of the request for the source's sample rate.
+		 */
+		quint64 requestSourceSampleRate();
+
+		/*! Request that the BLDS send data in an encoding, by setting
+		 * its `data-encoding` parameter.
+		 *
+		 * Delta and compressed encodings reduce the bandwidth of the
+		 * stream several-fold, at the cost of some processing in both
+		 * the server and the client, and so are best suited to clients
+		 * on a slower network. Frames are decoded as they are received,
+		 * whatever encoding they were sent in, so the request takes
+		 * effect whenever the BLDS applies it, and frames are delivered
+		 * exactly as if they were sent raw.
+		 *
+		 * \param encoding The requested encoding. LZ4 and zstd compression
+		 * 	are only available if the library is built with support for them,
+		 * 	see `codec::isSupported()`.
+		 *
+		 * \return The ID of the request, or 0 if the encoding is not
+		 * 	supported, in which case `error()` is emitted.
+		 */
+		quint64 requestDataEncoding(codec::Encoding encoding);
+
+		/*! Open a ring buffer into which all received frames are pushed.
+		 *
+		 * The ring provides a bounded alternative to the `data()` and
+		 * `frameReceived()` signals, intended for a single consuming thread
+		 * which polls for frames using `FrameRing::tryPop()` or
+		 * `FrameRing::pop()`, without running an event loop. Frames are
+		 * pushed into the ring from the thread in which they are decoded,
+		 * in addition to being emitted via the usual signals.
+		 *
+		 * With the FrameRing::Block policy, the client stops reading from
+		 * the socket while the ring is full, which in turn applies
+		 * backpressure to the BLDS through TCP flow control. The reading
+		 * thread is then stalled: no further messages, including responses
+		 * to requests, are read until the consumer pops a frame or the
+		 * ring is closed. A consumer which may stop popping should use
+		 * another policy, or close the ring when it stops.
+		 *
+		 * Opening a new ring closes any previously opened ring.
+		 *
+		 * \param depth The number of frames the ring can hold.
+		 * \param policy The policy applied when a frame is received while
+		 * 	the ring is full.
+		 * \return The ring, shared between the client and the consumer.
+		 */
+		QSharedPointer<FrameRing> openFrameRing(int depth,
+				FrameRing::OverflowPolicy policy = FrameRing::DropOldest);
+
+		/*! Close the ring buffer opened with `openFrameRing()`, if any.
+		 *
+		 * No further frames are pushed into the ring, though frames already
+		 * in it may still be popped by the consumer.
+		 */
+		void closeFrameRing();
+
+		/*! Open a recorder to which all streamed frames are appended.
+		 *
+		 * Frames received after `requestAllData()` are appended to a
+		 * memory-mapped file from the thread in which they are decoded,
+		 * in addition to being emitted via the usual signals, so that
+		 * consumers which fall behind may read them back later using a
+		 * RecordingReader, rather than requiring them to be buffered in
+		 * memory. Frames received in response to `getData()` are not
+		 * recorded.
+		 *
+		 * Opening a new recorder closes any previously opened recorder.
+		 *
+		 * \param path The path of the recording's data file. Any existing
+		 * 	recording at this path is replaced.
+		 * \param segmentSize The size by which the data file is grown
+		 * 	and mapped at a time, in bytes.
+		 * \return The recorder, or null if it could not be opened, in
+		 * 	which case the `error()` signal is emitted.
+		 */
+		QSharedPointer<FrameRecorder> openFrameRecorder(const QString& path,
+				qint64 segmentSize = FrameRecorder::DefaultSegmentSize);
+
+		/*! Close the recorder opened with `openFrameRecorder()`, if any.
+		 *
+		 * The recording is closed once any frame being appended is written.
+		 */
+		void closeFrameRecorder();
+
+		/*! The outcome of a request, delivered through the futures
+		 * returned by the asynchronous request methods.
+		 */
+		struct RequestResult {
+			/*! The ID of the request. */
+			quint64 id = 0;
+
+			/*! True if the request succeeded. */
+			bool success = false;
+
+			/*! The result of the request, exactly as passed to
+			 * `requestFinished()`.
+			 */
+			QVariant data;
+		};
+
+		/*! Future through which the result of a request is delivered.
+		 *
+		 * The future is finished from the thread in which the socket
+		 * lives, as soon as the response is parsed, without passing
+		 * through the thread owning the client, so it may be waited on
+		 * or watched from any thread. If the client is destroyed before
+		 * the request is answered, the future is canceled instead.
+		 *
+		 * Note that the response can only be received while the socket's
+		 * thread runs its event loop, so a future must not be waited on
+		 * from the thread owning the client unless it uses an I/O thread.
+		 */
+		typedef QFuture<RequestResult> RequestFuture;
+
+		/*! Request that the BLDS create a data source, returning a future
+		 * for the result. See `createSource()`.
+		 */
+		RequestFuture createSourceAsync(const QString& type = "mcs",
+				const QString& location = "");
+
+		/*! Request that the BLDS delete the current data source, returning
+		 * a future for the result. See `deleteSource()`.
+		 */
+		RequestFuture deleteSourceAsync();
+
+		/*! Request that the BLDS start recording, returning a future for
+		 * the result. See `startRecording()`.
+		 */
+		RequestFuture startRecordingAsync();
+
+		/*! Request that the BLDS stop recording, returning a future for
+		 * the result. See `stopRecording()`.
+		 */
+		RequestFuture stopRecordingAsync();
+
+		/*! Set a parameter of the source, returning a future for the
+		 * result. See `setSource()`.
+		 */
+		RequestFuture setSourceAsync(const QString& param, const QVariant& data);
+
+		/*! Get a parameter of the source, returning a future for its
+		 * value. See `getSource()`.
+		 */
+		RequestFuture getSourceAsync(const QString& param);
+
+		/*! Set a parameter of the server, returning a future for the
+		 * result. See `set()`.
+		 */
+		RequestFuture setAsync(const QString& param, const QVariant& data);
+
+		/*! Get a parameter of the server, returning a future for its
+		 * value. See `get()`.
+		 */
+		RequestFuture getAsync(const QString& param);
+
+		/*! Get several parameters of the server, returning a future for
+		 * the map of their values. See `getMany()`.
+		 */
+		RequestFuture getManyAsync(const QStringList& params);
+
+		/*! Set several parameters of the server, returning a future for
+		 * the map of their results. See `setMany()`.
+		 */
+		RequestFuture setManyAsync(const QVariantMap& params);
+
+		/*! Get several parameters of the source, returning a future for
+		 * the map of their values. See `getSourceMany()`.
+		 */
+		RequestFuture getSourceManyAsync(const QStringList& params);
+
+		/*! Set several parameters of the source, returning a future for
+		 * the map of their results. See `setSourceMany()`.
+		 */
+		RequestFuture setSourceManyAsync(const QVariantMap& params);
+
+		/*! Request or cancel all data, returning a future for the result.
+		 * See `requestAllData()`.
+		 */
+		RequestFuture requestAllDataAsync(bool request = true);
+
+		/*! Get a chunk of data, returning a future for the received
+		 * PooledFrame. See `getData()`.
+		 */
+		RequestFuture getDataAsync(float start, float stop);
+
+		/*! Get a range of samples, returning a future for the received
+		 * PooledFrame. See `getDataSamples()`.
+		 */
+		RequestFuture getDataSamplesAsync(qint64 start, qint64 stop);
+
 	public slots:
 
 		/*! Connect to the BLDS. */
@@ -98,62 +660,177 @@ class LIBBLDS_CLIENT_VISIBILITY BldsClient : public QObject {
 		 * 	to create. See the documentation of `libdata-source` for more
 		 * 	details.
 		 */
-		void createSource(const QString& type = "mcs", const QString& location = "");
+		quint64 createSource(const QString& type = "mcs", const QString& location = "");
 
 		/*! Request that the BLDS deleted the current data source. */
-		void deleteSource();
+		quint64 deleteSource();
 
 		/*! Request that the BLDS start recording data. */
-		void startRecording();
+		quint64 startRecording();
 
 		/*! Request that the BLDS stop an active recording. */
-		void stopRecording();
+		quint64 stopRecording();
 
 		/*! Send a request to set a named parameter of the source.
 		 *
 		 * \param param The name of the parameter to set.
 		 * \param data Variant containing the encoded value to set the parameter to.
 		 */
-		void setSource(const QString& param, const QVariant& data);
+		quint64 setSource(const QString& param, const QVariant& data);
 
 		/*! Get the value of a named parameter of the source.
 		 *
 		 * \param param The name of the parameter to retrieve the value of.
 		 */
-		void getSource(const QString& param);
+		quint64 getSource(const QString& param);
 
 		/*! Send a request to set a named parameter of the server.
 		 *
 		 * \param param The name of the parameter to set.
 		 * \param data Variant containing the encoded value to set the parameter to.
 		 */
-		void set(const QString& param, const QVariant& data);
+		quint64 set(const QString& param, const QVariant& data);
 
 		/*! Get the value of a named parameter of the source.
 		 *
 		 * \param param The name of the parameter to retrieve the value of.
 		 */
-		void get(const QString& param);
+		quint64 get(const QString& param);
+
+		/*! Get the values of several named parameters of the server.
+		 *
+		 * All requests are sent in a single write, and a single
+		 * `getManyResponse()` signal is emitted once all are answered.
+		 *
+		 * \param params The names of the parameters to retrieve.
+		 */
+		quint64 getMany(const QStringList& params);
+
+		/*! Send a request to set several named parameters of the server.
+		 *
+		 * All requests are sent in a single write, and a single
+		 * `setManyResponse()` signal is emitted once all are answered.
+		 *
+		 * \param params Map from the name of each parameter to set, to a
+		 * 	variant containing the value to set it to.
+		 */
+		quint64 setMany(const QVariantMap& params);
+
+		/*! Get the values of several named parameters of the source.
+		 *
+		 * All requests are sent in a single write, and a single
+		 * `getSourceManyResponse()` signal is emitted once all are answered.
+		 *
+		 * \param params The names of the parameters to retrieve.
+		 */
+		quint64 getSourceMany(const QStringList& params);
+
+		/*! Send a request to set several named parameters of the source.
+		 *
+		 * All requests are sent in a single write, and a single
+		 * `setSourceManyResponse()` signal is emitted once all are answered.
+		 *
+		 * \param params Map from the name of each parameter to set, to a
+		 * 	variant containing the value to set it to.
+		 */
+		quint64 setSourceMany(const QVariantMap& params);
 
 		/*! Send a request for the BLDS to send all data as it is available.
 		 *
 		 * \param request True to request all data, false to cancel a previous request.
 		 */
-		void requestAllData(bool request = true);
+		quint64 requestAllData(bool request = true);
 
 		/*! Get a delimited chunk of data.
+		 *
+		 * If the data cache is enabled and already holds the whole chunk,
+		 * it is served from the cache without contacting the BLDS. If it
+		 * holds part of the chunk, only the missing part is requested,
+		 * and the chunk is assembled once it arrives. In either case the
+		 * chunk is delivered exactly as if it were received from the BLDS.
 		 *
 		 * \param start The start time of the data chunk to retrieve.
 		 * \param stop The stop time of the data chunk to retrieve.
 		 */
-		void getData(float start, float stop);
+		quint64 getData(float start, float stop);
 
-		/*! Send an HTTP request for the server's overall status. */
+		/*! Get a range of samples, by their exact indices.
+		 *
+		 * This is as `getData()`, but the range is given in samples since
+		 * the start of the recording, and the chunk delivered carries the
+		 * index of its first sample. Ranges are served from the data cache
+		 * only if it holds every sample exactly. The sample rate must be
+		 * known, see `setSampleRate()`.
+		 *
+		 * \param start The index of the first sample to retrieve.
+		 * \param stop The index one past the last sample to retrieve.
+		 * \return The ID of the request, or 0 if the sample rate is not
+		 * 	known, in which case `error()` is emitted.
+		 */
+		quint64 getDataSamples(qint64 start, qint64 stop);
+
+		/*! Send an HTTP request for the server's overall status.
+		 *
+		 * If a request for the server's status is already in flight, no
+		 * new request is made, and the pending reply answers both.
+		 */
 		void requestServerStatus();
 
-		/*! Send an HTTP request for the source's overall status. */
+		/*! Send an HTTP request for the source's overall status.
+		 *
+		 * If a request for the source's status is already in flight, no
+		 * new request is made, and the pending reply answers both.
+		 */
 		void requestSourceStatus();
 
+		/*! Return the interval at which the server's and source's status
+		 * are polled, in milliseconds, or 0 if they are not polled.
+		 */
+		int statusPollInterval() const;
+
+		/*! Poll the server's and source's status at a fixed interval.
+		 *
+		 * Each poll requests both statuses, as with `requestServerStatus()`
+		 * and `requestSourceStatus()`, skipping either if its previous
+		 * request has not been answered, so that a slow server is never
+		 * sent overlapping requests. A reply is only parsed if it differs
+		 * from the last. Consumers interested only in what changed should
+		 * use `serverStatusChanged()` and `sourceStatusChanged()`.
+		 *
+		 * A poll whose request fails, or whose reply is empty or not a
+		 * valid status, is skipped and reported with `error()`, leaving
+		 * the last status received unchanged.
+		 *
+		 * \param msec The interval, or 0 to stop polling.
+		 */
+		void setStatusPollInterval(int msec);
+
+		/*! Return the client's statistics since they were last reset.
+		 *
+		 * The statistics count the bytes, messages and frames received,
+		 * frames dropped, the time taken to decode and deliver each data
+		 * frame, the depth of the socket's receive buffer and of any frame
+		 * ring, and the round-trip time of requests by type of response.
+		 * They may be read at any time, and cost only a few atomic
+		 * operations per message to collect.
+		 */
+		ClientStatistics::Snapshot statistics() const;
+
+		/*! Reset the client's statistics. */
+		void resetStatistics();
+
+		/*! Return the interval at which statistics are reported, in
+		 * milliseconds, or 0 if they are not reported.
+		 */
+		int statisticsInterval() const;
+
+		/*! Report the client's statistics at a fixed interval, with the
+		 * `statisticsReported()` signal.
+		 *
+		 * \param msec The interval, or 0 to stop reporting.
+		 */
+		void setStatisticsInterval(int msec);
+
 	signals:
 
 		/*! Emitted when the client connects to the BLDS.
@@ -165,6 +842,29 @@ class LIBBLDS_CLIENT_VISIBILITY BldsClient : public QObject {
 		/*! Emitted when the client disconnects from the BLDS. */
 		void disconnected();
 
+		/*! Emitted when the client is about to try to reconnect to the
+		 * BLDS, if auto-reconnect is enabled.
+		 *
+		 * \param attempt The number of the attempt, starting from 1.
+		 * \param delay The delay before the attempt, in milliseconds.
+		 */
+		void reconnecting(int attempt, int delay);
+
+		/*! Emitted when the client has reconnected to the BLDS after its
+		 * connection was lost, before any stream is resumed.
+		 */
+		void reconnected();
+
+		/*! Emitted at the interval set with `setStatisticsInterval()`.
+		 *
+		 * \param statistics The client's statistics since they were last
+		 * 	reset, as returned by `ClientStatistics::Snapshot::toJson()`,
+		 * 	with an additional "interval" object holding the rates of
+		 * 	bytes and frames received, and the number of frames dropped,
+		 * 	since the previous report.
+		 */
+		void statisticsReported(const QJsonObject& statistics);
+
 		/*! Emitted upon receipt of a response to a request to create a
 		 * data source.
 		 *
@@ -245,6 +945,55 @@ class LIBBLDS_CLIENT_VISIBILITY BldsClient : public QObject {
 		 */
 		void requestAllDataResponse(bool success, const QString& msg);
 
+		/*! Emitted once all responses to a `getMany()` request are received.
+		 *
+		 * \param id The ID returned when the request was made.
+		 * \param success True if all parameters were retrieved.
+		 * \param data Map from each parameter name to its value if it was
+		 * 	retrieved, or an error message, encoded as a QString, if not.
+		 */
+		void getManyResponse(quint64 id, bool success, const QVariantMap& data);
+
+		/*! Emitted once all responses to a `setMany()` request are received.
+		 *
+		 * \param id The ID returned when the request was made.
+		 * \param success True if all parameters were set.
+		 * \param msgs Map from each parameter name to an error message if
+		 * 	it could not be set, or an empty string if it was.
+		 */
+		void setManyResponse(quint64 id, bool success, const QVariantMap& msgs);
+
+		/*! Emitted once all responses to a `getSourceMany()` request are
+		 * received. The arguments are as for `getManyResponse()`.
+		 */
+		void getSourceManyResponse(quint64 id, bool success, const QVariantMap& data);
+
+		/*! Emitted once all responses to a `setSourceMany()` request are
+		 * received. The arguments are as for `setManyResponse()`.
+		 */
+		void setSourceManyResponse(quint64 id, bool success, const QVariantMap& msgs);
+
+		/*! Emitted upon receipt of a response to any request.
+		 *
+		 * Each request made of the BLDS returns a request ID, unique within
+		 * the client, with which this signal is emitted in addition to the
+		 * signal specific to the type of request. Requests may therefore be
+		 * sent in a burst without waiting for each response, and responses
+		 * matched to requests by ID.
+		 *
+		 * \param id The ID returned when the request was made.
+		 * \param success True if the request succeeded, false otherwise.
+		 * \param data If the request succeeded, this contains the value
+		 * 	of a requested parameter, or a PooledFrame for a request for
+		 * 	data, and is otherwise empty. If the request failed, this
+		 * 	contains an error message, encoded as a QString. Requests
+		 * 	outstanding when the connection is lost fail, as do requests
+		 * 	made while not connected, without being sent. For a request
+		 * 	sending several parameters at once, this contains the same map
+		 * 	as the corresponding batched response signal.
+		 */
+		void requestFinished(quint64 id, bool success, const QVariant& data);
+
 		/*! Emitted when a new frame of data is received.
 		 *
 		 * \param frame The DataFrame containing the data. This class contains
@@ -253,6 +1002,36 @@ class LIBBLDS_CLIENT_VISIBILITY BldsClient : public QObject {
 		 */
 		void data(const DataFrame& frame);
 
+		/*! Emitted when a new frame of data is received, immediately after
+		 * the `data()` signal.
+		 *
+		 * \param frame A shared handle to the received frame. Unlike the
+		 * 	`data()` signal, queued connections to this signal do not copy
+		 * 	the frame's samples. The frame's storage is returned to the
+		 * 	client's frame pool once all copies of the handle are released.
+		 */
+		void frameReceived(const PooledFrame& frame);
+
+		/*! Emitted after `frameReceived()` for frames streamed after
+		 * `requestAllData()`, but not for frames answering `getData()`
+		 * or `getDataSamples()`, so that consumers of the live stream
+		 * see only consecutive frames.
+		 *
+		 * \param frame A shared handle to the streamed frame.
+		 */
+		void streamedFrameReceived(const PooledFrame& frame);
+
+		/*! Emitted when a streamed frame has been searched for spikes,
+		 * if detection is enabled with `setSpikeDetection()`.
+		 *
+		 * This signal is emitted from the thread in which frames are
+		 * decoded, once for every streamed frame, even if no spikes
+		 * were found in it.
+		 *
+		 * \param batch The spikes found in the frame.
+		 */
+		void spikesDetected(const SpikeBatch& batch);
+
 		/*! Emitted when the client receives an error message from the server,
 		 * or when an internal error occurs.
 		 *
@@ -272,6 +1051,22 @@ class LIBBLDS_CLIENT_VISIBILITY BldsClient : public QObject {
 		 */
 		void sourceStatus(bool exists, QJsonObject json);
 
+		/*! Emitted when a received server status differs from the last.
+		 *
+		 * \param changed The fields which were added or changed, with
+		 * 	their new values, and those which were removed, as nulls. For
+		 * 	the first status received, this contains every field.
+		 */
+		void serverStatusChanged(const QJsonObject& changed);
+
+		/*! Emitted when a received source status differs from the last.
+		 *
+		 * \param exists True if a source exists.
+		 * \param changed The fields which changed, as for
+		 * 	`serverStatusChanged()`.
+		 */
+		void sourceStatusChanged(bool exists, const QJsonObject& changed);
+
 	private slots:
 
 		/* Handle new data available on the client's socket. */
@@ -285,8 +1080,59 @@ class LIBBLDS_CLIENT_VISIBILITY BldsClient : public QObject {
 
 	private:
 
-		/* Handle new messages on the socket of the given size. */
-		void handleMessage(quint32 size);
+		/* Types of message received from the BLDS. */
+		enum MessageType {
+			DataMessage,
+			EncodedDataMessage,
+			SourceCreatedMessage,
+			SourceDeletedMessage,
+			SetMessage,
+			GetMessage,
+			SetSourceMessage,
+			GetSourceMessage,
+			RecordingStartedMessage,
+			RecordingStoppedMessage,
+			GetAllDataMessage,
+			ErrorMessage,
+			UnknownMessage
+		};
+
+		/* Maximum length of any known message type. */
+		static const int MaxMessageTypeLength = 32;
+
+		/* Look up the type of a message from its name. */
+		static MessageType messageType(const char* type, std::size_t length);
+
+		/* Handle a new control message on the socket, of the given type.
+		 * The size is that of the message body, excluding the type.
+		 */
+		void handleMessage(MessageType type, quint32 size);
+
+		/* Reset the parser to expect the start of a new message. */
+		void resetReadState();
+
+		/* Discard any partially-read message, keeping the state of the
+		 * stream, e.g., before reconnecting.
+		 */
+		void resetParser();
+
+		/* Handle a change in the state of the socket, reconnecting if
+		 * the connection is lost.
+		 */
+		void handleSocketStateChanged(QAbstractSocket::SocketState state);
+
+		/* Schedule the next attempt to reconnect. */
+		void scheduleReconnect();
+
+		/* Backfill the data missed while disconnected, and request
+		 * all data again.
+		 */
+		void resumeStream();
+
+		/* Trim a streamed frame to start after the last frame delivered
+		 * before reconnecting, returning false if it should be dropped.
+		 */
+		bool trimToSeam(PooledFrame& frame);
 
 		/* Parse messsages which contain only a success boolean and 
 		 * a string in the case of failure.
@@ -320,20 +1166,499 @@ class LIBBLDS_CLIENT_VISIBILITY BldsClient : public QObject {
 		/* Handle a response to a request for all future data. */
 		void handleRequestAllDataResponse(quint32 size);
 
-		/* Handle a response to a request for data. */
-		void handleDataMessage(quint32 size);
+		/* Read the header of a data frame, and acquire a frame from the
+		 * pool into which to read its samples.
+		 */
+		void beginDataFrame();
+
+		/* Read any available samples of the current data frame, returning
+		 * true and publishing the frame once all samples have been read.
+		 */
+		bool readDataFrame();
+
+		/* Read the samples of the current encoded data frame, once all
+		 * have arrived, returning true and publishing the frame once
+		 * they are decoded.
+		 */
+		bool readEncodedDataFrame();
 
 		/* Handle an error message. */
 		void handleError(quint32 size);
 
+		/* Run a function in the thread owning the client's socket.
+		 * The function is run immediately if called from that thread,
+		 * and queued otherwise.
+		 */
+		template <typename Function>
+		void runOnIoThread(Function&& function);
+
+		/* Run a function in the thread owning the client itself. */
+		template <typename Function>
+		void runOnClientThread(Function&& function);
+
+		/* Emit the error signal from the thread owning the client. */
+		void reportError(const QString& msg);
+
+		/* Return a new request ID. */
+		quint64 nextRequestId();
+
+		/* Promise through which the result of a request is delivered to
+		 * a future, if requested through an asynchronous method. The
+		 * future is canceled if the promise is released unfinished.
+		 */
+		typedef QSharedPointer<QFutureInterface<RequestResult> > RequestPromise;
+
+		/* Create a started promise. */
+		static RequestPromise createPromise();
+
+		/* Deliver the result of a request to its promise, if any. */
+		static void resolvePromise(const RequestPromise& promise, quint64 id,
+				bool success, const QVariant& result);
+
+		/* Send an encoded request, whose response has the given type
+		 * and parameter, returning the request's ID.
+		 */
+		quint64 sendRequest(const QByteArray& responseType,
+				const QString& param, const QByteArray& buffer,
+				const RequestPromise& promise = RequestPromise());
+
+		/* Send a request for all data, or for a chunk of data. */
+		quint64 sendAllDataRequest(bool request, const RequestPromise& promise,
+				bool internal = false);
+		quint64 sendDataRequest(float start, float stop, const RequestPromise& promise);
+
+		/* Set the sample rate used to index frames, from the socket's thread. */
+		void updateSampleRate(double rate);
+
+		/* Request a range of samples, serving it from the cache if possible. */
+		quint64 sendDataSamplesRequest(qint64 start, qint64 stop,
+				const RequestPromise& promise);
+
+		/* Encode a request to create a source. */
+		static QByteArray encodeCreateSource(const QString& type, const QString& location);
+
+		/* Encode a request to get or set a parameter of the server or source. */
+		static QByteArray encodeGet(const QString& param);
+		static QByteArray encodeGetSource(const QString& param);
+		static QByteArray encodeSet(const QString& param, const QVariant& data);
+		static QByteArray encodeSetSource(const QString& param, const QVariant& data);
+
+		/* Append a message, prefixed by its length, to a buffer. */
+		static void appendMessage(QByteArray& buffer, const QByteArray& message);
+
+		/* Send several encoded requests for named parameters in a single
+		 * write, each paired with the parameter's name. The responses all
+		 * have the given type, and are collected into one batch.
+		 */
+		quint64 sendBatch(const QByteArray& responseType,
+				const QList<QPair<QString, QByteArray> >& messages,
+				const RequestPromise& promise = RequestPromise());
+
+		/* Encode the messages of a batch of requests for parameters. */
+		static QList<QPair<QString, QByteArray> > encodeGetMany(const QStringList& params);
+		static QList<QPair<QString, QByteArray> > encodeSetMany(const QVariantMap& params);
+		static QList<QPair<QString, QByteArray> > encodeGetSourceMany(
+				const QStringList& params);
+		static QList<QPair<QString, QByteArray> > encodeSetSourceMany(
+				const QVariantMap& params);
+
+		/* Encode a request for a chunk of data, including its length. */
+		static QByteArray encodeGetData(float start, float stop);
+
+		/* Record a request as awaiting a response. */
+		void addPendingRequest(quint64 id, const QByteArray& responseType,
+				const QString& param = QString(), float start = 0., float stop = 0.,
+				quint64 batch = 0, const RequestPromise& promise = RequestPromise());
+
+		/* A request sent to the BLDS, awaiting its response. */
+		struct PendingRequest {
+			quint64 id;
+			QByteArray responseType;
+			QString param;
+			float start;
+			float stop;
+			quint64 batch; // ID of batch containing the request, or 0
+
+			/* For requests for data which fetch only the part of a chunk
+			 * missing from the cache, the range of the whole chunk.
+			 */
+			bool merge = false;
+			float mergeStart = 0.;
+			float mergeStop = 0.;
+
+			/* For requests for a range of samples, the range, and the
+			 * range of the whole chunk if merging, or -1.
+			 */
+			qint64 firstSample = -1;
+			qint64 stopSample = -1;
+			qint64 mergeFirstSample = -1;
+			qint64 mergeStopSample = -1;
+
+			/* Promise of an asynchronous request, if any. */
+			RequestPromise promise;
+
+			/* Function called from the socket's thread when an internal
+			 * request finishes, if any.
+			 */
+			std::function<void(bool success, const QVariant& result)> callback;
+
+			/* True for a request for data backfilling the stream. */
+			bool backfill = false;
+
+			/* True for a request made by the client itself, such as when
+			 * resuming the stream, whose response is not reported by the
+			 * client's signals.
+			 */
+			bool internal = false;
+
+			/* Time at which the request was sent, as from ClientStatistics::now(). */
+			qint64 sentTime = 0;
+		};
+
+		/* A batch of requests, awaiting all responses. */
+		struct PendingBatch {
+			QByteArray responseType;
+			int remaining;
+			bool success;
+			QVariantMap results;
+			RequestPromise promise;
+		};
+
+		/* Finish a request, emitting the requestFinished signal from the
+		 * thread owning the client, or updating the request's batch.
+		 */
+		void finishRequest(const PendingRequest& request,
+				bool success, const QVariant& result);
+
+		/* Emit the response to a finished batch of requests. */
+		void finishBatch(quint64 id, const PendingBatch& batch);
+
+		/* Finish the oldest pending request matching a response,
+		 * returning false if it was an internal request, whose response
+		 * is not reported.
+		 */
+		bool completeRequest(const QByteArray& responseType,
+				const QString& param, bool success, const QVariant& result);
+
+		/* Remove the oldest pending request for data, if a received
+		 * frame answers it, returning false if the frame was not
+		 * requested explicitly.
+		 */
+		bool takeDataRequest(const PooledFrame& frame, PendingRequest& request);
+
+		/* Cache, publish and finish any request for a decoded frame. */
+		void handleDataFrame(PooledFrame& frame);
+
+		/* Preprocess, run hooks over, detect spikes in, cache, record
+		 * and publish a streamed frame, or one backfilling the stream
+		 * after reconnecting.
+		 */
+		void handleStreamedFrame(PooledFrame& frame, bool backfill = false);
+
+		/* Rebuild the scaling of each column of the current frame, if
+		 * the scaling or channel selection have changed.
+		 */
+		void updateColumnScaling(arma::uword nchannels);
+
+		/* Convert or transpose the samples of the current frame read so
+		 * far, up to the given number of samples.
+		 */
+		void processPendingSamples(arma::uword count);
+
+		/* Convert or transpose all samples of a frame not read from
+		 * the socket, such as one assembled from the data cache.
+		 */
+		void processFrame(PooledFrame& frame);
+
+		/* Write a framed message to the socket, from the I/O thread, or
+		 * fail all pending requests if the socket is not connected.
+		 */
+		void writeMessage(const QByteArray& message);
+
+		/* Fail all pending requests. */
+		void failPendingRequests(const QString& msg);
+
+		/* Parse all complete messages available from the socket. */
+		void readMessages();
+
+		/* Emit the statisticsReported signal. */
+		void reportStatistics();
+
+		/* Apply the requested options to a connected socket. */
+		void applySocketOptions();
+
+		/* Deliver a fully-decoded frame to all consumers. */
+		void publishFrame(const PooledFrame& frame);
+
+		/* Layout of the fixed-size header preceding the samples of
+		 * a serialized DataFrame.
+		 */
+		struct DataFrameHeader {
+			float start;
+			float stop;
+			quint32 nsamples;
+			quint32 nchannels;
+		};
+
 		/* The socket with which the client communicates to the BLDS. */
 		QTcpSocket* m_socket;
 
-		/* Data stream object for simplifying serialization of data. */
+		/* One-shot handlers of the socket's connection being made or
+		 * failing, made by `connect()`, and the handler reporting errors
+		 * once connected. These are removed by handle, so that handlers
+		 * made in the constructor are kept.
+		 */
+		QMetaObject::Connection m_connectedConnection;
+		QMetaObject::Connection m_connectErrorConnection;
+		QMetaObject::Connection m_errorConnection;
+
+		/* Handler forwarding the socket's disconnection, made by the first
+		 * call to `disconnect()`. The constructor's handler, which fails
+		 * pending requests, is kept alongside it.
+		 */
+		QMetaObject::Connection m_disconnectedConnection;
+
+		/* Thread in which the socket lives, if using an I/O thread. */
+		QThread* m_ioThread = nullptr;
+
+		/* True if low-latency mode was requested. */
+		bool m_lowLatency = false;
+
+		/* Options applied to the socket when connected. Only accessed
+		 * from the socket's thread.
+		 */
+		struct SocketOptions {
+			bool lowLatency = false;
+			int sendBufferSize = 0;
+			int receiveBufferSize = 0;
+		} m_ioSocketOptions;
+
+		/* True if auto-reconnect was requested. */
+		bool m_autoReconnect = false;
+
+		/* State of auto-reconnection. Only accessed from the socket's
+		 * thread, as is the timer, which lives there.
+		 */
+		struct ReconnectState {
+			bool enabled = false;
+			int initialDelay = 500;
+			int maxDelay = 30000;
+			bool active = false; // connected, and not disconnected explicitly
+			int attempt = 0;
+		} m_ioReconnect;
+		QTimer* m_reconnectTimer;
+
+		/* Stop time of the last streamed frame delivered, and whether
+		 * streamed frames are checked against it after reconnecting.
+		 * Only accessed from the socket's thread.
+		 */
+		bool m_hasLastStreamedStop = false;
+		float m_lastStreamedStop = 0.;
+		bool m_seamPending = false;
+
+		/* Sample rate of the source, as seen from the thread owning the
+		 * client, and as used in the socket's thread to index frames.
+		 */
+		double m_sampleRate = 0.;
+		SampleClock m_ioClock;
+		bool m_ioSampleRateFromSource = false; // set from the next sample-rate
+
+		/* Index one past the last streamed sample delivered, or -1 if
+		 * unknown. Only accessed from the socket's thread.
+		 */
+		qint64 m_lastStreamedSample = -1;
+
+		/* Statistics of the client's traffic, updated from the socket's
+		 * thread. The bytes left unread by the last read of the socket, and
+		 * the time at which the header of the current frame was read, are
+		 * only accessed from the socket's thread.
+		 */
+		ClientStatistics m_statistics;
+		qint64 m_unreadBytes = 0;
+		qint64 m_frameStartTime = 0;
+
+		/* Timer used to report statistics, and the statistics when they
+		 * were last reported, from the thread owning the client.
+		 */
+		QTimer* m_statisticsTimer;
+		ClientStatistics::Snapshot m_reportedStatistics;
+
+		/* Pool from which the storage of received frames is allocated. */
+		FramePool m_framePool;
+
+		/* Bounds of the data cache, as seen from the thread owning
+		 * the client.
+		 */
+		float m_dataCacheDuration = 0.;
+		qint64 m_dataCacheSize = 0;
+
+		/* Cache of recently received frames. Only accessed from the
+		 * socket's thread.
+		 */
+		DataCache m_dataCache;
+
+		/* Ring into which received frames are pushed, if any. This is
+		 * only accessed from the socket's thread; the ring itself is
+		 * shared with its consumer.
+		 */
+		QSharedPointer<FrameRing> m_frameRing;
+
+		/* The most recently opened ring, used to close it from the
+		 * thread owning the client.
+		 */
+		QWeakPointer<FrameRing> m_openFrameRing;
+
+		/* Recorder to which streamed frames are appended, if any. Only
+		 * accessed from the socket's thread.
+		 */
+		QSharedPointer<FrameRecorder> m_frameRecorder;
+
+		/* The most recently opened recorder. */
+		QWeakPointer<FrameRecorder> m_openFrameRecorder;
+
+		/* States of the incremental parser of messages from the BLDS. */
+		enum ReadState {
+			ReadingSize,
+			ReadingType,
+			ReadingBody,
+			ReadingFrameHeader,
+			ReadingFrameSamples,
+			ReadingEncodedFrame,
+			DiscardingBody
+		};
+
+		/* Current state of the parser. */
+		ReadState m_readState = ReadingSize;
+
+		/* Number of bytes of the current message not yet read. */
+		quint32 m_messageSize = 0;
+
+		/* Type of the current message. */
+		MessageType m_messageType = UnknownMessage;
+
+		/* Frame into which the current data message is being read. */
+		PooledFrame m_pendingFrame;
+
+		/* Header of the current data message. */
+		DataFrameHeader m_frameHeader;
+
+		/* Encoding of the current data message. */
+		codec::Encoding m_frameEncoding = codec::RawEncoding;
+
+		/* Buffers holding the samples of an encoded message as received,
+		 * and once decompressed, reused from message to message.
+		 */
+		QByteArray m_encodedSamples;
+		QByteArray m_decompressedSamples;
+
+		/* Channels selected for decoding, as seen from the thread
+		 * owning the client, and from the socket's thread.
+		 */
+		QVector<int> m_channelSelection;
+		QVector<int> m_ioChannelSelection;
+
+		/* Map from each received channel to its column in decoded frames,
+		 * or -1 if not selected. Empty if all channels are selected.
+		 */
+		QVector<int> m_channelMap;
+
+		/* Number of selected channels present in received frames. */
+		int m_selectedChannelCount = 0;
+
+		/* True if the selection changed since the map was built. */
+		bool m_channelMapDirty = false;
+
+		/* True if frames are converted to floating point, as seen from
+		 * the thread owning the client.
+		 */
+		bool m_floatConversion = false;
+
+		/* Requested conversion of samples. Only accessed from the
+		 * socket's thread.
+		 */
+		struct Scaling {
+			bool enabled = false;
+			float gain = 1.;
+			float offset = 0.;
+			QVector<float> gains;
+			QVector<float> offsets;
+			bool fromSource = false; // set gain from the next adc-range
+		} m_ioScaling;
+
+		/* Gain and offset of each column of decoded frames. */
+		QVector<float> m_columnGains;
+		QVector<float> m_columnOffsets;
+
+		/* True if the column scaling must be rebuilt. */
+		bool m_scalingDirty = true;
+
+		/* Number of samples of the current frame converted so far. */
+		arma::uword m_convertedSamples = 0;
+
+		/* Preferred layout of frames, as seen from the thread owning the
+		 * client, and from the socket's thread.
+		 */
+		SampleLayout m_sampleLayout = ChannelMajor;
+		SampleLayout m_ioSampleLayout = ChannelMajor;
+
+		/* Number of channels of the current frame transposed so far. */
+		arma::uword m_transposedChannels = 0;
+
+		/* Preprocessing settings, as seen from the thread owning the client. */
+		Preprocessor::Settings m_preprocessing;
+
+		/* Preprocessor applied to streamed frames. Only accessed from
+		 * the socket's thread.
+		 */
+		Preprocessor m_preprocessor;
+
+		/* Source of channel hook IDs. */
+		int m_nextChannelHookId = 0;
+
+		/* Number of threads processing channel hooks, as seen from the
+		 * thread owning the client.
+		 */
+		int m_channelHookThreads = 0;
+
+		/* Channel hooks, by ID, in the order added. Only accessed from
+		 * the socket's thread, as are the processor and grain.
+		 */
+		QVector<QPair<int, ChannelHook> > m_channelHooks;
+		ChannelProcessor m_channelProcessor;
+		quint32 m_channelHookGrain = 0;
+
+		/* Spike detection settings, as seen from the thread owning the client. */
+		SpikeDetector::Settings m_spikeDetection;
+
+		/* Detector applied to streamed frames. Only accessed from
+		 * the socket's thread.
+		 */
+		SpikeDetector m_spikeDetector;
+
+		/* Whether streamed frames are published, as seen from the thread
+		 * owning the client and from the socket's thread.
+		 */
+		bool m_frameDelivery = true;
+		bool m_ioFrameDelivery = true;
+
+		/* Requests awaiting a response, in the order they were sent.
+		 * Only accessed from the socket's thread.
+		 */
+		QList<PendingRequest> m_pendingRequests;
+
+		/* Batches of requests awaiting responses, by batch ID. Only
+		 * accessed from the socket's thread.
+		 */
+		QMap<quint64, PendingBatch> m_pendingBatches;
+
+		/* Source of request IDs. */
+		QAtomicInteger<quint64> m_nextRequestId;
+
+		/* Data stream object for simplifying deserialization of data. */
 		QDataStream m_stream;
 
 		/* True if the client requests all data. */
-		bool m_requestAllData;
+		bool m_requestAllData = false;
 
 		/* Hostname of the BLDS. */
 		QString m_hostname;
@@ -346,10 +1671,25 @@ class LIBBLDS_CLIENT_VISIBILITY BldsClient : public QObject {
 
 		/* Request object used to make status HTTP requests. */
 		QNetworkRequest m_serverRequest;
-		QNetworkReply* m_serverReply;
+		QNetworkReply* m_serverReply = nullptr;
 
 		QNetworkRequest m_sourceRequest;
-		QNetworkReply* m_sourceReply;
+		QNetworkReply* m_sourceReply = nullptr;
+
+		/* Timer used to poll the statuses. */
+		QTimer* m_statusTimer;
+
+		/* The last status of each kind, both as received and parsed, so
+		 * that unchanged replies need not be parsed again.
+		 */
+		bool m_hasServerStatus = false;
+		QByteArray m_serverStatusBody;
+		QJsonObject m_serverStatus;
+
+		bool m_hasSourceStatus = false;
+		bool m_sourceExists = false;
+		QByteArray m_sourceStatusBody;
+		QJsonObject m_sourceStatus;
 
 		/* The URLs for the above requests. Changes when the 
 		 * request changes.
@@ -0,0 +1,216 @@
+/*! \file bulk-fetcher.h
+ *
+ * Header file declaring the BulkFetcher class, which downloads a long
+ * range of recorded data from the BLDS in parallel chunks.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#ifndef BLDS_CLIENT_BULK_FETCHER_H
+#define BLDS_CLIENT_BULK_FETCHER_H
+
+#include "libblds-client-global.h"
+#include "blds-client.h"
+#include "frame-pool.h"
+#include "frame-recorder.h"
+
+#include <QtCore>
+
+/*! \class BulkFetcher
+ *
+ * The BulkFetcher class downloads a range of a recording which may be
+ * far longer than fits in memory, such as a whole finished experiment.
+ *
+ * The range is split into chunks of `chunkDuration()` seconds, which
+ * are requested with `BldsClient::getData()` over one or more of the
+ * fetcher's own connections to the BLDS, keeping up to `maxInFlight()`
+ * requests outstanding on each, so that the transfer is bounded by the
+ * bandwidth of the link rather than by the round trip of each request.
+ * Chunks which fail are retried, up to `maxRetries()` times. If any
+ * connection is lost, the fetch fails rather than retrying on it.
+ *
+ * Chunks are delivered strictly in order, via `chunkReady()`, and, if
+ * an output file is set, appended to it with a FrameRecorder. Chunks
+ * which arrive early are held until the chunks before them have been
+ * delivered, and no chunk is requested more than one window ahead of
+ * the next to deliver, so that at most a window of chunks is held in
+ * memory at once, however long the range.
+ *
+ * If the sample rate is set, chunks are requested by exact sample index
+ * with `BldsClient::getDataSamples()`, so that consecutive chunks share
+ * no samples and leave none out.
+ *
+ * A fetcher must be used from the thread which created it, from which
+ * all its signals are emitted.
+ */
+class LIBBLDS_CLIENT_VISIBILITY BulkFetcher : public QObject {
+	Q_OBJECT
+
+	public:
+
+		/*! Construct a fetcher for a BLDS.
+		 *
+		 * \param hostname The hostname of the BLDS.
+		 * \param port The port of the BLDS.
+		 * \param parent The parent QObject.
+		 */
+		BulkFetcher(const QString& hostname = "localhost",
+				quint16 port = 12345, QObject* parent = nullptr);
+
+		/*! Destroy a fetcher, cancelling any fetch in progress. */
+		~BulkFetcher();
+
+		/* Copying is not supported */
+		BulkFetcher(const BulkFetcher&) = delete;
+		BulkFetcher& operator=(const BulkFetcher&) = delete;
+
+		/*! Return the duration of each chunk, in seconds. */
+		float chunkDuration() const;
+
+		/*! Set the duration of each chunk, in seconds. Takes effect with
+		 * the next fetch.
+		 */
+		void setChunkDuration(float seconds);
+
+		/*! Return the number of connections made to the BLDS. */
+		int connectionCount() const;
+
+		/*! Set the number of connections made to the BLDS. Takes effect
+		 * with the next fetch.
+		 */
+		void setConnectionCount(int count);
+
+		/*! Return the number of requests kept outstanding on each connection. */
+		int maxInFlight() const;
+
+		/*! Set the number of requests kept outstanding on each connection.
+		 * Takes effect with the next fetch.
+		 */
+		void setMaxInFlight(int count);
+
+		/*! Return the number of times a failed chunk is retried. */
+		int maxRetries() const;
+
+		/*! Set the number of times a failed chunk is retried. */
+		void setMaxRetries(int count);
+
+		/*! Return the sample rate of the source, in Hz, or 0 if unknown. */
+		double sampleRate() const;
+
+		/*! Set the sample rate of the source, in Hz, or 0 if unknown, in
+		 * which case chunks are requested by time. Takes effect with the
+		 * next fetch.
+		 */
+		void setSampleRate(double rate);
+
+		/*! Return the path of the file to which chunks are written, if any. */
+		QString outputFile() const;
+
+		/*! Set the path of a file to which chunks are written, with a
+		 * FrameRecorder, or an empty path to write none. Takes effect
+		 * with the next fetch.
+		 */
+		void setOutputFile(const QString& path);
+
+		/*! Return true if a fetch is in progress. */
+		bool isActive() const;
+
+		/*! Start fetching a range of data.
+		 *
+		 * \param start The start of the range, in seconds.
+		 * \param stop The end of the range, in seconds.
+		 * \return False if a fetch is already in progress, or the range
+		 * 	is empty.
+		 */
+		bool fetch(float start, float stop);
+
+		/*! Cancel the fetch in progress, if any. The `finished()` signal
+		 * is emitted with the result.
+		 */
+		void cancel();
+
+	signals:
+
+		/*! Emitted as each chunk is delivered, in order.
+		 *
+		 * \param index The index of the chunk, starting from 0.
+		 * \param frame The chunk's data.
+		 */
+		void chunkReady(int index, const PooledFrame& frame);
+
+		/*! Emitted after each chunk is delivered.
+		 *
+		 * \param delivered The number of chunks delivered.
+		 * \param total The number of chunks in the range.
+		 */
+		void progress(int delivered, int total);
+
+		/*! Emitted when a fetch finishes, fails or is cancelled.
+		 *
+		 * \param success True if every chunk was delivered.
+		 * \param msg A description of the failure, if any.
+		 */
+		void finished(bool success, const QString& msg);
+
+	private:
+
+		/* A connection to the BLDS, and its outstanding requests. */
+		struct Connection {
+			BldsClient* client = nullptr;
+			bool ready = false;
+			QHash<quint64, int> requests; // chunk index by request ID
+		};
+
+		/* Outstanding or held chunk, by index. */
+		struct Chunk {
+			int retries = 0;
+			bool received = false;
+			PooledFrame frame;
+		};
+
+		/* Request chunks on each ready connection, up to its limit and
+		 * within the window of the next chunk to deliver.
+		 */
+		void requestChunks();
+
+		/* Request one chunk over a connection, returning false if the
+		 * request could not be made.
+		 */
+		bool requestChunk(Connection& connection, int index);
+
+		/* Handle the response to a request made over a connection. */
+		void handleResponse(int connection, quint64 id, bool success,
+				const QVariant& data);
+
+		/* Deliver all consecutive received chunks from the next one. */
+		void deliverChunks();
+
+		/* Finish the fetch, releasing all connections. */
+		void finish(bool success, const QString& msg);
+
+		QString m_hostname;
+		quint16 m_port;
+
+		float m_chunkDuration = 1.;
+		int m_connectionCount = 1;
+		int m_maxInFlight = 4;
+		int m_maxRetries = 2;
+		double m_sampleRate = 0.;
+		QString m_outputFile;
+
+		/* State of the fetch in progress. */
+		bool m_active = false;
+		float m_start = 0.;
+		float m_stop = 0.;
+		SampleClock m_clock;
+		int m_chunkCount = 0;
+		int m_nextRequest = 0; // next chunk never requested
+		int m_nextDelivery = 0; // next chunk to deliver
+		QList<int> m_retryQueue;
+		QMap<int, Chunk> m_chunks;
+		QVector<Connection> m_connections;
+		QScopedPointer<FrameRecorder> m_recorder;
+};
+
+#endif
+
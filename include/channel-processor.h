@@ -0,0 +1,78 @@
+/*! \file channel-processor.h
+ *
+ * Header file declaring the ChannelProcessor class, which runs work on
+ * ranges of channels of a frame in parallel.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#ifndef BLDS_CLIENT_CHANNEL_PROCESSOR_H
+#define BLDS_CLIENT_CHANNEL_PROCESSOR_H
+
+#include "libblds-client-global.h"
+
+#include <functional>
+
+#include <QtCore>
+
+/*! \class ChannelProcessor
+ *
+ * The ChannelProcessor class partitions the channels of a frame into
+ * ranges, and runs a function over each range in parallel, returning
+ * only once all ranges are processed.
+ *
+ * The ranges are not assigned to threads in advance. Instead, the calling
+ * thread and each worker repeatedly claim the next unprocessed range from
+ * a shared atomic counter, so that threads which finish early take on the
+ * remaining work, and channels that are expensive to process do not leave
+ * other threads idle.
+ *
+ * A processor owns its worker threads, so that channel work never waits
+ * behind unrelated tasks in the global thread pool. Only one call to
+ * `run()` may be in progress at a time.
+ */
+class LIBBLDS_CLIENT_VISIBILITY ChannelProcessor {
+	public:
+
+		/*! Function processing `count` channels, starting at `first`. */
+		typedef std::function<void(quint32 first, quint32 count)> Function;
+
+		/*! Construct a processor.
+		 *
+		 * \param threads The total number of threads used, including the
+		 * 	calling thread, or 0 to use one per processor core.
+		 */
+		explicit ChannelProcessor(int threads = 0);
+
+		/*! Destroy a processor, waiting for its worker threads to exit. */
+		~ChannelProcessor();
+
+		/* Copying is not supported */
+		ChannelProcessor(const ChannelProcessor&) = delete;
+		ChannelProcessor& operator=(const ChannelProcessor&) = delete;
+
+		/*! Return the total number of threads used, including the caller. */
+		int threadCount() const;
+
+		/*! Set the total number of threads used, including the caller,
+		 * or 0 to use one per processor core.
+		 */
+		void setThreadCount(int threads);
+
+		/*! Process all channels in parallel.
+		 *
+		 * \param nchannels The number of channels.
+		 * \param grain The number of channels in each range, or 0 to
+		 * 	choose a size giving several ranges per thread.
+		 * \param function The function run for each range.
+		 */
+		void run(quint32 nchannels, quint32 grain, const Function& function);
+
+	private:
+
+		QThreadPool m_pool;
+		int m_threads;
+};
+
+#endif
+
@@ -0,0 +1,201 @@
+/*! \file client-statistics.h
+ *
+ * Header file declaring the LatencyHistogram and ClientStatistics classes,
+ * which collect counters and timings describing a BldsClient's traffic.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#ifndef BLDS_CLIENT_CLIENT_STATISTICS_H
+#define BLDS_CLIENT_CLIENT_STATISTICS_H
+
+#include "libblds-client-global.h"
+
+#include <QtCore>
+
+/*! \class LatencyHistogram
+ *
+ * The LatencyHistogram class counts durations in buckets whose bounds
+ * are powers of two microseconds, from 1 us to over an hour, so that
+ * recording a duration is a handful of atomic operations and never
+ * allocates. Percentiles are estimated to within a factor of two.
+ *
+ * Durations may be recorded from any thread, concurrently with reads.
+ */
+class LIBBLDS_CLIENT_VISIBILITY LatencyHistogram {
+	public:
+
+		/*! Number of buckets. Bucket i counts durations below 2^i us,
+		 * and at least 2^(i-1) us, except the first and last.
+		 */
+		static const int BucketCount = 32;
+
+		/*! Summary of the durations recorded in a histogram. */
+		struct Summary {
+			/*! Number of durations recorded. */
+			quint64 count = 0;
+			/*! Mean duration, in microseconds. */
+			double mean = 0.;
+			/*! Maximum duration, in microseconds. */
+			double max = 0.;
+			/*! Estimated median, in microseconds. */
+			double p50 = 0.;
+			/*! Estimated 99th percentile, in microseconds. */
+			double p99 = 0.;
+			/*! Count in each bucket. */
+			QVector<quint64> buckets;
+
+			/*! Return the summary as a JSON object. */
+			QJsonObject toJson() const;
+		};
+
+		/*! Construct an empty histogram. */
+		LatencyHistogram();
+
+		/* Copying is not supported */
+		LatencyHistogram(const LatencyHistogram&) = delete;
+		LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+		/*! Record a duration, in nanoseconds. */
+		void record(qint64 nsec);
+
+		/*! Return a summary of the recorded durations. */
+		Summary summary() const;
+
+		/*! Discard all recorded durations. */
+		void reset();
+
+	private:
+		QAtomicInteger<quint64> m_buckets[BucketCount];
+		QAtomicInteger<quint64> m_count;
+		QAtomicInteger<quint64> m_total; // nanoseconds
+		QAtomicInteger<quint64> m_max; // nanoseconds
+};
+
+/*! \class ClientStatistics
+ *
+ * The ClientStatistics class collects the statistics of a BldsClient:
+ * the volume of data received, the time taken to decode and deliver each
+ * frame, the depth of the socket's receive buffer and of the frame ring,
+ * the number of frames dropped, and the round-trip time of each type of
+ * request.
+ *
+ * The statistics are updated from the thread in which the client reads
+ * its socket, using only atomic operations on the fast path, and may be
+ * read from any thread with `snapshot()`.
+ */
+class LIBBLDS_CLIENT_VISIBILITY ClientStatistics {
+	public:
+
+		/*! A consistent copy of the statistics at one time. */
+		struct Snapshot {
+			/*! Time since the statistics were reset, in seconds. */
+			double elapsed = 0.;
+			/*! Bytes read from the socket. */
+			quint64 bytesReceived = 0;
+			/*! Messages received, of any type. */
+			quint64 messagesReceived = 0;
+			/*! Data frames received, streamed or requested. */
+			quint64 framesReceived = 0;
+			/*! Frames dropped, because a frame ring was full or they
+			 * duplicated data already delivered after reconnecting.
+			 */
+			quint64 framesDropped = 0;
+			/*! Time from reading the header of each data frame to
+			 * delivering it, including any conversion, preprocessing,
+			 * hooks and spike detection.
+			 */
+			LatencyHistogram::Summary decodeTime;
+			/*! Bytes waiting in the socket's receive buffer, when last
+			 * read, and the maximum seen.
+			 */
+			qint64 socketBacklog = 0;
+			qint64 maxSocketBacklog = 0;
+			/*! Frames in the frame ring, when last pushed, and the
+			 * maximum seen.
+			 */
+			qint64 ringOccupancy = 0;
+			qint64 maxRingOccupancy = 0;
+			/*! Round-trip time of requests, by type of response. */
+			QMap<QString, LatencyHistogram::Summary> requestTime;
+
+			/*! Return the average rate at which bytes were received
+			 * since the statistics were reset, in bytes per second.
+			 */
+			double bytesPerSecond() const;
+
+			/*! Return the average rate at which frames were received
+			 * since the statistics were reset, in frames per second.
+			 */
+			double framesPerSecond() const;
+
+			/*! Return the snapshot as a JSON object. */
+			QJsonObject toJson() const;
+		};
+
+		/*! Construct empty statistics. */
+		ClientStatistics();
+
+		/* Copying is not supported */
+		ClientStatistics(const ClientStatistics&) = delete;
+		ClientStatistics& operator=(const ClientStatistics&) = delete;
+
+		/*! Return a copy of the statistics. */
+		Snapshot snapshot() const;
+
+		/*! Reset all statistics, and the time from which rates are measured. */
+		void reset();
+
+		/*! Return the number of nanoseconds since an arbitrary reference,
+		 * used to time frames and requests.
+		 */
+		qint64 now() const;
+
+		/*! Record bytes read from the socket, and the bytes left waiting. */
+		void addBytes(qint64 count, qint64 backlog);
+
+		/*! Record the receipt of a message. */
+		void addMessage();
+
+		/*! Record a frame decoded and delivered, which took the given
+		 * time in nanoseconds.
+		 */
+		void addFrame(qint64 nsec);
+
+		/*! Record frames dropped. */
+		void addDropped(quint64 count);
+
+		/*! Record the occupancy of the frame ring. */
+		void setRingOccupancy(qint64 count);
+
+		/*! Record the round-trip time of a request, in nanoseconds. */
+		void addRequest(const QString& type, qint64 nsec);
+
+	private:
+
+		/* Raise an atomic maximum. */
+		static void raise(QAtomicInteger<qint64>& max, qint64 value);
+
+		QElapsedTimer m_clock;
+		QAtomicInteger<qint64> m_resetTime;
+
+		QAtomicInteger<quint64> m_bytes;
+		QAtomicInteger<quint64> m_messages;
+		QAtomicInteger<quint64> m_frames;
+		QAtomicInteger<quint64> m_dropped;
+		LatencyHistogram m_decodeTime;
+		QAtomicInteger<qint64> m_backlog;
+		QAtomicInteger<qint64> m_maxBacklog;
+		QAtomicInteger<qint64> m_ring;
+		QAtomicInteger<qint64> m_maxRing;
+
+		/* Histograms of request times, by type, created as each type
+		 * is first seen. Histograms are never removed, so they may be
+		 * updated outside the lock.
+		 */
+		mutable QMutex m_lock;
+		QMap<QString, QSharedPointer<LatencyHistogram> > m_requestTime;
+};
+
+#endif
+
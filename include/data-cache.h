@@ -0,0 +1,193 @@
+/*! \file data-cache.h
+ *
+ * Header file declaring the DataCache class, a time-indexed cache of
+ * recently received frames of data.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#ifndef BLDS_CLIENT_DATA_CACHE_H
+#define BLDS_CLIENT_DATA_CACHE_H
+
+#include "libblds-client-global.h"
+#include "frame-pool.h"
+#include "sample-clock.h"
+
+#include <QtCore>
+
+/*! \class DataCache
+ *
+ * The DataCache class retains recently received frames of data, indexed
+ * by their start time, so that requests for ranges of data which have
+ * already been received can be served without contacting the BLDS.
+ *
+ * The cache is bounded by the duration of data it holds, by the size
+ * of that data in bytes, or both. When either bound is exceeded, the
+ * frames with the earliest start times are evicted first. A cache for
+ * which neither bound is set is disabled, and holds no frames.
+ *
+ * All frames in the cache share the same number of channels and the
+ * same sampling period. Inserting a frame which differs in either
+ * clears the cache before the frame is added.
+ *
+ * The cache is not thread-safe. A BldsClient only accesses its cache
+ * from the thread in which frames are decoded.
+ */
+class LIBBLDS_CLIENT_VISIBILITY DataCache {
+	public:
+
+		/*! Coverage of a range of time by the frames in the cache. */
+		enum Coverage {
+			/*! No part of the range is cached. */
+			NotCovered,
+			/*! Some, but not all, of the range is cached. */
+			PartiallyCovered,
+			/*! The whole range is cached. */
+			Covered
+		};
+
+		/*! Construct an empty, disabled cache. */
+		DataCache();
+
+		/*! Return the maximum duration of data retained, in seconds,
+		 * or 0 if the duration is unbounded.
+		 */
+		float maxDuration() const;
+
+		/*! Set the maximum duration of data retained, in seconds.
+		 *
+		 * Frames are evicted once they end more than this long before
+		 * the end of the latest frame in the cache. A value of 0 removes
+		 * the bound.
+		 */
+		void setMaxDuration(float seconds);
+
+		/*! Return the maximum size of data retained, in bytes, or 0 if
+		 * the size is unbounded.
+		 */
+		qint64 maxSize() const;
+
+		/*! Set the maximum size of data retained, in bytes. A value of
+		 * 0 removes the bound.
+		 */
+		void setMaxSize(qint64 bytes);
+
+		/*! Return true if either bound is set. */
+		bool isEnabled() const;
+
+		/*! Return the size of the samples currently cached, in bytes. */
+		qint64 size() const;
+
+		/*! Return the number of frames currently cached. */
+		int frameCount() const;
+
+		/*! Remove all frames from the cache. */
+		void clear();
+
+		/*! Insert a frame into the cache, evicting older frames if
+		 * either bound is exceeded. Does nothing if the cache is disabled
+		 * or the frame is empty.
+		 *
+		 * The frame is shared, not copied, and so must not be modified
+		 * after it is inserted.
+		 */
+		void insert(const PooledFrame& frame);
+
+		/*! Determine how much of a range of time is cached.
+		 *
+		 * \param start The start of the range.
+		 * \param stop The end of the range.
+		 * \param gapStart Set to the start of the smallest range which,
+		 * 	if fetched, would cover the remainder of the requested range.
+		 * 	Only set if the range is partially covered.
+		 * \param gapStop Set to the end of that range.
+		 */
+		Coverage coverage(float start, float stop,
+				float& gapStart, float& gapStop) const;
+
+		/*! Assemble a single frame covering a range of time.
+		 *
+		 * The returned frame is aligned to the samples of the cached
+		 * frames, and is acquired from the given pool. Samples within
+		 * the range are copied from the cached frames and from `extra`,
+		 * which takes precedence where it overlaps cached data. Samples
+		 * not covered by either are zero.
+		 *
+		 * \param start The start of the range.
+		 * \param stop The end of the range.
+		 * \param pool The pool from which to acquire the frame.
+		 * \param extra A frame, not necessarily cached, providing samples
+		 * 	missing from the cache. May be null.
+		 * \return The assembled frame, or a null frame if neither the
+		 * 	cache nor `extra` overlap the range.
+		 */
+		PooledFrame extract(float start, float stop, FramePool& pool,
+				const PooledFrame& extra = PooledFrame()) const;
+
+		/*! Determine how much of a range of samples is cached.
+		 *
+		 * This is as `coverage()` for a range of time, but compares the
+		 * exact indices of the cached frames' samples. A range is only
+		 * covered by frames whose index is known.
+		 *
+		 * \param start The index of the first sample of the range.
+		 * \param stop The index one past the last sample of the range.
+		 * \param gapStart Set to the first sample of the smallest range
+		 * 	which, if fetched, would cover the remainder of the range.
+		 * \param gapStop Set to the end of that range.
+		 */
+		Coverage coverage(qint64 start, qint64 stop,
+				qint64& gapStart, qint64& gapStop) const;
+
+		/*! Assemble a single frame covering a range of samples.
+		 *
+		 * This is as `extract()` for a range of time, but copies samples
+		 * by their exact indices, and so only uses frames whose index is
+		 * known. The assembled frame has exactly `stop - start` samples,
+		 * and carries the index of its first sample.
+		 *
+		 * \param start The index of the first sample of the range.
+		 * \param stop The index one past the last sample of the range.
+		 * \param clock Converts the indices to the frame's start and stop times.
+		 * \param pool The pool from which to acquire the frame.
+		 * \param extra A frame, not necessarily cached, providing samples
+		 * 	missing from the cache. May be null.
+		 * \return The assembled frame, or a null frame if neither the
+		 * 	cache nor `extra` overlap the range.
+		 */
+		PooledFrame extractSamples(qint64 start, qint64 stop, const SampleClock& clock,
+				FramePool& pool, const PooledFrame& extra = PooledFrame()) const;
+
+	private:
+
+		/* Return the sampling period of a non-empty frame. */
+		static double samplePeriod(const DataFrame& frame);
+
+		/* Copy the samples of a frame overlapping an assembled frame. */
+		static void copyOverlap(const DataFrame& source, DataFrame& dest,
+				double period);
+
+		/* Copy the samples of an indexed frame overlapping an
+		 * assembled, indexed frame.
+		 */
+		static void copySampleOverlap(const PooledFrame& source, PooledFrame& dest);
+
+		/* Evict frames until both bounds are satisfied. */
+		void evict();
+
+		/* Bounds on the cached data, or 0 if unbounded. */
+		float m_maxDuration;
+		qint64 m_maxSize;
+
+		/* Cached frames, by start time. */
+		QMap<float, PooledFrame> m_frames;
+
+		/* Size of the cached samples, in bytes. */
+		qint64 m_size;
+
+		/* Latest end time of any cached frame. */
+		float m_latestStop;
+};
+
+#endif
+
@@ -0,0 +1,196 @@
+/*! \file envelope-stream.h
+ *
+ * Header file declaring the EnvelopeDecimator and EnvelopeStream classes,
+ * which reduce the data streamed by a BldsClient to a min/max envelope
+ * at a rate suitable for display.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#ifndef BLDS_CLIENT_ENVELOPE_STREAM_H
+#define BLDS_CLIENT_ENVELOPE_STREAM_H
+
+#include "libblds-client-global.h"
+#include "blds-client.h"
+#include "frame-pool.h"
+
+#include "blds/include/data-frame.h"
+
+#include <QtCore>
+
+/*! The min/max envelope of a span of data, one row per output bin. */
+struct Envelope {
+	/*! Start time of the first bin. */
+	float start = 0.;
+
+	/*! Stop time of the last bin. */
+	float stop = 0.;
+
+	/*! Minimum raw sample of each bin, one column per channel. */
+	DataFrame::Samples minima;
+
+	/*! Maximum raw sample of each bin, one column per channel. */
+	DataFrame::Samples maxima;
+};
+
+Q_DECLARE_METATYPE(Envelope)
+
+/*! \class EnvelopeDecimator
+ *
+ * The EnvelopeDecimator class computes the minimum and maximum of each
+ * channel over consecutive bins of a fixed number of samples, e.g., one
+ * bin per pixel column of a display.
+ *
+ * Frames are decimated incrementally: a bin left incomplete at the end
+ * of a frame is completed by the samples of the next, so that the bins
+ * are the same however the data is divided into frames. If a frame does
+ * not follow the previous one, or has a different number of channels,
+ * the incomplete bin is discarded and binning starts again.
+ */
+class LIBBLDS_CLIENT_VISIBILITY EnvelopeDecimator {
+	public:
+
+		/*! Construct a decimator.
+		 *
+		 * \param binSize The number of samples in each bin.
+		 */
+		explicit EnvelopeDecimator(int binSize = 1);
+
+		/*! Return the number of samples in each bin. */
+		int binSize() const;
+
+		/*! Set the number of samples in each bin, discarding any
+		 * incomplete bin.
+		 */
+		void setBinSize(int binSize);
+
+		/*! Discard any incomplete bin, as at the start of a new stream. */
+		void reset();
+
+		/*! Decimate the next frame of the stream.
+		 *
+		 * \param frame The frame to decimate.
+		 * \param envelope Filled with the bins completed by the frame.
+		 * \return True if at least one bin was completed.
+		 */
+		bool decimate(const DataFrame& frame, Envelope& envelope);
+
+	private:
+
+		int m_binSize;
+
+		/* Number of samples in the incomplete bin. */
+		int m_filled = 0;
+
+		/* Start time of the incomplete bin, and the expected start
+		 * time of the next frame.
+		 */
+		double m_binStart = 0.;
+		double m_nextStart = 0.;
+
+		/* Extremes of each channel in the incomplete bin. */
+		QVector<qint16> m_minima;
+		QVector<qint16> m_maxima;
+};
+
+/*! \class EnvelopeStream
+ *
+ * The EnvelopeStream class decimates the frames streamed by a BldsClient
+ * into min/max envelopes at a requested output rate, and emits them via
+ * `envelopeReady()`.
+ *
+ * Decimation runs in the thread in which the client decodes frames, so
+ * that a display connected with a queued connection receives only the
+ * envelopes, which are typically several hundred times smaller than the
+ * frames they summarize, and is never asked to keep up with the full
+ * bandwidth of the stream.
+ *
+ * Only the frames streamed by the client are decimated, so that the
+ * responses to requests for other data, such as `BldsClient::getData()`,
+ * do not interrupt the envelope. The stream does not itself request
+ * data, which must be requested from the client with
+ * `BldsClient::requestAllData()`.
+ */
+class LIBBLDS_CLIENT_VISIBILITY EnvelopeStream : public QObject {
+	Q_OBJECT
+
+	public:
+
+		/*! Construct a stream of envelopes of the frames received by a client.
+		 *
+		 * \param client The client whose frames are decimated. It must
+		 * 	outlive the stream.
+		 * \param outputRate The number of bins per second.
+		 * \param parent The parent QObject.
+		 */
+		explicit EnvelopeStream(BldsClient* client, float outputRate = 1000.,
+				QObject* parent = nullptr);
+
+		/*! Destroy a stream.
+		 *
+		 * The stream may be destroyed from any thread. If a frame is being
+		 * decimated, this waits for it to finish. The stream may also be
+		 * destroyed from a slot directly connected to `envelopeReady()`.
+		 */
+		~EnvelopeStream();
+
+		/* Copying is not supported */
+		EnvelopeStream(const EnvelopeStream&) = delete;
+		EnvelopeStream& operator=(const EnvelopeStream&) = delete;
+
+		/*! Return the client whose frames are decimated. */
+		BldsClient* client() const;
+
+		/*! Return the requested number of bins per second. */
+		float outputRate() const;
+
+		/*! Set the requested number of bins per second.
+		 *
+		 * Each bin contains a whole number of samples, so the actual rate
+		 * is the sample rate divided by the nearest whole number, and is
+		 * never more than the sample rate itself.
+		 */
+		void setOutputRate(float rate);
+
+	signals:
+
+		/*! Emitted when one or more bins are completed.
+		 *
+		 * This signal is emitted from the thread in which the client
+		 * decodes frames.
+		 *
+		 * \param envelope The completed bins.
+		 */
+		void envelopeReady(const Envelope& envelope);
+
+	private:
+
+		/* Decimate a streamed frame. */
+		void handleFrame(const PooledFrame& frame);
+
+		/* Shared with the connection to the client, and held while a
+		 * frame is handled. The stream is cleared when it is destroyed.
+		 * The lock is recursive, so that the stream may be destroyed
+		 * while handling a frame.
+		 */
+		struct Guard {
+			QMutex lock { QMutex::Recursive };
+			EnvelopeStream* stream = nullptr;
+		};
+
+		BldsClient* m_client;
+		QMetaObject::Connection m_frameConnection;
+
+		/* Guards the fields below, which are accessed from the thread
+		 * in which the client decodes frames.
+		 */
+		mutable QMutex m_lock;
+		float m_outputRate;
+		float m_sampleRate = 0.;
+		EnvelopeDecimator m_decimator;
+
+		QSharedPointer<Guard> m_guard;
+};
+
+#endif
+
@@ -0,0 +1,117 @@
+/*! \file frame-codec.h
+ *
+ * Header file declaring functions used to encode and decode the samples
+ * of frames sent by the BLDS in a compressed encoding.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#ifndef BLDS_CLIENT_FRAME_CODEC_H
+#define BLDS_CLIENT_FRAME_CODEC_H
+
+#include "libblds-client-global.h"
+
+#include "blds/include/data-frame.h"
+
+#include <cstddef>
+
+#include <QtCore>
+
+/*! Functions used to encode and decode frames sent in compressed form.
+ *
+ * An encoded frame is sent as an `encoded-data` message, whose body is
+ * the header of a serialized DataFrame (start, stop, number of samples
+ * and of channels), followed by the encoding as a 32-bit integer, and
+ * then the encoded samples.
+ *
+ * The samples are encoded channel by channel, i.e., in the column-major
+ * order of a DataFrame. With delta encoding, the first sample of each
+ * channel is sent as is, and each subsequent sample as its difference
+ * from the one before, modulo 2^16. As neighbouring samples of neural
+ * data are strongly correlated, the differences are small, and compress
+ * several times better than the samples themselves.
+ *
+ * LZ4 and zstd compression are only available if the library is built
+ * with `BLDS_CLIENT_HAVE_LZ4` or `BLDS_CLIENT_HAVE_ZSTD` defined, e.g.,
+ * with `qmake CONFIG+=lz4 CONFIG+=zstd`.
+ */
+namespace codec {
+
+/*! Encodings in which the samples of a frame may be sent. */
+enum Encoding {
+	/*! Samples as in a serialized DataFrame. */
+	RawEncoding = 0,
+	/*! Differences between consecutive samples of each channel. */
+	DeltaEncoding = 1,
+	/*! Delta encoding, compressed with LZ4. */
+	DeltaLz4Encoding = 2,
+	/*! Delta encoding, compressed with zstd. */
+	DeltaZstdEncoding = 3
+};
+
+/*! Return the name of an encoding, as used in the `data-encoding`
+ * parameter of the BLDS, or an empty string if it is invalid.
+ */
+LIBBLDS_CLIENT_VISIBILITY const char* encodingName(Encoding encoding);
+
+/*! Return true if the library can encode and decode an encoding. */
+LIBBLDS_CLIENT_VISIBILITY bool isSupported(Encoding encoding);
+
+/*! Encode the samples of a frame.
+ *
+ * \param samples The samples to encode.
+ * \param encoding The encoding to use.
+ * \return The encoded samples, or an empty array if the encoding is
+ * 	not supported.
+ */
+LIBBLDS_CLIENT_VISIBILITY QByteArray encode(const DataFrame::Samples& samples,
+		Encoding encoding);
+
+/*! Decompress encoded samples, leaving any delta encoding in place.
+ *
+ * \param encoding The encoding of the samples.
+ * \param input The encoded samples.
+ * \param size The size of the encoded samples, in bytes.
+ * \param output Receives the uncompressed samples.
+ * \param outputSize The expected size of the uncompressed samples, in bytes.
+ * \return True if the samples were decompressed to exactly the
+ * 	expected size.
+ */
+LIBBLDS_CLIENT_VISIBILITY bool decompress(Encoding encoding,
+		const char* input, std::size_t size, char* output, std::size_t outputSize);
+
+/*! Return the largest size, in bytes, to which encoded samples may
+ * decompress, from the limit on each compressor's ratio, or 0 if the
+ * encoding is not supported.
+ *
+ * \param encoding The encoding of the samples.
+ * \param size The size of the encoded samples, in bytes.
+ */
+LIBBLDS_CLIENT_VISIBILITY quint64 maxDecompressedSize(Encoding encoding, quint64 size);
+
+/*! Return true if samples in an encoding must be decompressed, or
+ * false if the encoded samples may be used as is.
+ */
+LIBBLDS_CLIENT_VISIBILITY bool isCompressed(Encoding encoding);
+
+/*! Compute the running sum of delta-encoded samples of one channel,
+ * recovering the samples themselves, using SSE2 on x86, NEON on ARM,
+ * or a scalar loop otherwise.
+ *
+ * \param input The differences between consecutive samples.
+ * \param output The decoded samples. May be the same as the input.
+ * \param count The number of samples.
+ */
+LIBBLDS_CLIENT_VISIBILITY void integrate(const qint16* input, qint16* output,
+		std::size_t count);
+
+/*! Compute the differences between consecutive samples of one channel,
+ * the inverse of `integrate()`.
+ */
+LIBBLDS_CLIENT_VISIBILITY void difference(const qint16* input, qint16* output,
+		std::size_t count);
+
+} // end codec namespace
+
+#endif
+
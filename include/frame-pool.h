@@ -0,0 +1,235 @@
+/*! \file frame-pool.h
+ *
+ * Header file declaring the FramePool and PooledFrame classes, used
+ * to recycle the storage of DataFrames received by a BldsClient.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#ifndef BLDS_CLIENT_FRAME_POOL_H
+#define BLDS_CLIENT_FRAME_POOL_H
+
+#include "libblds-client-global.h"
+
+#include "blds/include/data-frame.h"
+
+#include <armadillo>
+
+#include <QtCore>
+
+struct FramePoolSlot;
+struct FramePoolPrivate;
+
+/*! \class PooledFrame
+ *
+ * The PooledFrame class is a shared, reference-counted handle to a
+ * DataFrame whose storage is owned by a FramePool. Handles are cheap
+ * to copy, and may be passed freely between threads. When the last
+ * handle to a frame is destroyed, the frame's storage is returned to
+ * its pool, rather than being freed, so that it can be reused for
+ * later frames of the same shape.
+ *
+ * A default-constructed handle is null, and refers to no frame.
+ */
+class LIBBLDS_CLIENT_VISIBILITY PooledFrame {
+	friend class FramePool;
+
+	public:
+
+		/*! Construct a null handle. */
+		PooledFrame();
+
+		/*! Copy a handle, sharing the referenced frame. */
+		PooledFrame(const PooledFrame& other);
+
+		/*! Move a handle, leaving the other null. */
+		PooledFrame(PooledFrame&& other);
+
+		/*! Assign a handle, releasing any frame currently referenced. */
+		PooledFrame& operator=(PooledFrame other);
+
+		/*! Release the referenced frame, if any. */
+		~PooledFrame();
+
+		/*! Return true if the handle references no frame. */
+		bool isNull() const;
+
+		/*! Return the number of handles sharing the referenced frame. */
+		int useCount() const;
+
+		/*! Release the referenced frame, making this handle null. */
+		void reset();
+
+		/*! Return the referenced frame. The handle must not be null. */
+		const DataFrame& frame() const;
+
+		/*! Return the referenced frame for modification.
+		 *
+		 * This is intended for producers of frames, and should only be
+		 * used before a frame is shared with any other handle.
+		 */
+		DataFrame& frame();
+
+		/*! Return true if the frame also carries its samples converted
+		 * to floating point.
+		 */
+		bool hasFloatData() const;
+
+		/*! Return the frame's samples converted to floating point, with
+		 * the same shape as the frame's samples, or an empty matrix if
+		 * the frame was not converted.
+		 */
+		const arma::fmat& floatData() const;
+
+		/*! Return the frame's converted samples for modification.
+		 *
+		 * As with `frame()`, this should only be used by producers.
+		 */
+		arma::fmat& floatData();
+
+		/*! Return true if the frame also carries its samples in
+		 * sample-major order.
+		 */
+		bool hasSampleMajorData() const;
+
+		/*! Return the frame's samples in sample-major order, i.e., with
+		 * one column per sample, so that the channels of each sample are
+		 * contiguous. This is the transpose of the frame's samples, or an
+		 * empty matrix if the frame was not transposed.
+		 */
+		const DataFrame::Samples& sampleMajorData() const;
+
+		/*! Return the frame's sample-major samples for modification.
+		 *
+		 * As with `frame()`, this should only be used by producers.
+		 */
+		DataFrame::Samples& sampleMajorData();
+
+		/*! Return true if the frame carries the exact index of its
+		 * first sample, in the stream of samples of the source.
+		 */
+		bool hasSampleIndex() const;
+
+		/*! Return the index of the frame's first sample since the
+		 * start of the recording, or -1 if it is not known.
+		 *
+		 * Unlike the frame's start time, which is single-precision,
+		 * the index is exact however long the recording. See
+		 * `BldsClient::setSampleRate()`.
+		 */
+		qint64 firstSample() const;
+
+		/*! Return the index one past the frame's last sample, or -1
+		 * if it is not known.
+		 */
+		qint64 stopSample() const;
+
+		/*! Set the index of the frame's first sample, or -1 if it is
+		 * not known. Frames acquired from a pool have no index.
+		 *
+		 * As with `frame()`, this should only be used by producers.
+		 */
+		void setFirstSample(qint64 index);
+
+		const DataFrame& operator*() const { return frame(); }
+		const DataFrame* operator->() const { return &frame(); }
+
+		/*! Swap the frames referenced by two handles. */
+		void swap(PooledFrame& other);
+
+	private:
+
+		/* Construct a handle taking ownership of one reference to a slot. */
+		explicit PooledFrame(FramePoolSlot* slot);
+
+		/* The pool's slot containing the referenced frame. */
+		FramePoolSlot* m_slot;
+};
+
+Q_DECLARE_METATYPE(PooledFrame)
+
+/*! \class FramePool
+ *
+ * The FramePool class maintains a free list of DataFrames, so that
+ * a stream of frames of the same shape may be delivered without
+ * allocating new sample storage for each frame.
+ *
+ * Frames are acquired from the pool as PooledFrame handles. Once
+ * all handles to a frame are released, from any thread, the frame
+ * is returned to the free list. The pool retains at most `capacity()`
+ * idle frames; frames released while the free list is full are
+ * deleted. Handles may outlive the pool which created them.
+ */
+class LIBBLDS_CLIENT_VISIBILITY FramePool {
+	public:
+
+		/*! Construct a pool.
+		 *
+		 * \param capacity The maximum number of idle frames retained.
+		 */
+		explicit FramePool(int capacity = 8);
+
+		/*! Destroy a pool, deleting all idle frames. Frames which are
+		 * still referenced are deleted when their last handle is released.
+		 */
+		~FramePool();
+
+		/* Copying is not supported */
+		FramePool(const FramePool&) = delete;
+		FramePool& operator=(const FramePool&) = delete;
+
+		/*! Additional storage which may be provided with a frame. */
+		enum ExtraStorage {
+			/*! Only the frame's samples. */
+			NoExtraStorage = 0x0,
+			/*! Samples converted to floating point. */
+			FloatStorage = 0x1,
+			/*! Samples in sample-major order. */
+			SampleMajorStorage = 0x2
+		};
+
+		/*! Acquire a frame from the pool.
+		 *
+		 * If an idle frame is available, it is reused, and its sample
+		 * storage is resized only if its shape differs from that requested.
+		 * Otherwise, a new frame is allocated. The contents of the returned
+		 * frame's samples are unspecified.
+		 *
+		 * \param start The start time of the frame.
+		 * \param stop The stop time of the frame.
+		 * \param nsamples The number of samples in the frame.
+		 * \param nchannels The number of channels in the frame.
+		 * \param extra A combination of ExtraStorage flags, giving any
+		 * 	additional storage provided for the frame. This storage is
+		 * 	recycled along with the frame.
+		 */
+		PooledFrame acquire(float start, float stop,
+				arma::uword nsamples, arma::uword nchannels,
+				int extra = NoExtraStorage);
+
+		/*! Return the maximum number of idle frames retained. */
+		int capacity() const;
+
+		/*! Set the maximum number of idle frames retained, deleting
+		 * any idle frames in excess of the new capacity.
+		 */
+		void setCapacity(int capacity);
+
+		/*! Return the number of idle frames currently in the pool. */
+		int idleCount() const;
+
+		/*! Return the total number of allocations made by the pool,
+		 * counting each new frame and each reallocation of a frame's
+		 * samples or extra storage, such as when its shape changes.
+		 */
+		quint64 allocationCount() const;
+
+	private:
+
+		/* Shared state of the pool, which outlives the pool itself
+		 * as long as any of its frames are referenced.
+		 */
+		FramePoolPrivate* d;
+};
+
+#endif
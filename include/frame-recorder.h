@@ -0,0 +1,244 @@
+/*! \file frame-recorder.h
+ *
+ * Header file declaring the FrameRecorder and RecordingReader classes,
+ * used to spill frames received by a BldsClient to memory-mapped files.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#ifndef BLDS_CLIENT_FRAME_RECORDER_H
+#define BLDS_CLIENT_FRAME_RECORDER_H
+
+#include "libblds-client-global.h"
+
+#include "blds/include/data-frame.h"
+
+#include <QtCore>
+
+/*! \class FrameRecorder
+ *
+ * The FrameRecorder class appends the samples of received frames to an
+ * append-only data file, and records the time range, shape and location
+ * of each frame in a small index file alongside it.
+ *
+ * The data file is grown and memory-mapped in large segments, and
+ * samples are copied directly into the mapping, so that long sessions
+ * may be recorded without holding frames in memory. The samples of each
+ * frame are stored exactly as in a DataFrame, i.e., column-major with
+ * each channel contiguous.
+ *
+ * Recordings are read back with the RecordingReader class, which may
+ * be used from any thread or process, including while the recording
+ * is still being written.
+ *
+ * A recorder is not thread-safe, except for `frameCount()` and
+ * `bytesWritten()`, which may be called from any thread.
+ */
+class LIBBLDS_CLIENT_VISIBILITY FrameRecorder {
+	public:
+
+		/*! Entry in the index of a recording, describing one frame. */
+		struct IndexEntry {
+			/*! Start time of the frame. */
+			float start;
+			/*! Stop time of the frame. */
+			float stop;
+			/*! Number of samples in the frame. */
+			quint32 nsamples;
+			/*! Number of channels in the frame. */
+			quint32 nchannels;
+			/*! Offset of the frame's samples in the data file, in bytes. */
+			quint64 offset;
+		};
+
+		/*! Header at the start of an index file. */
+		struct IndexHeader {
+			/*! Identifies the file as an index. */
+			char magic[8];
+			/*! Version of the file format. */
+			quint32 version;
+			/*! Size of each sample in the data file, in bytes. */
+			quint32 sampleSize;
+		};
+
+		/*! Default size of each mapped segment of the data file. */
+		static const qint64 DefaultSegmentSize = 64 * 1024 * 1024;
+
+		/*! Construct a recorder.
+		 *
+		 * \param path The path of the data file. The index is written
+		 * 	to a file of the same name, with `.index` appended.
+		 * \param segmentSize The size by which the data file is grown and
+		 * 	mapped at a time, in bytes.
+		 */
+		explicit FrameRecorder(const QString& path,
+				qint64 segmentSize = DefaultSegmentSize);
+
+		/*! Destroy a recorder, closing its files. */
+		~FrameRecorder();
+
+		/* Copying is not supported */
+		FrameRecorder(const FrameRecorder&) = delete;
+		FrameRecorder& operator=(const FrameRecorder&) = delete;
+
+		/*! Return the path of the index file for a data file. */
+		static QString indexPath(const QString& path);
+
+		/*! Return the path of the data file. */
+		QString path() const;
+
+		/*! Create the data and index files, replacing any existing files.
+		 *
+		 * \return True on success. On failure, `errorString()` describes
+		 * 	the error.
+		 */
+		bool open();
+
+		/*! Close the files, truncating the data file to the data written. */
+		void close();
+
+		/*! Return true if the files are open for recording. */
+		bool isOpen() const;
+
+		/*! Return a description of the last error. */
+		QString errorString() const;
+
+		/*! Append a frame to the recording.
+		 *
+		 * All frames must have the same number of channels as the first.
+		 * A frame with a different number is rejected, and the recording
+		 * remains open.
+		 *
+		 * \return True on success. On failure, `errorString()` describes
+		 * 	the error, and the recording is closed unless the frame was
+		 * 	rejected.
+		 */
+		bool append(const DataFrame& frame);
+
+		/*! Return the number of frames appended. */
+		int frameCount() const;
+
+		/*! Return the number of bytes of samples appended. */
+		qint64 bytesWritten() const;
+
+	private:
+
+		/* Map a new segment of the data file at the current offset,
+		 * large enough for at least the given number of bytes.
+		 */
+		bool mapSegment(qint64 minBytes);
+
+		/* Record an error and close the recording. */
+		bool fail(const QString& msg);
+
+		QString m_path;
+		qint64 m_segmentSize;
+		QFile m_data;
+		QFile m_index;
+		QString m_error;
+
+		/* Currently mapped segment of the data file. */
+		uchar* m_segment = nullptr;
+		qint64 m_segmentOffset = 0;
+		qint64 m_segmentLength = 0;
+
+		/* Offset at which the next frame is written. */
+		QAtomicInteger<qint64> m_offset;
+
+		/* Number of frames written. */
+		QAtomicInt m_frameCount;
+
+		/* Number of channels of the first frame, which all frames must have. */
+		quint32 m_nchannels = 0;
+};
+
+/*! \class RecordingReader
+ *
+ * The RecordingReader class provides read-only access to a recording
+ * written by a FrameRecorder. The data file is memory-mapped, so that
+ * the samples of any frame may be accessed directly, without copying.
+ *
+ * A reader may be opened while the recording is still being written,
+ * and `refresh()` called to pick up frames appended since.
+ */
+class LIBBLDS_CLIENT_VISIBILITY RecordingReader {
+	public:
+
+		/*! Construct a reader.
+		 *
+		 * \param path The path of the data file of the recording.
+		 */
+		explicit RecordingReader(const QString& path);
+
+		/*! Destroy a reader, unmapping its files. */
+		~RecordingReader();
+
+		/* Copying is not supported */
+		RecordingReader(const RecordingReader&) = delete;
+		RecordingReader& operator=(const RecordingReader&) = delete;
+
+		/*! Open and map the recording.
+		 *
+		 * \return True on success. On failure, `errorString()` describes
+		 * 	the error.
+		 */
+		bool open();
+
+		/*! Close the recording. Pointers returned by `samples()` are
+		 * invalidated.
+		 */
+		void close();
+
+		/*! Return true if the recording is open. */
+		bool isOpen() const;
+
+		/*! Return a description of the last error. */
+		QString errorString() const;
+
+		/*! Read any frames appended to the recording since it was opened
+		 * or last refreshed. If the data file has grown, it is mapped
+		 * again, which invalidates pointers returned by `samples()`.
+		 *
+		 * \return True on success.
+		 */
+		bool refresh();
+
+		/*! Return the number of frames in the recording. */
+		int frameCount() const;
+
+		/*! Return the index entry for a frame. */
+		const FrameRecorder::IndexEntry& entry(int index) const;
+
+		/*! Return the index of the frame containing a time, or -1 if
+		 * no frame contains it.
+		 */
+		int findFrame(float time) const;
+
+		/*! Return a pointer to the samples of a frame, in the mapping of
+		 * the data file. The samples are laid out as in a DataFrame, and
+		 * must not be modified.
+		 */
+		const DataFrame::Samples::elem_type* samples(int index) const;
+
+		/*! Return a copy of a frame. */
+		DataFrame frame(int index) const;
+
+	private:
+
+		/* Map the whole data file, if it has grown. */
+		bool mapData();
+
+		QFile m_data;
+		QFile m_index;
+		QString m_error;
+
+		/* Mapping of the data file. */
+		uchar* m_mapping = nullptr;
+		qint64 m_mappingLength = 0;
+
+		/* Entries read from the index file. */
+		QVector<FrameRecorder::IndexEntry> m_entries;
+};
+
+#endif
+
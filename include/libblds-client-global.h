@@ -0,0 +1,20 @@
+/*! \file libblds-client-global.h
+ *
+ * Header file defining macros shared by all public headers of
+ * the libblds-client library.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#ifndef LIBBLDS_CLIENT_GLOBAL_H
+#define LIBBLDS_CLIENT_GLOBAL_H
+
+#include <QtCore>
+
+#ifdef COMPILE_LIBBLDS_CLIENT
+# define LIBBLDS_CLIENT_VISIBILITY Q_DECL_EXPORT
+#else
+# define LIBBLDS_CLIENT_VISIBILITY Q_DECL_IMPORT
+#endif
+
+#endif
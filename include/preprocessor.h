@@ -0,0 +1,133 @@
+/*! \file preprocessor.h
+ *
+ * Header file declaring the Preprocessor class, which applies common
+ * online preprocessing steps to streamed frames.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#ifndef BLDS_CLIENT_PREPROCESSOR_H
+#define BLDS_CLIENT_PREPROCESSOR_H
+
+#include "libblds-client-global.h"
+
+#include <armadillo>
+
+#include <QtCore>
+
+/*! \class Preprocessor
+ *
+ * The Preprocessor class applies a common-average reference and a
+ * band-pass filter to consecutive frames of a continuous stream of data.
+ *
+ * Frames are processed in place, as floating-point samples with the
+ * samples of each channel contiguous. The reference is computed across
+ * channels, separately for each sample. The band-pass filter is a pair
+ * of second-order Butterworth sections, one high-pass and one low-pass,
+ * whose state is kept for each channel between frames, so that frames
+ * are filtered exactly as if the stream were filtered as a whole.
+ *
+ * The filter state assumes consecutive frames follow each other without
+ * gaps, in the same channels. Call `reset()` whenever that is not so.
+ */
+class LIBBLDS_CLIENT_VISIBILITY Preprocessor {
+	public:
+
+		/*! Method used to compute the common reference. */
+		enum Reference {
+			/*! No reference is subtracted. */
+			NoReference,
+			/*! The mean across channels is subtracted from each sample. */
+			MeanReference,
+			/*! The median across channels is subtracted from each sample. */
+			MedianReference
+		};
+
+		/*! Settings of a preprocessor. */
+		struct Settings {
+			Settings() :
+				reference(NoReference),
+				lowCutoff(0.),
+				highCutoff(0.)
+			{
+			}
+
+			/*! Method used to compute the common reference. */
+			Reference reference;
+			/*! Cutoff of the high-pass section, in Hz, or 0 to disable. */
+			float lowCutoff;
+			/*! Cutoff of the low-pass section, in Hz, or 0 to disable.
+			 * The section is also disabled if the cutoff is at or above
+			 * the Nyquist frequency of the data.
+			 */
+			float highCutoff;
+		};
+
+		/*! Construct a preprocessor.
+		 *
+		 * \param settings The preprocessing steps to apply.
+		 */
+		explicit Preprocessor(const Settings& settings = Settings());
+
+		/*! Return the preprocessor's settings. */
+		const Settings& settings() const;
+
+		/*! Change the preprocessor's settings, resetting its state. */
+		void setSettings(const Settings& settings);
+
+		/*! Return true if any preprocessing step is enabled. */
+		bool isEnabled() const;
+
+		/*! Clear the filter state, as at the start of a new stream. */
+		void reset();
+
+		/*! Process a frame of samples in place.
+		 *
+		 * \param samples The samples of the frame, with one column
+		 * 	per channel.
+		 * \param sampleRate The sampling rate of the frame, in Hz. The
+		 * 	filter sections are redesigned only if the rate changes by
+		 * 	more than 0.1%, keeping the filter state, so that a rate
+		 * 	estimated from each frame's times does not disturb them.
+		 */
+		void process(arma::fmat& samples, float sampleRate);
+
+	private:
+
+		/* Coefficients of a second-order section, normalized so
+		 * that a0 is 1.
+		 */
+		struct Biquad {
+			float b0, b1, b2, a1, a2;
+		};
+
+		/* Subtract the common reference from each sample. */
+		void subtractReference(arma::fmat& samples);
+
+		/* Compute the coefficients of the filter sections for a rate.
+		 * The filter state is kept, unless the sections enabled change.
+		 */
+		void design(float sampleRate);
+
+		/* Filter one channel through all sections, in place. */
+		void filter(float* samples, arma::uword nsamples, float* state);
+
+		Settings m_settings;
+
+		/* Sampling rate for which the sections were designed. */
+		float m_sampleRate = 0.;
+
+		/* Enabled filter sections. */
+		QVector<Biquad> m_sections;
+
+		/* Filter state, two values per section per channel. */
+		QVector<float> m_state;
+		arma::uword m_nchannels = 0;
+
+		/* Scratch storage for the reference. */
+		QVector<float> m_reference;
+		QVector<float> m_scratch;
+};
+
+#endif
+
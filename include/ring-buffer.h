@@ -0,0 +1,257 @@
+/*! \file ring-buffer.h
+ *
+ * Header file declaring the RingBuffer class, a bounded lock-free
+ * queue used to hand data from a BldsClient to a consuming thread.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#ifndef BLDS_CLIENT_RING_BUFFER_H
+#define BLDS_CLIENT_RING_BUFFER_H
+
+#include "libblds-client-global.h"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+#include <QtCore>
+
+/*! \class RingBufferBase
+ *
+ * Non-template base of the RingBuffer class, declaring the policies for
+ * handling a full buffer.
+ */
+class RingBufferBase {
+	public:
+
+		/*! Policy used when pushing a value into a full buffer. */
+		enum OverflowPolicy {
+			/*! Discard the oldest value in the buffer to make room. */
+			DropOldest,
+			/*! Discard the value being pushed. */
+			DropNewest,
+			/*! Wait until the consumer makes room, or the buffer is closed. */
+			Block
+		};
+};
+
+/*! \class RingBuffer
+ *
+ * The RingBuffer class is a bounded queue intended for passing values from
+ * a single producing thread to a single consuming thread, without locks and
+ * without involving the Qt event loop.
+ *
+ * The buffer's capacity is fixed at construction, and rounded up to a
+ * power of two. When the buffer is full, new values are handled according
+ * to its OverflowPolicy. Dropped values are counted, and the count may be
+ * queried from any thread.
+ *
+ * The implementation uses per-cell sequence numbers, which allows the
+ * producer to discard the oldest value under the DropOldest policy while
+ * the consumer concurrently pops, without either side taking a lock.
+ */
+template <typename T>
+class RingBuffer : public RingBufferBase {
+	public:
+
+		/*! Construct a buffer.
+		 *
+		 * \param capacity The minimum number of values the buffer holds.
+		 * \param policy The policy used when the buffer is full.
+		 */
+		explicit RingBuffer(std::size_t capacity, OverflowPolicy policy = DropOldest) :
+			m_policy(policy),
+			m_closed(false),
+			m_dropped(0),
+			m_pushPos(0),
+			m_popPos(0)
+		{
+			std::size_t size = 1;
+			while (size < qMax<std::size_t>(capacity, 1))
+				size <<= 1;
+			m_mask = size - 1;
+			m_cells.reset(new Cell[size]);
+			for (std::size_t i = 0; i < size; i++)
+				m_cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+
+		/* Copying is not supported */
+		RingBuffer(const RingBuffer&) = delete;
+		RingBuffer& operator=(const RingBuffer&) = delete;
+
+		/*! Return the number of values the buffer holds. */
+		std::size_t capacity() const { return m_mask + 1; }
+
+		/*! Return the policy used when the buffer is full. */
+		OverflowPolicy overflowPolicy() const { return m_policy; }
+
+		/*! Return the approximate number of values currently in the buffer. */
+		std::size_t size() const
+		{
+			auto push = m_pushPos.load(std::memory_order_acquire);
+			auto pop = m_popPos.load(std::memory_order_acquire);
+			return (push > pop) ? qMin(push - pop, capacity()) : 0;
+		}
+
+		/*! Return true if the buffer is approximately empty. */
+		bool isEmpty() const { return size() == 0; }
+
+		/*! Return the number of values dropped because the buffer was full. */
+		quint64 droppedCount() const { return m_dropped.load(std::memory_order_relaxed); }
+
+		/*! Close the buffer. Pending and future pushes fail, and a producer
+		 * blocked in push() returns immediately. Values already in the
+		 * buffer may still be popped.
+		 */
+		void close() { m_closed.store(true, std::memory_order_release); }
+
+		/*! Return true if the buffer has been closed. */
+		bool isClosed() const { return m_closed.load(std::memory_order_acquire); }
+
+		/*! Push a value into the buffer, applying the overflow policy if full.
+		 *
+		 * This must only be called from the producing thread.
+		 *
+		 * \param value The value to push.
+		 * \return True if the value was pushed, false if it was dropped or
+		 * 	the buffer is closed.
+		 */
+		bool push(T value)
+		{
+			unsigned int spins = 0;
+			while (!isClosed()) {
+				if (tryPush(value))
+					return true;
+				switch (m_policy) {
+					case DropNewest:
+						m_dropped.fetch_add(1, std::memory_order_relaxed);
+						return false;
+					case DropOldest: {
+						T oldest;
+						if (tryPop(oldest))
+							m_dropped.fetch_add(1, std::memory_order_relaxed);
+						break;
+					}
+					case Block:
+						backoff(spins++);
+						break;
+				}
+			}
+			return false;
+		}
+
+		/*! Pop the oldest value from the buffer, if any.
+		 *
+		 * This must only be called from the consuming thread.
+		 *
+		 * \param value Set to the popped value on success.
+		 * \return True if a value was popped, false if the buffer was empty.
+		 */
+		bool tryPop(T& value)
+		{
+			auto pos = m_popPos.load(std::memory_order_relaxed);
+			Cell* cell;
+			while (true) {
+				cell = &m_cells[pos & m_mask];
+				auto seq = cell->sequence.load(std::memory_order_acquire);
+				auto diff = static_cast<std::ptrdiff_t>(seq) -
+					static_cast<std::ptrdiff_t>(pos + 1);
+				if (diff == 0) {
+					if (m_popPos.compare_exchange_weak(pos, pos + 1,
+								std::memory_order_relaxed))
+						break;
+				} else if (diff < 0) {
+					return false;
+				} else {
+					pos = m_popPos.load(std::memory_order_relaxed);
+				}
+			}
+			value = std::move(cell->value);
+			cell->value = T();
+			cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+			return true;
+		}
+
+		/*! Pop the oldest value from the buffer, waiting for one if empty.
+		 *
+		 * The wait polls the buffer with a short backoff, rather than
+		 * sleeping on a lock shared with the producer.
+		 *
+		 * \param value Set to the popped value on success.
+		 * \param msecs The maximum time to wait, or a negative number to wait
+		 * 	until a value is available or the buffer is closed.
+		 * \return True if a value was popped, false on timeout or if the
+		 * 	buffer was closed and is empty.
+		 */
+		bool pop(T& value, int msecs = -1)
+		{
+			QElapsedTimer timer;
+			timer.start();
+			unsigned int spins = 0;
+			while (!tryPop(value)) {
+				if (isClosed() || ((msecs >= 0) && timer.hasExpired(msecs)))
+					return tryPop(value);
+				backoff(spins++);
+			}
+			return true;
+		}
+
+	private:
+
+		struct Cell {
+			std::atomic<std::size_t> sequence;
+			T value;
+		};
+
+		/* Attempt to push without applying the overflow policy. The value
+		 * is moved from only on success.
+		 */
+		bool tryPush(T& value)
+		{
+			auto pos = m_pushPos.load(std::memory_order_relaxed);
+			Cell* cell;
+			while (true) {
+				cell = &m_cells[pos & m_mask];
+				auto seq = cell->sequence.load(std::memory_order_acquire);
+				auto diff = static_cast<std::ptrdiff_t>(seq) -
+					static_cast<std::ptrdiff_t>(pos);
+				if (diff == 0) {
+					if (m_pushPos.compare_exchange_weak(pos, pos + 1,
+								std::memory_order_relaxed))
+						break;
+				} else if (diff < 0) {
+					return false;
+				} else {
+					pos = m_pushPos.load(std::memory_order_relaxed);
+				}
+			}
+			cell->value = std::move(value);
+			cell->sequence.store(pos + 1, std::memory_order_release);
+			return true;
+		}
+
+		/* Yield for the first few attempts, then sleep briefly. */
+		static void backoff(unsigned int spins)
+		{
+			if (spins < 64)
+				QThread::yieldCurrentThread();
+			else
+				QThread::usleep(50);
+		}
+
+		OverflowPolicy m_policy;
+		std::atomic<bool> m_closed;
+		std::atomic<quint64> m_dropped;
+		std::size_t m_mask;
+		std::unique_ptr<Cell[]> m_cells;
+
+		/* Keep the producer and consumer positions on separate cache lines. */
+		char m_pad0[64];
+		std::atomic<std::size_t> m_pushPos;
+		char m_pad1[64];
+		std::atomic<std::size_t> m_popPos;
+};
+
+#endif
@@ -0,0 +1,79 @@
+/*! \file sample-clock.h
+ *
+ * Header file declaring the SampleClock class, which converts between
+ * times in seconds and exact 64-bit sample indices.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#ifndef BLDS_CLIENT_SAMPLE_CLOCK_H
+#define BLDS_CLIENT_SAMPLE_CLOCK_H
+
+#include "libblds-client-global.h"
+
+#include <QtCore>
+
+/*! \class SampleClock
+ *
+ * The SampleClock class converts between the times of a recording, in
+ * seconds, and the indices of its samples, at a fixed sample rate.
+ *
+ * The BLDS sends the start and stop of each frame as single-precision
+ * seconds, which resolve individual samples only for the first minutes
+ * of a recording: at 20 kHz, a float time is ambiguous by more than a
+ * sample after about 3.5 minutes, and by tens of samples after a few
+ * hours. Indices are exact throughout. A frame's index is resolved from
+ * its time, and from the index at which it was expected to start, such
+ * as the end of the previous frame of a stream, whenever the time is
+ * consistent with that expectation.
+ */
+class LIBBLDS_CLIENT_VISIBILITY SampleClock {
+	public:
+
+		/*! Construct a clock.
+		 *
+		 * \param rate The sample rate, in Hz, or 0 if unknown.
+		 */
+		explicit SampleClock(double rate = 0.);
+
+		/*! Return true if the sample rate is known. */
+		bool isValid() const;
+
+		/*! Return the sample rate, in Hz, or 0 if unknown. */
+		double rate() const;
+
+		/*! Set the sample rate, in Hz, or 0 if unknown. */
+		void setRate(double rate);
+
+		/*! Return the index of the sample nearest a time, or -1 if the
+		 * sample rate is unknown.
+		 */
+		qint64 toSample(double seconds) const;
+
+		/*! Return the time of a sample, in seconds, or 0 if the sample
+		 * rate is unknown.
+		 */
+		double toSeconds(qint64 index) const;
+
+		/*! Return the number of samples by which a single-precision time
+		 * may differ from the exact time of a sample, as sent by the BLDS.
+		 */
+		double tolerance(float seconds) const;
+
+		/*! Resolve the index of the first sample of a frame.
+		 *
+		 * \param start The start time of the frame, as sent by the BLDS.
+		 * \param expected The index at which the frame is expected to
+		 * 	start, or -1 if there is no expectation.
+		 * \return The expected index, if the start time is consistent
+		 * 	with it, or else the index nearest the start time; or -1 if
+		 * 	the sample rate is unknown.
+		 */
+		qint64 resolve(float start, qint64 expected = -1) const;
+
+	private:
+		double m_rate;
+};
+
+#endif
+
@@ -0,0 +1,75 @@
+/*! \file sample-conversion.h
+ *
+ * Header file declaring functions for converting raw samples received
+ * from the BLDS to scaled floating-point values, or to other layouts.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#ifndef BLDS_CLIENT_SAMPLE_CONVERSION_H
+#define BLDS_CLIENT_SAMPLE_CONVERSION_H
+
+#include "libblds-client-global.h"
+
+#include <cstddef>
+
+#include <QtCore>
+
+namespace conversion {
+
+/*! Convert raw samples to floating point, computing
+ * `output[i] = gain * input[i] + offset`.
+ *
+ * The conversion uses the widest vector instructions supported by the
+ * processor, selected the first time it is called: AVX2 or SSE2 on x86,
+ * NEON on ARM, or a scalar loop otherwise.
+ *
+ * \param input The raw samples.
+ * \param output The converted samples. May not overlap the input.
+ * \param count The number of samples to convert.
+ * \param gain The factor by which each sample is scaled.
+ * \param offset The value added to each scaled sample.
+ */
+LIBBLDS_CLIENT_VISIBILITY void convert(const qint16* input, float* output,
+		std::size_t count, float gain, float offset);
+
+/*! Return the name of the instruction set used by `convert()`. */
+LIBBLDS_CLIENT_VISIBILITY const char* kernelName();
+
+/*! Transpose a range of channels of channel-major samples, in which
+ * the samples of each channel are contiguous, into sample-major order,
+ * in which the channels of each sample are contiguous.
+ *
+ * The transpose is done in small square blocks, so that both input
+ * and output stay in cache, rather than striding through the whole
+ * output for every input sample.
+ *
+ * \param input The channel-major samples of all channels.
+ * \param output The sample-major samples of all channels.
+ * \param nsamples The number of samples in each channel.
+ * \param nchannels The total number of channels.
+ * \param first The first channel to transpose.
+ * \param count The number of channels to transpose.
+ */
+LIBBLDS_CLIENT_VISIBILITY void transpose(const qint16* input, qint16* output,
+		std::size_t nsamples, std::size_t nchannels,
+		std::size_t first, std::size_t count);
+
+/*! Update the minimum and maximum of a run of raw samples.
+ *
+ * The samples are compared using SSE2 on x86, NEON on ARM, or a scalar
+ * loop otherwise. The initial values of `min` and `max` are included
+ * in the comparison, so that long runs may be processed in pieces.
+ *
+ * \param input The raw samples.
+ * \param count The number of samples.
+ * \param min The minimum, updated in place.
+ * \param max The maximum, updated in place.
+ */
+LIBBLDS_CLIENT_VISIBILITY void minMax(const qint16* input, std::size_t count,
+		qint16& min, qint16& max);
+
+} // end conversion namespace
+
+#endif
+
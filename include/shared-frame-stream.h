@@ -0,0 +1,117 @@
+/*! \file shared-frame-stream.h
+ *
+ * Header file declaring the SharedFrameStream class, which shares the
+ * data streamed by one BldsClient among many consumers.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#ifndef BLDS_CLIENT_SHARED_FRAME_STREAM_H
+#define BLDS_CLIENT_SHARED_FRAME_STREAM_H
+
+#include "libblds-client-global.h"
+#include "blds-client.h"
+#include "frame-pool.h"
+#include "ring-buffer.h"
+
+#include <QtCore>
+
+/*! \class SharedFrameStream
+ *
+ * The SharedFrameStream class distributes the frames streamed by a single
+ * BldsClient to any number of subscribers in the same process, so that
+ * each frame is sent by the BLDS and decoded by the client only once,
+ * however many consumers use it.
+ *
+ * Each subscriber receives its own FrameRing, with its own depth and
+ * overflow policy, so that a slow subscriber only loses its own frames
+ * and does not hold back the others. Subscribers share the frames
+ * themselves, which are reference-counted and must not be modified.
+ *
+ * The stream requests all data from the BLDS when the first subscriber
+ * subscribes, and cancels the request when the last one unsubscribes.
+ * A subscriber may unsubscribe explicitly, or simply release its ring.
+ *
+ * Subscribers cannot use the FrameRing::Block policy, which would stall
+ * the client while the subscriber's ring is full, and so hold back every
+ * other subscriber.
+ *
+ * Only frames streamed after `BldsClient::requestAllData()` are shared,
+ * and not frames answering requests for data made by other consumers
+ * of the client.
+ */
+class LIBBLDS_CLIENT_VISIBILITY SharedFrameStream : public QObject {
+	Q_OBJECT
+
+	public:
+
+		/*! Construct a stream of the frames received by a client.
+		 *
+		 * \param client The client whose frames are shared. It must
+		 * 	outlive the stream.
+		 * \param parent The parent QObject.
+		 */
+		explicit SharedFrameStream(BldsClient* client, QObject* parent = nullptr);
+
+		/*! Destroy a stream, closing all subscribers' rings. */
+		~SharedFrameStream();
+
+		/* Copying is not supported */
+		SharedFrameStream(const SharedFrameStream&) = delete;
+		SharedFrameStream& operator=(const SharedFrameStream&) = delete;
+
+		/*! Return the client whose frames are shared. */
+		BldsClient* client() const;
+
+		/*! Add a subscriber to the stream.
+		 *
+		 * \param depth The number of frames the subscriber's ring can hold.
+		 * \param policy The policy applied when a frame is received while
+		 * 	the subscriber's ring is full. FrameRing::Block is not
+		 * 	supported.
+		 * \return The subscriber's ring, from which it pops frames, or a
+		 * 	null pointer if the policy is FrameRing::Block.
+		 */
+		QSharedPointer<FrameRing> subscribe(int depth,
+				FrameRing::OverflowPolicy policy = FrameRing::DropOldest);
+
+		/*! Remove a subscriber from the stream, closing its ring. */
+		void unsubscribe(const QSharedPointer<FrameRing>& ring);
+
+		/*! Return the number of current subscribers. */
+		int subscriberCount() const;
+
+	private:
+
+		/* Push a frame into every subscriber's ring. */
+		void handleFrame(const PooledFrame& frame);
+
+		/* Remove subscribers which have released their rings, and cancel
+		 * the request for data if none remain. Called with the lock held.
+		 */
+		void pruneSubscribers();
+
+		BldsClient* m_client;
+
+		/* Guards the list of subscribers, which is read from the thread
+		 * in which the client decodes frames.
+		 */
+		mutable QMutex m_lock;
+
+		/* Rings of the current subscribers. They are shared with, and
+		 * owned by, the subscribers.
+		 */
+		QVector<QWeakPointer<FrameRing> > m_subscribers;
+
+		/* True if all data is currently requested from the BLDS. */
+		bool m_requested = false;
+
+		/* Rings into which the current frame is pushed, kept between
+		 * frames to reuse its storage. Only accessed from the thread in
+		 * which the client decodes frames.
+		 */
+		QVector<QSharedPointer<FrameRing> > m_rings;
+};
+
+#endif
+
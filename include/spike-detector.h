@@ -0,0 +1,177 @@
+/*! \file spike-detector.h
+ *
+ * Header file declaring the SpikeDetector class, which detects threshold
+ * crossings in consecutive frames of a continuous stream of data.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#ifndef BLDS_CLIENT_SPIKE_DETECTOR_H
+#define BLDS_CLIENT_SPIKE_DETECTOR_H
+
+#include "libblds-client-global.h"
+
+#include <armadillo>
+
+#include <QtCore>
+
+/*! A single threshold crossing detected on one channel. */
+struct SpikeEvent {
+	/*! Channel on which the crossing occurred, i.e., the column of
+	 * the frames in which it was detected.
+	 */
+	quint32 channel;
+
+	/*! Index of the crossing sample, counted from the first sample
+	 * processed by the detector.
+	 */
+	quint64 sample;
+
+	/*! Time of the crossing sample. */
+	float time;
+
+	/*! Value of the sample of largest magnitude in the snippet following
+	 * the crossing, on the side of the threshold crossed.
+	 */
+	float amplitude;
+};
+
+/*! Events detected in one frame of data. */
+struct SpikeBatch {
+	/*! Start time of the frame in which the events were detected. */
+	float start = 0.;
+
+	/*! Stop time of the frame in which the events were detected. */
+	float stop = 0.;
+
+	/*! Detected events, in order of channel, then sample. */
+	QVector<SpikeEvent> events;
+
+	/*! Number of samples in each snippet, or 0 if snippets are not
+	 * extracted.
+	 */
+	int snippetLength = 0;
+
+	/*! Snippets of each event, concatenated in the order of `events`. */
+	QVector<float> snippets;
+};
+
+Q_DECLARE_METATYPE(SpikeBatch)
+
+/*! \class SpikeDetector
+ *
+ * The SpikeDetector class finds threshold crossings on each channel of
+ * consecutive frames of data, using a threshold adapted to the noise
+ * level of each channel.
+ *
+ * The noise of each channel is estimated from the median absolute value
+ * of its samples in each frame, which is robust to the spikes themselves,
+ * and smoothed from frame to frame. A crossing is detected where a sample
+ * passes a fixed multiple of the noise, provided none was detected on the
+ * same channel within the refractory period.
+ *
+ * The last few samples of each channel are kept between frames, so that
+ * crossings near the boundary of a frame are detected exactly once, with
+ * complete snippets. As a result, crossings in the last `postSamples` samples
+ * of a frame are reported with the following frame.
+ */
+class LIBBLDS_CLIENT_VISIBILITY SpikeDetector {
+	public:
+
+		/*! Direction in which the threshold must be crossed. */
+		enum Polarity {
+			/*! Samples falling below the negative threshold. */
+			Negative,
+			/*! Samples rising above the positive threshold. */
+			Positive,
+			/*! Crossings of either threshold. */
+			Both
+		};
+
+		/*! Settings of a detector. */
+		struct Settings {
+			Settings() :
+				enabled(false),
+				threshold(4.5),
+				polarity(Negative),
+				refractorySamples(30),
+				preSamples(10),
+				postSamples(22),
+				snippets(false),
+				noiseAdaptation(0.05)
+			{
+			}
+
+			/*! True if detection is enabled. */
+			bool enabled;
+			/*! Threshold, as a multiple of the noise of each channel. */
+			float threshold;
+			/*! Direction in which the threshold must be crossed. */
+			Polarity polarity;
+			/*! Minimum number of samples between events on a channel. */
+			int refractorySamples;
+			/*! Number of samples before each crossing in its snippet. */
+			int preSamples;
+			/*! Number of samples from each crossing in its snippet. */
+			int postSamples;
+			/*! True if snippets are extracted. */
+			bool snippets;
+			/*! Weight of each frame's noise estimate in the smoothed
+			 * estimate, between 0 and 1.
+			 */
+			float noiseAdaptation;
+		};
+
+		/*! Construct a detector. */
+		explicit SpikeDetector(const Settings& settings = Settings());
+
+		/*! Return the detector's settings. */
+		const Settings& settings() const;
+
+		/*! Change the detector's settings, resetting its state. */
+		void setSettings(const Settings& settings);
+
+		/*! Clear the noise estimates and retained samples, as at the
+		 * start of a new stream.
+		 */
+		void reset();
+
+		/*! Return the current noise estimate of each channel. */
+		const QVector<float>& noise() const;
+
+		/*! Detect crossings in the next frame of the stream.
+		 *
+		 * \param samples The samples of the frame, one column per channel.
+		 * \param start The start time of the frame.
+		 * \param stop The stop time of the frame.
+		 * \param batch Filled with the detected events.
+		 */
+		void detect(const arma::fmat& samples, float start, float stop,
+				SpikeBatch& batch);
+
+	private:
+
+		/* State kept for each channel between frames. */
+		struct Channel {
+			QVector<float> carry; // last samples of the previous frame
+			float noise = 0.;
+			qint64 lastEvent = -1; // sample index of the last event
+		};
+
+		/* Estimate the noise of one channel of a frame. */
+		float estimateNoise(const float* samples, arma::uword nsamples);
+
+		Settings m_settings;
+		QVector<Channel> m_channels;
+		QVector<float> m_noise;
+
+		/* Index of the first sample of the next frame. */
+		quint64 m_nextSample = 0;
+
+		/* Scratch storage. */
+		QVector<float> m_signal;
+		QVector<float> m_magnitudes;
+};
+
+#endif
+
@@ -34,10 +34,50 @@ win32 {
 	LIBS += -ldata-source
 }
 
+# Optional compression of streamed data, e.g., qmake CONFIG+=lz4
+lz4 {
+	DEFINES += BLDS_CLIENT_HAVE_LZ4
+	LIBS += -llz4
+}
+zstd {
+	DEFINES += BLDS_CLIENT_HAVE_ZSTD
+	LIBS += -lzstd
+}
+
 mac {
 	QMAKE_SONAME_PREFIX += @rpath
 }
 
 # Input
-HEADERS += include/blds-client.h
-SOURCES += src/blds-client.cc
+HEADERS += include/libblds-client-global.h \
+	include/blds-client.h \
+	include/blds-client-group.h \
+	include/bulk-fetcher.h \
+	include/channel-processor.h \
+	include/client-statistics.h \
+	include/data-cache.h \
+	include/envelope-stream.h \
+	include/frame-codec.h \
+	include/frame-pool.h \
+	include/frame-recorder.h \
+	include/preprocessor.h \
+	include/ring-buffer.h \
+	include/sample-clock.h \
+	include/sample-conversion.h \
+	include/shared-frame-stream.h \
+	include/spike-detector.h
+SOURCES += src/blds-client.cc \
+	src/blds-client-group.cc \
+	src/bulk-fetcher.cc \
+	src/channel-processor.cc \
+	src/client-statistics.cc \
+	src/data-cache.cc \
+	src/envelope-stream.cc \
+	src/frame-codec.cc \
+	src/frame-pool.cc \
+	src/frame-recorder.cc \
+	src/preprocessor.cc \
+	src/sample-clock.cc \
+	src/sample-conversion.cc \
+	src/shared-frame-stream.cc \
+	src/spike-detector.cc
@@ -0,0 +1,220 @@
+/*! \file blds-client-group.cc
+ *
+ * Implementation of the BldsClientGroup class.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#include "blds-client-group.h"
+
+#include <cstring>
+#include <limits>
+
+BldsClientGroup::BldsClientGroup(QObject* parent) :
+	QObject(parent)
+{
+	qRegisterMetaType<QVector<PooledFrame> >();
+}
+
+BldsClientGroup::~BldsClientGroup()
+{
+	/* Delete the clients first, stopping their I/O threads, so that
+	 * no frames are delivered while the group is being destroyed.
+	 */
+	qDeleteAll(m_clients);
+	m_clients.clear();
+}
+
+int BldsClientGroup::addClient(const QString& hostname, quint16 port)
+{
+	const int source = m_clients.size();
+	auto client = new BldsClient(hostname, port, this);
+	client->setUseIoThread(true);
+	QObject::connect(client, &BldsClient::frameReceived,
+			this, [this, source](const PooledFrame& frame) -> void {
+				handleFrame(source, frame);
+			}, Qt::DirectConnection);
+	QObject::connect(client, &BldsClient::error,
+			this, [this, source](const QString& msg) -> void {
+				emit error(source, msg);
+			});
+
+	QMutexLocker lock(&m_lock);
+	m_clients.append(client);
+	m_pending.append(QQueue<PooledFrame>());
+	return source;
+}
+
+int BldsClientGroup::count() const
+{
+	return m_clients.size();
+}
+
+BldsClient* BldsClientGroup::client(int source) const
+{
+	return m_clients.value(source, nullptr);
+}
+
+float BldsClientGroup::alignmentTolerance() const
+{
+	QMutexLocker lock(&m_lock);
+	return m_tolerance;
+}
+
+void BldsClientGroup::setAlignmentTolerance(float tolerance)
+{
+	QMutexLocker lock(&m_lock);
+	m_tolerance = qMax(tolerance, 0.f);
+}
+
+int BldsClientGroup::maxPendingFrames() const
+{
+	QMutexLocker lock(&m_lock);
+	return m_maxPending;
+}
+
+void BldsClientGroup::setMaxPendingFrames(int count)
+{
+	QMutexLocker lock(&m_lock);
+	m_maxPending = qMax(count, 1);
+}
+
+bool BldsClientGroup::mergeFrames() const
+{
+	QMutexLocker lock(&m_lock);
+	return m_merge;
+}
+
+void BldsClientGroup::setMergeFrames(bool merge)
+{
+	QMutexLocker lock(&m_lock);
+	m_merge = merge;
+}
+
+quint64 BldsClientGroup::droppedCount() const
+{
+	QMutexLocker lock(&m_lock);
+	return m_dropped;
+}
+
+void BldsClientGroup::connect()
+{
+	for (auto client : m_clients)
+		client->connect();
+}
+
+void BldsClientGroup::disconnect()
+{
+	for (auto client : m_clients)
+		client->disconnect();
+}
+
+void BldsClientGroup::requestAllData(bool request)
+{
+	clearPending();
+	for (auto client : m_clients)
+		client->requestAllData(request);
+}
+
+void BldsClientGroup::clearPending()
+{
+	QMutexLocker lock(&m_lock);
+	for (auto& queue : m_pending)
+		queue.clear();
+}
+
+void BldsClientGroup::handleFrame(int source, const PooledFrame& frame)
+{
+	emit frameReceived(source, frame);
+
+	/* Collect the aligned sets under the lock, but emit them only once
+	 * it is released, so that handlers may call back into the group.
+	 */
+	QVector<QVector<PooledFrame> > sets;
+	bool mergeSets = false;
+	{
+		QMutexLocker lock(&m_lock);
+		collectAligned(source, frame, sets);
+		mergeSets = m_merge;
+	}
+	for (const auto& frames : sets) {
+		emit framesAligned(frames);
+		if (mergeSets) {
+			QString msg;
+			auto merged = merge(frames, msg);
+			if (merged.isNull())
+				emit error(-1, msg);
+			else
+				emit frameMerged(merged);
+		}
+	}
+}
+
+void BldsClientGroup::collectAligned(int source, const PooledFrame& frame,
+		QVector<QVector<PooledFrame> >& sets)
+{
+	auto& queue = m_pending[source];
+	queue.enqueue(frame);
+	if (queue.size() > m_maxPending) {
+		queue.dequeue();
+		m_dropped++;
+	}
+
+	/* Emit sets for as long as every source has a frame waiting. Frames
+	 * starting before the latest of the oldest waiting frames, by more
+	 * than the tolerance, can never be aligned and are dropped.
+	 */
+	while (true) {
+		float latest = -std::numeric_limits<float>::max();
+		for (const auto& pending : m_pending) {
+			if (pending.isEmpty())
+				return;
+			latest = qMax(latest, pending.head()->start());
+		}
+
+		bool aligned = true;
+		for (auto& pending : m_pending) {
+			while (!pending.isEmpty() && (pending.head()->start() < latest - m_tolerance)) {
+				pending.dequeue();
+				m_dropped++;
+				aligned = false;
+			}
+		}
+		if (!aligned)
+			continue;
+
+		QVector<PooledFrame> frames;
+		frames.reserve(m_pending.size());
+		for (auto& pending : m_pending)
+			frames.append(pending.dequeue());
+		sets.append(frames);
+	}
+}
+
+PooledFrame BldsClientGroup::merge(const QVector<PooledFrame>& frames, QString& msg)
+{
+	using Sample = DataFrame::Samples::elem_type;
+	const auto nsamples = frames.first()->nsamples();
+	arma::uword nchannels = 0;
+	for (const auto& frame : frames) {
+		if (frame->nsamples() != nsamples) {
+			msg = "Cannot merge aligned frames with different numbers of samples";
+			return PooledFrame();
+		}
+		nchannels += frame->nchannels();
+	}
+
+	/* Channels are contiguous, so each frame is copied as a block. */
+	auto merged = m_mergePool.acquire(frames.first()->start(),
+			frames.first()->stop(), nsamples, nchannels);
+	auto& samples = merged.frame().data();
+	arma::uword column = 0;
+	for (const auto& frame : frames) {
+		if (frame->data().n_elem > 0) {
+			std::memcpy(samples.colptr(column), frame->data().memptr(),
+					frame->data().n_elem * sizeof(Sample));
+		}
+		column += frame->nchannels();
+	}
+	return merged;
+}
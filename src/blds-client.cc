@@ -6,20 +6,173 @@
  */
 
 #include "blds-client.h"
+#include "sample-conversion.h"
 
 #include "libdata-source/include/data-source.h" // for (de)serialization methods
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+/* Largest size of the samples of a frame accepted from the BLDS, in
+ * bytes, so that a corrupt header cannot cause an enormous allocation.
+ */
+const quint64 MaxFrameSize = Q_UINT64_C(1) << 30;
+
+/* FNV-1a hash of a string, usable at compile time to build the
+ * dispatch tables for message types and parameter names.
+ */
+constexpr quint32 fnv1a(const char* str, std::size_t length,
+		quint32 hash = 2166136261u)
+{
+	return (length == 0) ? hash :
+		fnv1a(str + 1, length - 1, (hash ^ static_cast<quint8>(*str)) * 16777619u);
+}
+
+template <std::size_t N>
+constexpr quint32 hashOf(const char (&str)[N])
+{
+	return fnv1a(str, N - 1);
+}
+
+/* Return true if a string of the given length equals a literal. */
+template <std::size_t N>
+bool equals(const char* str, std::size_t length, const char (&literal)[N])
+{
+	return (length == N - 1) && (std::memcmp(str, literal, N - 1) == 0);
+}
+
+/* Decoders used for the values of server parameters. */
+enum ParamDecoder {
+	StringDecoder,
+	UIntDecoder,
+	FloatDecoder,
+	BoolDecoder,
+	ErrorDecoder
+};
+
+ParamDecoder serverParamDecoder(const char* param, std::size_t length)
+{
+	switch (fnv1a(param, length)) {
+		case hashOf("save-file"):
+			return equals(param, length, "save-file") ? StringDecoder : ErrorDecoder;
+		case hashOf("save-directory"):
+			return equals(param, length, "save-directory") ? StringDecoder : ErrorDecoder;
+		case hashOf("data-encoding"):
+			return equals(param, length, "data-encoding") ? StringDecoder : ErrorDecoder;
+		case hashOf("source-location"):
+			return equals(param, length, "source-location") ? StringDecoder : ErrorDecoder;
+		case hashOf("start-time"):
+			return equals(param, length, "start-time") ? StringDecoder : ErrorDecoder;
+		case hashOf("recording-length"):
+			return equals(param, length, "recording-length") ? UIntDecoder : ErrorDecoder;
+		case hashOf("read-interval"):
+			return equals(param, length, "read-interval") ? UIntDecoder : ErrorDecoder;
+		case hashOf("recording-position"):
+			return equals(param, length, "recording-position") ? FloatDecoder : ErrorDecoder;
+		case hashOf("source-exists"):
+			return equals(param, length, "source-exists") ? BoolDecoder : ErrorDecoder;
+		case hashOf("recording-exists"):
+			return equals(param, length, "recording-exists") ? BoolDecoder : ErrorDecoder;
+		default:
+			return ErrorDecoder;
+	}
+}
+
+/* Return the fields of a JSON object which differ from an older version,
+ * with those removed set to null.
+ */
+QJsonObject changedFields(const QJsonObject& old, const QJsonObject& current)
+{
+	QJsonObject changed;
+	for (auto it = current.constBegin(); it != current.constEnd(); ++it) {
+		if (old.value(it.key()) != it.value())
+			changed.insert(it.key(), it.value());
+	}
+	for (auto it = old.constBegin(); it != old.constEnd(); ++it) {
+		if (!current.contains(it.key()))
+			changed.insert(it.key(), QJsonValue());
+	}
+	return changed;
+}
+
+} // end anonymous namespace
+
+BldsClient::MessageType BldsClient::messageType(const char* type, std::size_t length)
+{
+	/* Check for data first, as it is by far the most frequent message. */
+	if (equals(type, length, "data"))
+		return DataMessage;
+	if (equals(type, length, "encoded-data"))
+		return EncodedDataMessage;
+	switch (fnv1a(type, length)) {
+		case hashOf("source-created"):
+			return equals(type, length, "source-created") ?
+				SourceCreatedMessage : UnknownMessage;
+		case hashOf("source-deleted"):
+			return equals(type, length, "source-deleted") ?
+				SourceDeletedMessage : UnknownMessage;
+		case hashOf("set"):
+			return equals(type, length, "set") ? SetMessage : UnknownMessage;
+		case hashOf("get"):
+			return equals(type, length, "get") ? GetMessage : UnknownMessage;
+		case hashOf("set-source"):
+			return equals(type, length, "set-source") ? SetSourceMessage : UnknownMessage;
+		case hashOf("get-source"):
+			return equals(type, length, "get-source") ? GetSourceMessage : UnknownMessage;
+		case hashOf("recording-started"):
+			return equals(type, length, "recording-started") ?
+				RecordingStartedMessage : UnknownMessage;
+		case hashOf("recording-stopped"):
+			return equals(type, length, "recording-stopped") ?
+				RecordingStoppedMessage : UnknownMessage;
+		case hashOf("get-all-data"):
+			return equals(type, length, "get-all-data") ?
+				GetAllDataMessage : UnknownMessage;
+		case hashOf("error"):
+			return equals(type, length, "error") ? ErrorMessage : UnknownMessage;
+		default:
+			return UnknownMessage;
+	}
+}
+
 BldsClient::BldsClient(const QString& hostname, quint16 port, QObject *parent) :
 	QObject(parent),
 	m_hostname(hostname),
 	m_port(port)
 {
+	qRegisterMetaType<PooledFrame>();
+	qRegisterMetaType<SpikeBatch>();
+	qRegisterMetaType<QAbstractSocket::SocketError>();
+
 	m_socket = new QTcpSocket(this);
 	m_stream.setDevice(m_socket);
 	m_stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
 	m_stream.setByteOrder(QDataStream::LittleEndian);
+	/* Always read in the socket's own thread, whichever that is. */
 	QObject::connect(m_socket, &QAbstractSocket::readyRead,
-			this, &BldsClient::handleReadyRead);
+			this, &BldsClient::handleReadyRead, Qt::DirectConnection);
+	QObject::connect(m_socket, &QAbstractSocket::disconnected,
+			this, [this]() -> void {
+				failPendingRequests("Disconnected from BLDS");
+			}, Qt::DirectConnection);
+	QObject::connect(m_socket, &QAbstractSocket::connected,
+			this, &BldsClient::applySocketOptions, Qt::DirectConnection);
+	QObject::connect(m_socket, &QAbstractSocket::stateChanged,
+			this, &BldsClient::handleSocketStateChanged, Qt::DirectConnection);
+
+	/* The timer is a child of the socket, so that it moves to the
+	 * I/O thread with it.
+	 */
+	m_reconnectTimer = new QTimer(m_socket);
+	m_reconnectTimer->setSingleShot(true);
+	QObject::connect(m_reconnectTimer, &QTimer::timeout, this, [this]() -> void {
+				resetParser();
+				m_socket->connectToHost(m_hostname, m_port);
+			}, Qt::DirectConnection);
 
 	m_manager = new QNetworkAccessManager(this);
 	m_serverUrl.setScheme("http");
@@ -33,12 +186,101 @@ BldsClient::BldsClient(const QString& hostname, quint16 port, QObject *parent) :
 	m_sourceUrl.setPort(BldsHttpPort);
 	m_sourceUrl.setPath(BldsSourceStatusPath);
 	m_sourceRequest.setUrl(m_sourceUrl);
+
+	m_statusTimer = new QTimer(this);
+	QObject::connect(m_statusTimer, &QTimer::timeout, this, [this]() -> void {
+				requestServerStatus();
+				requestSourceStatus();
+			});
+
+	m_statisticsTimer = new QTimer(this);
+	QObject::connect(m_statisticsTimer, &QTimer::timeout,
+			this, &BldsClient::reportStatistics);
 }
 
 BldsClient::~BldsClient()
 {
-	if (isConnected())
-		m_socket->disconnectFromHost();
+	/* Close the frame ring before any blocking hand-off to the I/O
+	 * thread, which may be blocked pushing into a full ring.
+	 */
+	closeFrameRing();
+	if (m_ioThread) {
+		QMetaObject::invokeMethod(m_socket, [this]() -> void {
+					m_ioReconnect.active = false;
+					m_reconnectTimer->stop();
+					if (isConnected())
+						m_socket->disconnectFromHost();
+				}, Qt::BlockingQueuedConnection);
+		m_ioThread->quit();
+		m_ioThread->wait();
+		delete m_socket;
+	} else {
+		m_ioReconnect.active = false;
+		m_reconnectTimer->stop();
+		if (isConnected())
+			m_socket->disconnectFromHost();
+	}
+}
+
+template <typename Function>
+void BldsClient::runOnIoThread(Function&& function)
+{
+	if (QThread::currentThread() == m_socket->thread()) {
+		function();
+	} else {
+		QMetaObject::invokeMethod(m_socket, std::forward<Function>(function),
+				Qt::QueuedConnection);
+	}
+}
+
+template <typename Function>
+void BldsClient::runOnClientThread(Function&& function)
+{
+	if (QThread::currentThread() == thread()) {
+		function();
+	} else {
+		QMetaObject::invokeMethod(this, std::forward<Function>(function),
+				Qt::QueuedConnection);
+	}
+}
+
+void BldsClient::reportError(const QString& msg)
+{
+	runOnClientThread([this, msg]() -> void { emit error(msg); });
+}
+
+bool BldsClient::usesIoThread() const
+{
+	return m_ioThread != nullptr;
+}
+
+void BldsClient::setUseIoThread(bool use)
+{
+	if (use == usesIoThread())
+		return;
+	if (isConnected()) {
+		emit error("Cannot change the I/O thread while connected to BLDS");
+		return;
+	}
+
+	if (use) {
+		m_ioThread = new QThread(this);
+		m_ioThread->setObjectName("blds-client-io");
+		m_socket->setParent(nullptr);
+		m_socket->moveToThread(m_ioThread);
+		m_ioThread->start();
+	} else {
+		closeFrameRing(); // the I/O thread may be blocked pushing into it
+		auto clientThread = thread();
+		QMetaObject::invokeMethod(m_socket, [this, clientThread]() -> void {
+					m_socket->moveToThread(clientThread);
+				}, Qt::BlockingQueuedConnection);
+		m_ioThread->quit();
+		m_ioThread->wait();
+		delete m_ioThread;
+		m_ioThread = nullptr;
+		m_socket->setParent(this);
+	}
 }
 
 bool BldsClient::isConnected() const
@@ -52,26 +294,41 @@ void BldsClient::connect()
 		emit error("Already connected to BLDS");
 		return;
 	}
-	QObject::connect(m_socket, &QAbstractSocket::connected,
+
+	/* Only the one-shot handlers are removed once the connection is made
+	 * or fails, leaving those made in the constructor.
+	 */
+	QObject::disconnect(m_connectedConnection);
+	QObject::disconnect(m_connectErrorConnection);
+	m_connectedConnection = QObject::connect(m_socket, &QAbstractSocket::connected,
 			this, [this]() -> void {
-				QObject::disconnect(m_socket, &QAbstractSocket::connected, 0, 0);
-				QObject::disconnect(m_socket,
-						static_cast<void(QAbstractSocket::*)(QAbstractSocket::SocketError)>(
-							&QAbstractSocket::error), 0, 0);
-				QObject::connect(m_socket,
+				QObject::disconnect(m_connectedConnection);
+				QObject::disconnect(m_connectErrorConnection);
+				QObject::disconnect(m_errorConnection);
+				/* Read the error in the socket's thread, as it may have
+				 * changed by the time a queued handler runs.
+				 */
+				m_errorConnection = QObject::connect(m_socket,
 						static_cast<void(QAbstractSocket::*)(QAbstractSocket::SocketError)>(
 							&QAbstractSocket::error), this, [this]() -> void {
-								emit error(m_socket->errorString());
-						});
+								reportError(m_socket->errorString());
+						}, Qt::DirectConnection);
 				emit connected(true);
 			});
-	QObject::connect(m_socket, 
+	m_connectErrorConnection = QObject::connect(m_socket, 
 			static_cast<void(QAbstractSocket::*)(QAbstractSocket::SocketError)>(
 				&QAbstractSocket::error),
-			this, [&,this](QAbstractSocket::SocketError /* err */) -> void {
+			this, [this](QAbstractSocket::SocketError /* err */) -> void {
+				QObject::disconnect(m_connectedConnection);
+				QObject::disconnect(m_connectErrorConnection);
 				emit connected(false);
 			});
-	m_socket->connectToHost(m_hostname, m_port);
+	runOnIoThread([this]() -> void {
+				m_reconnectTimer->stop();
+				m_ioReconnect.attempt = 0;
+				resetReadState();
+				m_socket->connectToHost(m_hostname, m_port);
+			});
 }
 
 void BldsClient::disconnect()
@@ -79,328 +336,2023 @@ void BldsClient::disconnect()
 	if (!isConnected()) {
 		emit error("Not connected to BLDS");
 	}
-	QObject::disconnect(m_socket, &QAbstractSocket::disconnected, 0, 0);
-	QObject::disconnect(m_socket,
-			static_cast<void(QAbstractSocket::*)(QAbstractSocket::SocketError)>(
-				&QAbstractSocket::error), 0, 0);
-	QObject::connect(m_socket, &QAbstractSocket::disconnected, 
-			this, &BldsClient::disconnected);
-	m_socket->disconnectFromHost();
+	QObject::disconnect(m_connectedConnection);
+	QObject::disconnect(m_connectErrorConnection);
+	QObject::disconnect(m_errorConnection);
+	if (!m_disconnectedConnection) {
+		m_disconnectedConnection = QObject::connect(m_socket,
+				&QAbstractSocket::disconnected, this, &BldsClient::disconnected);
+	}
+	runOnIoThread([this]() -> void {
+				m_ioReconnect.active = false;
+				m_reconnectTimer->stop();
+				m_socket->disconnectFromHost();
+			});
 }
 
-void BldsClient::createSource(const QString& type, const QString& location)
+bool BldsClient::autoReconnect() const
 {
-	QByteArray buffer { "create-source\n" };
-	buffer.append(type);
-	buffer.append("\n");
-	buffer.append(location);
-	m_stream << buffer;
+	return m_autoReconnect;
+}
+
+void BldsClient::setAutoReconnect(bool enable, int initialDelay, int maxDelay)
+{
+	m_autoReconnect = enable;
+	runOnIoThread([this, enable, initialDelay, maxDelay]() -> void {
+				m_ioReconnect.enabled = enable;
+				m_ioReconnect.initialDelay = qMax(initialDelay, 0);
+				m_ioReconnect.maxDelay = qMax(maxDelay, m_ioReconnect.initialDelay);
+				m_ioReconnect.active = enable && isConnected();
+				if (!enable) {
+					m_reconnectTimer->stop();
+					m_ioReconnect.attempt = 0;
+				}
+			});
+}
+
+void BldsClient::handleSocketStateChanged(QAbstractSocket::SocketState state)
+{
+	if (state == QAbstractSocket::ConnectedState) {
+		m_ioReconnect.active = m_ioReconnect.enabled;
+		if (m_ioReconnect.attempt > 0) {
+			m_ioReconnect.attempt = 0;
+			runOnClientThread([this]() -> void { emit reconnected(); });
+			resumeStream();
+		}
+	} else if ( (state == QAbstractSocket::UnconnectedState) &&
+			m_ioReconnect.enabled && m_ioReconnect.active ) {
+		scheduleReconnect();
+	}
+}
+
+void BldsClient::scheduleReconnect()
+{
+	const int attempt = ++m_ioReconnect.attempt;
+	qint64 delay = m_ioReconnect.initialDelay;
+	for (int i = 1; (i < attempt) && (delay < m_ioReconnect.maxDelay); i++)
+		delay *= 2;
+	const int wait = qMin<qint64>(delay, m_ioReconnect.maxDelay);
+	m_reconnectTimer->start(wait);
+	runOnClientThread([this, attempt, wait]() -> void {
+				emit reconnecting(attempt, wait);
+			});
+}
+
+void BldsClient::resumeStream()
+{
+	if (!m_requestAllData)
+		return;
+	if (!m_hasLastStreamedStop) {
+		sendAllDataRequest(true, RequestPromise(), true);
+		return;
+	}
+
+	/* Find how far the recording has progressed, and fetch the data
+	 * missed before streaming again. The BLDS answers in order, so the
+	 * backfilled data arrives before any live frame.
+	 */
+	auto id = nextRequestId();
+	addPendingRequest(id, "get", "recording-position");
+	m_pendingRequests.last().internal = true;
+	m_pendingRequests.last().callback = [this](bool success, const QVariant& result) -> void {
+		if (!isConnected())
+			return;
+		const float position = result.toFloat();
+		if (success && (position >= m_lastStreamedStop)) {
+			m_seamPending = true;
+			if (position > m_lastStreamedStop) {
+				/* Start exactly at the next sample, if it is known. */
+				float start = m_lastStreamedStop;
+				if (m_lastStreamedSample >= 0)
+					start = m_ioClock.toSeconds(m_lastStreamedSample);
+				addPendingRequest(nextRequestId(), "data", QString(), start, position);
+				auto& request = m_pendingRequests.last();
+				request.backfill = true;
+				request.firstSample = m_lastStreamedSample;
+				writeMessage(encodeGetData(start, position));
+			}
+		}
+		sendAllDataRequest(true, RequestPromise(), true);
+	};
+	QByteArray message;
+	appendMessage(message, encodeGet("recording-position"));
+	writeMessage(message);
+}
+
+bool BldsClient::trimToSeam(PooledFrame& frame)
+{
+	const auto nsamples = frame->nsamples();
+	if (nsamples == 0)
+		return false;
+	const double period = (static_cast<double>(frame->stop()) - frame->start()) / nsamples;
+	arma::uword skip = 0;
+	if (frame.hasSampleIndex() && (m_lastStreamedSample >= 0)) {
+		if (frame.stopSample() <= m_lastStreamedSample)
+			return false; // already delivered
+		skip = qMax<qint64>(0, m_lastStreamedSample - frame.firstSample());
+	} else {
+		if (frame->stop() <= m_lastStreamedStop + 0.5 * period)
+			return false;
+		skip = static_cast<arma::uword>(qMax(0., std::round(
+						(m_lastStreamedStop - frame->start()) / period)));
+	}
+	if (skip == 0)
+		return true;
+
+	/* Copy the samples not yet delivered, in each layout provided. */
+	int extra = FramePool::NoExtraStorage;
+	if (frame.hasFloatData())
+		extra |= FramePool::FloatStorage;
+	if (frame.hasSampleMajorData())
+		extra |= FramePool::SampleMajorStorage;
+	auto trimmed = m_framePool.acquire(frame->start() + skip * period, frame->stop(),
+			nsamples - skip, frame->nchannels(), extra);
+	if (frame.hasSampleIndex())
+		trimmed.setFirstSample(frame.firstSample() + skip);
+	trimmed.frame().data() = frame->data().rows(skip, nsamples - 1);
+	if (frame.hasFloatData())
+		trimmed.floatData() = frame.floatData().rows(skip, nsamples - 1);
+	if (frame.hasSampleMajorData())
+		trimmed.sampleMajorData() = frame.sampleMajorData().cols(skip, nsamples - 1);
+	frame.swap(trimmed);
+	return true;
 }
 
-void BldsClient::deleteSource()
+quint64 BldsClient::createSource(const QString& type, const QString& location)
+{
+	return sendRequest("source-created", QString(), encodeCreateSource(type, location));
+}
+
+quint64 BldsClient::deleteSource()
 {
 	QByteArray buffer { "delete-source\n" };
-	m_stream << buffer;
+	return sendRequest("source-deleted", QString(), buffer);
 }
 
-void BldsClient::startRecording()
+quint64 BldsClient::startRecording()
 {
 	QByteArray buffer { "start-recording\n" };
-	m_stream << buffer;
+	return sendRequest("recording-started", QString(), buffer);
 }
 
-void BldsClient::stopRecording()
+quint64 BldsClient::stopRecording()
 {
 	QByteArray buffer { "stop-recording\n" };
-	m_stream << buffer;
+	return sendRequest("recording-stopped", QString(), buffer);
+}
+
+quint64 BldsClient::requestAllData(bool request)
+{
+	return sendAllDataRequest(request, RequestPromise());
 }
 
-void BldsClient::requestAllData(bool request)
+quint64 BldsClient::sendAllDataRequest(bool request, const RequestPromise& promise,
+		bool internal)
 {
-	m_requestAllData = request;
+	auto id = nextRequestId();
 	QByteArray buffer { "get-all-data\n" };
-	quint32 size = buffer.size() + 1;
-	m_stream << size;
-	m_socket->write(buffer);
-	m_stream << request;
+	buffer.append(static_cast<char>(request));
+	QByteArray message;
+	appendMessage(message, buffer);
+	runOnIoThread([this, id, request, message, promise, internal]() -> void {
+				m_requestAllData = request;
+				addPendingRequest(id, "get-all-data", QString(), 0., 0., 0, promise);
+				m_pendingRequests.last().internal = internal;
+				writeMessage(message);
+			});
+	return id;
 }
 
-void BldsClient::getData(float start, float stop)
+quint64 BldsClient::getData(float start, float stop)
 {
-	QByteArray buffer { "get-data\n" };
-	quint32 msgSize = buffer.size() + 2 * sizeof(float);
-	m_stream << msgSize;
-	m_socket->write(buffer);
-	m_stream << start << stop;
+	return sendDataRequest(start, stop, RequestPromise());
 }
 
-void BldsClient::get(const QString& param)
+quint64 BldsClient::sendDataRequest(float start, float stop, const RequestPromise& promise)
 {
-	QByteArray buffer { "get\n" };
-	buffer.append(param.toUtf8());
-	buffer.append("\n");
-	m_stream << buffer;
+	auto id = nextRequestId();
+	runOnIoThread([this, id, start, stop, promise]() -> void {
+				float gapStart = start, gapStop = stop;
+				auto coverage = m_dataCache.coverage(start, stop, gapStart, gapStop);
+				if (coverage == DataCache::Covered) {
+					auto frame = m_dataCache.extract(start, stop, m_framePool);
+					processFrame(frame);
+					PendingRequest request;
+					request.id = id;
+					request.responseType = "data";
+					request.start = start;
+					request.stop = stop;
+					request.batch = 0;
+					request.promise = promise;
+					publishFrame(frame);
+					finishRequest(request, true, QVariant::fromValue(frame));
+					return;
+				}
+
+				/* Fetch only the missing range, and merge it with the cache. */
+				addPendingRequest(id, "data", QString(), gapStart, gapStop, 0, promise);
+				if (coverage == DataCache::PartiallyCovered) {
+					auto& request = m_pendingRequests.last();
+					request.merge = true;
+					request.mergeStart = start;
+					request.mergeStop = stop;
+				}
+				writeMessage(encodeGetData(gapStart, gapStop));
+			});
+	return id;
 }
 
-void BldsClient::getSource(const QString& param)
+quint64 BldsClient::getDataSamples(qint64 start, qint64 stop)
 {
-	QByteArray buffer { "get-source\n" };
-	buffer.append(param.toUtf8());
-	buffer.append("\n");
-	m_stream << buffer;
+	return sendDataSamplesRequest(start, stop, RequestPromise());
 }
 
-void BldsClient::set(const QString& param, const QVariant& data)
+quint64 BldsClient::sendDataSamplesRequest(qint64 start, qint64 stop,
+		const RequestPromise& promise)
 {
-	QByteArray buffer { "set\n" };
-	buffer.append(param);
-	buffer.append("\n");
-	if ( (param == "save-file") || (param == "save-directory") ) {
-		buffer.append(data.toByteArray());
-	} else if ( (param == "recording-length") || (param == "read-interval") ) {
-		quint32 val = data.toUInt();
-		auto oldSize = buffer.size();
-		buffer.resize(oldSize + sizeof(val));
-		std::memcpy(buffer.data() + oldSize, &val, sizeof(val));
+	if (m_sampleRate <= 0) {
+		reportError("The sample rate must be known to get data by sample");
+		resolvePromise(promise, 0, false, QString("Sample rate is unknown"));
+		return 0;
 	}
-	m_stream << buffer;
+	auto id = nextRequestId();
+	runOnIoThread([this, id, start, stop, promise]() -> void {
+				qint64 gapStart = start, gapStop = stop;
+				auto coverage = m_dataCache.coverage(start, stop, gapStart, gapStop);
+				if (coverage == DataCache::Covered) {
+					auto frame = m_dataCache.extractSamples(start, stop,
+							m_ioClock, m_framePool);
+					processFrame(frame);
+					PendingRequest request;
+					request.id = id;
+					request.responseType = "data";
+					request.batch = 0;
+					request.promise = promise;
+					publishFrame(frame);
+					finishRequest(request, true, QVariant::fromValue(frame));
+					return;
+				}
+
+				/* Fetch only the missing samples, and merge them with the cache. */
+				const float fetchStart = m_ioClock.toSeconds(gapStart);
+				const float fetchStop = m_ioClock.toSeconds(gapStop);
+				addPendingRequest(id, "data", QString(), fetchStart, fetchStop, 0, promise);
+				auto& request = m_pendingRequests.last();
+				request.firstSample = gapStart;
+				request.stopSample = gapStop;
+				if (coverage == DataCache::PartiallyCovered) {
+					request.merge = true;
+					request.mergeFirstSample = start;
+					request.mergeStopSample = stop;
+				}
+				writeMessage(encodeGetData(fetchStart, fetchStop));
+			});
+	return id;
 }
 
-void BldsClient::setSource(const QString& param, const QVariant& data)
+QByteArray BldsClient::encodeGetData(float start, float stop)
 {
-	QByteArray buffer = { "set-source\n" };
-	buffer.append(param.toUtf8() + "\n");
-	buffer.append(datasource::serialize(param, data));
-	m_stream << buffer;
+	QByteArray buffer { "get-data\n" };
+	auto oldSize = buffer.size();
+	buffer.resize(oldSize + 2 * sizeof(float));
+	std::memcpy(buffer.data() + oldSize, &start, sizeof(start));
+	std::memcpy(buffer.data() + oldSize + sizeof(start), &stop, sizeof(stop));
+	QByteArray message;
+	appendMessage(message, buffer);
+	return message;
 }
 
-void BldsClient::handleReadyRead()
+quint64 BldsClient::get(const QString& param)
 {
-	do {
-		quint32 size = 0;
-		if (m_socket->peek(reinterpret_cast<char*>(&size), sizeof(size)) <
-				static_cast<qint64>(sizeof(size))) {
-			return; // size not yet available
-		}
+	return sendRequest("get", param, encodeGet(param));
+}
 
-		/* Check if full message is available */
-		if (m_socket->bytesAvailable() < static_cast<qint64>(size - sizeof(size))) {
-			return;
-		}
+quint64 BldsClient::getSource(const QString& param)
+{
+	return sendRequest("get-source", param, encodeGetSource(param));
+}
 
-		m_socket->read(sizeof(size)); // ignore size, already read
-		handleMessage(size);
-	} while (true);
+quint64 BldsClient::set(const QString& param, const QVariant& data)
+{
+	return sendRequest("set", param, encodeSet(param, data));
 }
 
-void BldsClient::handleMessage(quint32 size)
+quint64 BldsClient::setSource(const QString& param, const QVariant& data)
 {
-	/* Read message type */
-	auto type = m_socket->readLine();
-	if (type.size() == 0) {
-		emit error("Received malformed message from BLDS");
-		return;
-	}
-	size -= type.size();
-	type.chop(1); // remove newline
-
-	if (type == "source-created") {
-		handleCreateSourceResponse(size);
-	} else if (type == "source-deleted") {
-		handleDeleteSourceResponse(size);
-	} else if (type == "set") {
-		handleSetResponse(size);
-	} else if (type == "get") {
-		handleGetResponse(size);
-	} else if (type == "set-source") {
-		handleSetSourceResponse(size);
-	} else if (type == "get-source") {
-		handleGetSourceResponse(size);
-	} else if (type == "recording-started") {
-		handleStartRecordingResponse(size);
-	} else if (type == "recording-stopped") {
-		handleStopRecordingResponse(size);
-	} else if (type == "data") {
-		handleDataMessage(size);
-	} else if (type == "get-all-data") {
-		handleRequestAllDataResponse(size);
-	} else if (type == "error") {
-		emit error(QString::fromUtf8(m_socket->read(size)));
-	} else {
-		emit error("Unknown message type received from BLDS: " + 
-				m_socket->read(size));
-	}
+	return sendRequest("set-source", param, encodeSetSource(param, data));
 }
 
-bool BldsClient::parseSuccessAndStringMessage(quint32 size, QString& msg)
+quint64 BldsClient::getMany(const QStringList& params)
 {
-	bool success;
-	m_stream >> success;
-	size -= 1;
-	if (!success) {
-		msg = QString::fromUtf8(m_socket->read(size));
-	}
-	return success;
+	return sendBatch("get", encodeGetMany(params));
 }
 
-void BldsClient::handleCreateSourceResponse(quint32 size)
+quint64 BldsClient::getSourceMany(const QStringList& params)
 {
-	QString msg;
-	bool success = parseSuccessAndStringMessage(size, msg);
-	emit sourceCreated(success, msg);
+	return sendBatch("get-source", encodeGetSourceMany(params));
 }
 
-void BldsClient::handleDeleteSourceResponse(quint32 size)
+quint64 BldsClient::setMany(const QVariantMap& params)
 {
-	QString msg;
-	bool success = parseSuccessAndStringMessage(size, msg);
-	emit sourceDeleted(success, msg);
+	return sendBatch("set", encodeSetMany(params));
 }
 
-void BldsClient::handleSetResponse(quint32 size)
+quint64 BldsClient::setSourceMany(const QVariantMap& params)
 {
-	bool success;
-	m_stream >> success;
-	size -= 1;
-	QString param = QString::fromUtf8(m_socket->readLine());
-	size -= param.size();
-	param.chop(1);
-	QString msg = QString::fromUtf8(m_socket->read(size));
-	emit setResponse(param, success, msg);
+	return sendBatch("set-source", encodeSetSourceMany(params));
 }
 
-void BldsClient::handleGetResponse(quint32 size)
+BldsClient::RequestFuture BldsClient::createSourceAsync(const QString& type,
+		const QString& location)
 {
-	bool success;
-	m_stream >> success;
-	size -= 1;
-	QString param = QString::fromUtf8(m_socket->readLine());
-	size -= param.size();
-	param.chop(1);
-	QVariant data;
+	auto promise = createPromise();
+	sendRequest("source-created", QString(), encodeCreateSource(type, location), promise);
+	return promise->future();
+}
 
-	if ( (param == "save-file") || (param == "save-directory") ||
-			(param == "source-location") || (param == "start-time") ) {
-		data = QString::fromUtf8(m_socket->read(size));
-	} else if ( (param == "recording-length") || (param == "read-interval") ) {
-		quint32 val = 0;
-		m_socket->read(reinterpret_cast<char*>(&val), sizeof(val));
-		data = val;
-	} else if (param == "recording-position") {
-		float val = 0.;
-		m_socket->read(reinterpret_cast<char*>(&val), sizeof(val));
-		data = val;
-	} else if ( (param == "source-exists") || (param == "recording-exists") ) {
-		bool val = false;
-		m_socket->read(reinterpret_cast<char*>(&val), sizeof(val));
-		data = val;
-	} else {
-		data = QString::fromUtf8(m_socket->read(size)); // error message
-	}
-	emit getResponse(param, success, data);
+BldsClient::RequestFuture BldsClient::deleteSourceAsync()
+{
+	auto promise = createPromise();
+	sendRequest("source-deleted", QString(), "delete-source\n", promise);
+	return promise->future();
 }
 
-void BldsClient::handleSetSourceResponse(quint32 size)
+BldsClient::RequestFuture BldsClient::startRecordingAsync()
 {
-	bool success;
-	m_stream >> success;
-	size -= 1;
-	QString param = QString::fromUtf8(m_socket->readLine());
-	size -= param.size();
-	param.chop(1);
-	QString msg = QString::fromUtf8(m_socket->read(size));
-	emit setSourceResponse(param, success, msg);
+	auto promise = createPromise();
+	sendRequest("recording-started", QString(), "start-recording\n", promise);
+	return promise->future();
 }
 
-void BldsClient::handleGetSourceResponse(quint32 size)
+BldsClient::RequestFuture BldsClient::stopRecordingAsync()
 {
-	bool success;
-	m_stream >> success;
-	size -= 1;
-	QString param = QString::fromUtf8(m_socket->readLine());
-	size -= param.size();
-	param.chop(1);
-	auto buffer = m_socket->read(size);
-	QVariant data = datasource::deserialize(param.toUtf8(), buffer);
-	emit getSourceResponse(param, success, data);
+	auto promise = createPromise();
+	sendRequest("recording-stopped", QString(), "stop-recording\n", promise);
+	return promise->future();
 }
 
-void BldsClient::handleStartRecordingResponse(quint32 size)
+BldsClient::RequestFuture BldsClient::setSourceAsync(const QString& param,
+		const QVariant& data)
 {
-	QString msg;
-	bool success = parseSuccessAndStringMessage(size, msg);
-	emit recordingStarted(success, msg);
+	auto promise = createPromise();
+	sendRequest("set-source", param, encodeSetSource(param, data), promise);
+	return promise->future();
 }
 
-void BldsClient::handleStopRecordingResponse(quint32 size)
+BldsClient::RequestFuture BldsClient::getSourceAsync(const QString& param)
 {
-	QString msg;
-	bool success = parseSuccessAndStringMessage(size, msg);
-	emit recordingStopped(success, msg);
+	auto promise = createPromise();
+	sendRequest("get-source", param, encodeGetSource(param), promise);
+	return promise->future();
 }
 
-void BldsClient::handleRequestAllDataResponse(quint32 size)
+BldsClient::RequestFuture BldsClient::setAsync(const QString& param, const QVariant& data)
 {
-	QString msg;
-	bool success = parseSuccessAndStringMessage(size, msg);
-	emit requestAllDataResponse(success, msg);
+	auto promise = createPromise();
+	sendRequest("set", param, encodeSet(param, data), promise);
+	return promise->future();
 }
 
-void BldsClient::handleDataMessage(quint32 size)
+BldsClient::RequestFuture BldsClient::getAsync(const QString& param)
 {
-	emit data(DataFrame::deserialize(m_socket->read(size)));
+	auto promise = createPromise();
+	sendRequest("get", param, encodeGet(param), promise);
+	return promise->future();
 }
 
-void BldsClient::handleError(quint32 size)
+BldsClient::RequestFuture BldsClient::getManyAsync(const QStringList& params)
 {
-	QString msg = QString::fromUtf8(m_socket->read(size));
-	emit error(msg);
+	auto promise = createPromise();
+	sendBatch("get", encodeGetMany(params), promise);
+	return promise->future();
 }
 
-QString BldsClient::address() const
+BldsClient::RequestFuture BldsClient::setManyAsync(const QVariantMap& params)
 {
-	return QString("%1:%2").arg(m_hostname).arg(m_port);
+	auto promise = createPromise();
+	sendBatch("set", encodeSetMany(params), promise);
+	return promise->future();
 }
 
-QString BldsClient::hostname() const
+BldsClient::RequestFuture BldsClient::getSourceManyAsync(const QStringList& params)
 {
-	return m_hostname;
+	auto promise = createPromise();
+	sendBatch("get-source", encodeGetSourceMany(params), promise);
+	return promise->future();
 }
 
-quint16 BldsClient::port() const
+BldsClient::RequestFuture BldsClient::setSourceManyAsync(const QVariantMap& params)
 {
-	return m_port;
+	auto promise = createPromise();
+	sendBatch("set-source", encodeSetSourceMany(params), promise);
+	return promise->future();
 }
 
-void BldsClient::requestServerStatus()
+BldsClient::RequestFuture BldsClient::requestAllDataAsync(bool request)
 {
-	m_serverReply = m_manager->get(m_serverRequest);
-	QObject::connect(m_serverReply, &QNetworkReply::finished,
-			this, &BldsClient::handleServerStatusReply);
+	auto promise = createPromise();
+	sendAllDataRequest(request, promise);
+	return promise->future();
 }
 
-void BldsClient::requestSourceStatus()
+BldsClient::RequestFuture BldsClient::getDataAsync(float start, float stop)
 {
-	m_sourceReply = m_manager->get(m_sourceRequest);
-	QObject::connect(m_sourceReply, &QNetworkReply::finished,
-			this, &BldsClient::handleSourceStatusReply);
+	auto promise = createPromise();
+	sendDataRequest(start, stop, promise);
+	return promise->future();
 }
 
-void BldsClient::handleServerStatusReply()
+BldsClient::RequestFuture BldsClient::getDataSamplesAsync(qint64 start, qint64 stop)
 {
-	QObject::disconnect(m_serverReply, &QNetworkReply::finished,
-			this, &BldsClient::handleServerStatusReply);
-	emit serverStatus(QJsonDocument::fromJson(m_serverReply->readAll()).object());
-	m_serverReply->deleteLater();
+	auto promise = createPromise();
+	sendDataSamplesRequest(start, stop, promise);
+	return promise->future();
 }
 
-void BldsClient::handleSourceStatusReply()
+BldsClient::RequestPromise BldsClient::createPromise()
 {
-	QObject::disconnect(m_sourceReply, &QNetworkReply::finished,
-			this, &BldsClient::handleSourceStatusReply);
-	emit sourceStatus(
-			m_sourceReply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 200,
-			QJsonDocument::fromJson(m_sourceReply->readAll()).object());
-	m_sourceReply->deleteLater();
+	/* Cancel the future if the promise is released unfinished, e.g.,
+	 * if the client is destroyed with the request outstanding, so
+	 * that nothing waits on it forever.
+	 */
+	RequestPromise promise(new QFutureInterface<RequestResult>(),
+			[](QFutureInterface<RequestResult>* p) -> void {
+				if (!p->isFinished()) {
+					p->reportCanceled();
+					p->reportFinished();
+				}
+				delete p;
+			});
+	promise->reportStarted();
+	return promise;
+}
+
+void BldsClient::resolvePromise(const RequestPromise& promise, quint64 id,
+		bool success, const QVariant& result)
+{
+	if (!promise)
+		return;
+	RequestResult r;
+	r.id = id;
+	r.success = success;
+	r.data = result;
+	promise->reportResult(r);
+	promise->reportFinished();
+}
+
+QByteArray BldsClient::encodeCreateSource(const QString& type, const QString& location)
+{
+	QByteArray buffer { "create-source\n" };
+	buffer.append(type);
+	buffer.append("\n");
+	buffer.append(location);
+	return buffer;
+}
+
+QList<QPair<QString, QByteArray> > BldsClient::encodeGetMany(const QStringList& params)
+{
+	QList<QPair<QString, QByteArray> > messages;
+	for (const auto& param : params)
+		messages.append(qMakePair(param, encodeGet(param)));
+	return messages;
+}
+
+QList<QPair<QString, QByteArray> > BldsClient::encodeGetSourceMany(const QStringList& params)
+{
+	QList<QPair<QString, QByteArray> > messages;
+	for (const auto& param : params)
+		messages.append(qMakePair(param, encodeGetSource(param)));
+	return messages;
+}
+
+QList<QPair<QString, QByteArray> > BldsClient::encodeSetMany(const QVariantMap& params)
+{
+	QList<QPair<QString, QByteArray> > messages;
+	for (auto it = params.constBegin(); it != params.constEnd(); ++it)
+		messages.append(qMakePair(it.key(), encodeSet(it.key(), it.value())));
+	return messages;
+}
+
+QList<QPair<QString, QByteArray> > BldsClient::encodeSetSourceMany(const QVariantMap& params)
+{
+	QList<QPair<QString, QByteArray> > messages;
+	for (auto it = params.constBegin(); it != params.constEnd(); ++it)
+		messages.append(qMakePair(it.key(), encodeSetSource(it.key(), it.value())));
+	return messages;
+}
+
+QByteArray BldsClient::encodeGet(const QString& param)
+{
+	QByteArray buffer { "get\n" };
+	buffer.append(param.toUtf8());
+	buffer.append("\n");
+	return buffer;
+}
+
+QByteArray BldsClient::encodeGetSource(const QString& param)
+{
+	QByteArray buffer { "get-source\n" };
+	buffer.append(param.toUtf8());
+	buffer.append("\n");
+	return buffer;
+}
+
+QByteArray BldsClient::encodeSet(const QString& param, const QVariant& data)
+{
+	QByteArray buffer { "set\n" };
+	buffer.append(param);
+	buffer.append("\n");
+	if ( (param == "save-file") || (param == "save-directory") ||
+			(param == "data-encoding") ) {
+		buffer.append(data.toByteArray());
+	} else if ( (param == "recording-length") || (param == "read-interval") ) {
+		quint32 val = data.toUInt();
+		auto oldSize = buffer.size();
+		buffer.resize(oldSize + sizeof(val));
+		std::memcpy(buffer.data() + oldSize, &val, sizeof(val));
+	}
+	return buffer;
+}
+
+QByteArray BldsClient::encodeSetSource(const QString& param, const QVariant& data)
+{
+	QByteArray buffer = { "set-source\n" };
+	buffer.append(param.toUtf8() + "\n");
+	buffer.append(datasource::serialize(param, data));
+	return buffer;
+}
+
+void BldsClient::appendMessage(QByteArray& buffer, const QByteArray& message)
+{
+	/* Equivalent to writing the message through a little-endian
+	 * QDataStream, which prefixes it with its 32-bit length.
+	 */
+	quint32 size = message.size();
+	auto oldSize = buffer.size();
+	buffer.resize(oldSize + sizeof(size));
+	qToLittleEndian(size, buffer.data() + oldSize);
+	buffer.append(message);
+}
+
+quint64 BldsClient::nextRequestId()
+{
+	return m_nextRequestId.fetchAndAddRelaxed(1) + 1;
+}
+
+quint64 BldsClient::sendRequest(const QByteArray& responseType,
+		const QString& param, const QByteArray& buffer, const RequestPromise& promise)
+{
+	/* Frame the message here, so that it is sent with a single write. */
+	QByteArray message;
+	appendMessage(message, buffer);
+	auto id = nextRequestId();
+	runOnIoThread([this, id, responseType, param, message, promise]() -> void {
+				addPendingRequest(id, responseType, param, 0., 0., 0, promise);
+				writeMessage(message);
+			});
+	return id;
+}
+
+quint64 BldsClient::sendBatch(const QByteArray& responseType,
+		const QList<QPair<QString, QByteArray> >& messages, const RequestPromise& promise)
+{
+	/* Coalesce all messages into a single write. */
+	QByteArray buffer;
+	QStringList params;
+	for (const auto& message : messages) {
+		appendMessage(buffer, message.second);
+		params.append(message.first);
+	}
+
+	auto id = nextRequestId();
+	runOnIoThread([this, id, responseType, params, buffer, promise]() -> void {
+				PendingBatch batch;
+				batch.responseType = responseType;
+				batch.remaining = params.size();
+				batch.success = true;
+				batch.promise = promise;
+				if (params.isEmpty()) {
+					finishBatch(id, batch);
+					return;
+				}
+				m_pendingBatches.insert(id, batch);
+				for (const auto& param : params)
+					addPendingRequest(nextRequestId(), responseType, param, 0., 0., id);
+				writeMessage(buffer);
+			});
+	return id;
+}
+
+void BldsClient::addPendingRequest(quint64 id, const QByteArray& responseType,
+		const QString& param, float start, float stop, quint64 batch,
+		const RequestPromise& promise)
+{
+	PendingRequest request;
+	request.id = id;
+	request.responseType = responseType;
+	request.param = param;
+	request.start = start;
+	request.stop = stop;
+	request.batch = batch;
+	request.promise = promise;
+	request.sentTime = m_statistics.now();
+	m_pendingRequests.append(request);
+}
+
+void BldsClient::finishRequest(const PendingRequest& request,
+		bool success, const QVariant& result)
+{
+	if (request.batch == 0) {
+		auto id = request.id;
+		if (request.callback)
+			request.callback(success, result);
+		resolvePromise(request.promise, id, success, result);
+		if (!request.internal) {
+			runOnClientThread([this, id, success, result]() -> void {
+						emit requestFinished(id, success, result);
+					});
+		}
+		return;
+	}
+
+	auto it = m_pendingBatches.find(request.batch);
+	if (it == m_pendingBatches.end())
+		return;
+	it->success &= success;
+	it->results.insert(request.param, result);
+	if (--it->remaining == 0) {
+		auto batch = it.value();
+		m_pendingBatches.erase(it);
+		finishBatch(request.batch, batch);
+	}
+}
+
+void BldsClient::finishBatch(quint64 id, const PendingBatch& batch)
+{
+	resolvePromise(batch.promise, id, batch.success, batch.results);
+	runOnClientThread([this, id, batch]() -> void {
+				if (batch.responseType == "get") {
+					emit getManyResponse(id, batch.success, batch.results);
+				} else if (batch.responseType == "get-source") {
+					emit getSourceManyResponse(id, batch.success, batch.results);
+				} else if (batch.responseType == "set") {
+					emit setManyResponse(id, batch.success, batch.results);
+				} else {
+					emit setSourceManyResponse(id, batch.success, batch.results);
+				}
+				emit requestFinished(id, batch.success, batch.results);
+			});
+}
+
+bool BldsClient::completeRequest(const QByteArray& responseType,
+		const QString& param, bool success, const QVariant& result)
+{
+	/* The BLDS answers requests in order, but match on the response type
+	 * and parameter, so that a request which is never answered does not
+	 * cause later responses to be attributed to the wrong request.
+	 */
+	for (auto it = m_pendingRequests.begin(); it != m_pendingRequests.end(); ++it) {
+		if ( (it->responseType == responseType) && (it->param == param) ) {
+			auto request = *it;
+			m_pendingRequests.erase(it);
+			m_statistics.addRequest(request.responseType,
+					m_statistics.now() - request.sentTime);
+			finishRequest(request, success, result);
+			return !request.internal;
+		}
+	}
+	return true;
+}
+
+bool BldsClient::takeDataRequest(const PooledFrame& frame, PendingRequest& request)
+{
+	/* Data messages carry no request type, but the BLDS answers requests
+	 * in order, so a frame can only answer the oldest outstanding request
+	 * for data. Its time range is only checked to tell the response from
+	 * streamed frames, allowing for the BLDS aligning the requested range
+	 * to the boundaries of samples.
+	 */
+	auto it = std::find_if(m_pendingRequests.begin(), m_pendingRequests.end(),
+			[](const PendingRequest& pending) -> bool {
+				return pending.responseType == "data";
+			});
+	if (it == m_pendingRequests.end())
+		return false;
+	double tolerance = (frame->nsamples() > 0) ?
+		(static_cast<double>(frame->stop()) - frame->start()) / frame->nsamples() : 1e-6;
+	if (m_ioClock.isValid()) {
+		tolerance = qMax<double>(tolerance,
+				(m_ioClock.tolerance(frame->stop()) + 1) / m_ioClock.rate());
+	}
+	if ( (qAbs(it->start - frame->start()) > tolerance) ||
+			(qAbs(it->stop - frame->stop()) > tolerance) ) {
+		return false;
+	}
+	request = *it;
+	m_pendingRequests.erase(it);
+	return true;
+}
+
+void BldsClient::handleStreamedFrame(PooledFrame& frame, bool backfill)
+{
+	/* Count samples on from the last frame, whose time is exact. */
+	if (m_ioClock.isValid() && !frame.hasSampleIndex())
+		frame.setFirstSample(m_ioClock.resolve(frame->start(), m_lastStreamedSample));
+
+	/* Drop what was already delivered before reconnecting. */
+	if (m_seamPending && !backfill) {
+		if (!trimToSeam(frame)) {
+			m_statistics.addDropped(1);
+			return;
+		}
+		m_seamPending = false;
+	}
+	m_hasLastStreamedStop = true;
+	m_lastStreamedStop = frame->stop();
+	m_lastStreamedSample = frame.stopSample();
+
+	/* Only streamed frames are preprocessed or searched for spikes,
+	 * as the state of each assumes every frame follows the last.
+	 */
+	if (m_preprocessor.isEnabled() && frame.hasFloatData() && (frame->nsamples() > 0)) {
+		/* Prefer the known sample rate to one estimated from the frame's
+		 * times, which lose precision as the recording grows.
+		 */
+		const double rate = m_ioClock.isValid() ? m_ioClock.rate() :
+			frame->nsamples() / (frame->stop() - frame->start());
+		m_preprocessor.process(frame.floatData(), rate);
+	}
+	if (!m_channelHooks.isEmpty()) {
+		m_channelProcessor.run(frame->nchannels(), m_channelHookGrain,
+				[this, &frame](quint32 first, quint32 count) -> void {
+					for (const auto& hook : m_channelHooks)
+						hook.second(frame, first, count);
+				});
+	}
+	if (m_spikeDetector.settings().enabled && frame.hasFloatData()) {
+		SpikeBatch batch;
+		m_spikeDetector.detect(frame.floatData(), frame->start(), frame->stop(), batch);
+		emit spikesDetected(batch);
+	}
+
+	m_dataCache.insert(frame);
+	if (m_frameRecorder && !m_frameRecorder->append(*frame)) {
+		reportError(m_frameRecorder->errorString());
+		m_frameRecorder.clear();
+	}
+	if (m_ioFrameDelivery) {
+		publishFrame(frame);
+		emit streamedFrameReceived(frame);
+	}
+}
+
+void BldsClient::handleDataFrame(PooledFrame& frame)
+{
+	PendingRequest request;
+	if (!takeDataRequest(frame, request)) {
+		handleStreamedFrame(frame);
+		m_statistics.addFrame(m_statistics.now() - m_frameStartTime);
+		return;
+	}
+	m_statistics.addRequest(request.responseType, m_statistics.now() - request.sentTime);
+	if (request.firstSample >= 0)
+		frame.setFirstSample(request.firstSample);
+	else if (m_ioClock.isValid())
+		frame.setFirstSample(m_ioClock.resolve(frame->start()));
+	if (request.backfill) {
+		handleStreamedFrame(frame, true);
+		m_statistics.addFrame(m_statistics.now() - m_frameStartTime);
+		return;
+	}
+
+	/* Assemble the whole chunk before the fetched part is cached,
+	 * in case caching it evicts the older data it is merged with.
+	 */
+	auto result = frame;
+	if (request.merge) {
+		auto merged = (request.mergeFirstSample >= 0) ?
+			m_dataCache.extractSamples(request.mergeFirstSample,
+					request.mergeStopSample, m_ioClock, m_framePool, frame) :
+			m_dataCache.extract(request.mergeStart, request.mergeStop, m_framePool, frame);
+		if (!merged.isNull()) {
+			processFrame(merged);
+			result = merged;
+		}
+	}
+	m_dataCache.insert(frame);
+	publishFrame(result);
+	m_statistics.addFrame(m_statistics.now() - m_frameStartTime);
+	finishRequest(request, true, QVariant::fromValue(result));
+}
+
+void BldsClient::writeMessage(const QByteArray& message)
+{
+	/* A message written to an unconnected socket is silently lost, so
+	 * fail the requests waiting for its response instead.
+	 */
+	if (!isConnected()) {
+		failPendingRequests("Not connected to BLDS");
+		return;
+	}
+	m_socket->write(message);
+}
+
+void BldsClient::failPendingRequests(const QString& msg)
+{
+	auto requests = m_pendingRequests;
+	m_pendingRequests.clear();
+	for (const auto& request : requests)
+		finishRequest(request, false, msg);
+}
+
+void BldsClient::handleReadyRead()
+{
+	/* Whatever is available beyond what was left unread last time
+	 * has arrived since, and the rest is the backlog.
+	 */
+	const auto available = m_socket->bytesAvailable();
+	m_statistics.addBytes(available - m_unreadBytes, available);
+	readMessages();
+	m_unreadBytes = m_socket->bytesAvailable();
+}
+
+void BldsClient::readMessages()
+{
+	/* Messages are parsed incrementally, so that each byte is read from
+	 * the socket only once, and large data frames are assembled in place
+	 * as their segments arrive, rather than waiting for the whole message.
+	 */
+	while (true) {
+		switch (m_readState) {
+			case ReadingSize:
+				if (m_socket->bytesAvailable() < static_cast<qint64>(sizeof(m_messageSize)))
+					return;
+				m_socket->read(reinterpret_cast<char*>(&m_messageSize),
+						sizeof(m_messageSize));
+				m_readState = ReadingType;
+				break;
+
+			case ReadingType: {
+				if (!m_socket->canReadLine())
+					return;
+
+				/* Read the type into a fixed buffer, to avoid allocating. */
+				char type[MaxMessageTypeLength + 1];
+				auto length = m_socket->readLine(type, sizeof(type));
+				if ( (length <= 0) || (static_cast<quint32>(length) > m_messageSize) ) {
+					reportError("Received malformed message from BLDS");
+					m_readState = ReadingSize;
+					break;
+				}
+				m_messageSize -= length;
+				m_statistics.addMessage();
+				if (type[length - 1] != '\n') {
+					reportError("Unknown message type received from BLDS: " +
+							QByteArray(type, length));
+					m_readState = DiscardingBody;
+					break;
+				}
+				m_messageType = messageType(type, length - 1);
+				if ( (m_messageType == DataMessage) ||
+						(m_messageType == EncodedDataMessage) ) {
+					m_readState = ReadingFrameHeader;
+				} else if (m_messageType == UnknownMessage) {
+					reportError("Unknown message type received from BLDS: " +
+							QByteArray(type, length - 1));
+					m_readState = DiscardingBody;
+				} else {
+					m_readState = ReadingBody;
+				}
+				break;
+			}
+
+			case ReadingBody: {
+				auto available = m_socket->bytesAvailable();
+				if (available < m_messageSize)
+					return;
+				handleMessage(m_messageType, m_messageSize);
+
+				/* Skip anything the handler did not consume. */
+				auto consumed = available - m_socket->bytesAvailable();
+				if (consumed < m_messageSize)
+					m_socket->skip(m_messageSize - consumed);
+				m_readState = ReadingSize;
+				break;
+			}
+
+			case ReadingFrameHeader: {
+				auto headerSize = sizeof(DataFrameHeader);
+				if (m_messageType == EncodedDataMessage)
+					headerSize += sizeof(quint32);
+				if (m_socket->bytesAvailable() < static_cast<qint64>(headerSize))
+					return;
+				beginDataFrame();
+				break;
+			}
+
+			case ReadingFrameSamples:
+				if (!readDataFrame())
+					return;
+				m_readState = ReadingSize;
+				break;
+
+			case ReadingEncodedFrame:
+				if (!readEncodedDataFrame())
+					return;
+				m_readState = ReadingSize;
+				break;
+
+			case DiscardingBody: {
+				auto skipped = m_socket->skip(m_messageSize);
+				if (skipped > 0)
+					m_messageSize -= skipped;
+				if (m_messageSize > 0)
+					return;
+				m_readState = ReadingSize;
+				break;
+			}
+		}
+	}
+}
+
+void BldsClient::resetParser()
+{
+	m_readState = ReadingSize;
+	m_messageSize = 0;
+	m_unreadBytes = 0;
+	m_pendingFrame.reset();
+}
+
+void BldsClient::resetReadState()
+{
+	resetParser();
+	m_hasLastStreamedStop = false;
+	m_lastStreamedSample = -1;
+	m_seamPending = false;
+	m_dataCache.clear();
+	m_preprocessor.reset();
+	m_spikeDetector.reset();
+	failPendingRequests("Connection to BLDS was reset");
+}
+
+void BldsClient::handleMessage(MessageType type, quint32 size)
+{
+	switch (type) {
+		case SourceCreatedMessage:
+			handleCreateSourceResponse(size);
+			break;
+		case SourceDeletedMessage:
+			handleDeleteSourceResponse(size);
+			break;
+		case SetMessage:
+			handleSetResponse(size);
+			break;
+		case GetMessage:
+			handleGetResponse(size);
+			break;
+		case SetSourceMessage:
+			handleSetSourceResponse(size);
+			break;
+		case GetSourceMessage:
+			handleGetSourceResponse(size);
+			break;
+		case RecordingStartedMessage:
+			handleStartRecordingResponse(size);
+			break;
+		case RecordingStoppedMessage:
+			handleStopRecordingResponse(size);
+			break;
+		case GetAllDataMessage:
+			handleRequestAllDataResponse(size);
+			break;
+		case ErrorMessage:
+			handleError(size);
+			break;
+		case DataMessage:
+		case EncodedDataMessage:
+		case UnknownMessage:
+			break; // handled by the parser
+	}
+}
+
+bool BldsClient::parseSuccessAndStringMessage(quint32 size, QString& msg)
+{
+	bool success;
+	m_stream >> success;
+	size -= 1;
+	if (!success) {
+		msg = QString::fromUtf8(m_socket->read(size));
+	}
+	return success;
+}
+
+void BldsClient::handleCreateSourceResponse(quint32 size)
+{
+	QString msg;
+	bool success = parseSuccessAndStringMessage(size, msg);
+	completeRequest("source-created", QString(), success, msg);
+	runOnClientThread([this, success, msg]() -> void {
+				emit sourceCreated(success, msg);
+			});
+}
+
+void BldsClient::handleDeleteSourceResponse(quint32 size)
+{
+	QString msg;
+	bool success = parseSuccessAndStringMessage(size, msg);
+	if (success)
+		m_dataCache.clear();
+	completeRequest("source-deleted", QString(), success, msg);
+	runOnClientThread([this, success, msg]() -> void {
+				emit sourceDeleted(success, msg);
+			});
+}
+
+void BldsClient::handleSetResponse(quint32 size)
+{
+	bool success;
+	m_stream >> success;
+	size -= 1;
+	QString param = QString::fromUtf8(m_socket->readLine());
+	size -= param.size();
+	param.chop(1);
+	QString msg = QString::fromUtf8(m_socket->read(size));
+	completeRequest("set", param, success, msg);
+	runOnClientThread([this, param, success, msg]() -> void {
+				emit setResponse(param, success, msg);
+			});
+}
+
+void BldsClient::handleGetResponse(quint32 size)
+{
+	bool success;
+	m_stream >> success;
+	size -= 1;
+	auto line = m_socket->readLine();
+	size -= line.size();
+	line.chop(1);
+	QString param = QString::fromUtf8(line);
+	QVariant data;
+
+	switch (serverParamDecoder(line.constData(), line.size())) {
+		case StringDecoder:
+			data = QString::fromUtf8(m_socket->read(size));
+			break;
+		case UIntDecoder: {
+			quint32 val = 0;
+			m_socket->read(reinterpret_cast<char*>(&val), sizeof(val));
+			data = val;
+			break;
+		}
+		case FloatDecoder: {
+			float val = 0.;
+			m_socket->read(reinterpret_cast<char*>(&val), sizeof(val));
+			data = val;
+			break;
+		}
+		case BoolDecoder: {
+			bool val = false;
+			m_socket->read(reinterpret_cast<char*>(&val), sizeof(val));
+			data = val;
+			break;
+		}
+		case ErrorDecoder:
+			data = QString::fromUtf8(m_socket->read(size)); // error message
+			break;
+	}
+	if (!completeRequest("get", param, success, data))
+		return;
+	runOnClientThread([this, param, success, data]() -> void {
+				emit getResponse(param, success, data);
+			});
+}
+
+void BldsClient::handleSetSourceResponse(quint32 size)
+{
+	bool success;
+	m_stream >> success;
+	size -= 1;
+	QString param = QString::fromUtf8(m_socket->readLine());
+	size -= param.size();
+	param.chop(1);
+	QString msg = QString::fromUtf8(m_socket->read(size));
+	completeRequest("set-source", param, success, msg);
+	runOnClientThread([this, param, success, msg]() -> void {
+				emit setSourceResponse(param, success, msg);
+			});
+}
+
+void BldsClient::handleGetSourceResponse(quint32 size)
+{
+	bool success;
+	m_stream >> success;
+	size -= 1;
+	QString param = QString::fromUtf8(m_socket->readLine());
+	size -= param.size();
+	param.chop(1);
+	auto buffer = m_socket->read(size);
+	QVariant data = datasource::deserialize(param.toUtf8(), buffer);
+	if (m_ioScaling.fromSource && (param == "adc-range")) {
+		bool ok = false;
+		auto range = data.toFloat(&ok);
+		if (success && ok && (range > 0)) {
+			m_ioScaling.gain = range / 32768.;
+			m_scalingDirty = true;
+		}
+		m_ioScaling.fromSource = false;
+	}
+	if (m_ioSampleRateFromSource && (param == "sample-rate")) {
+		bool ok = false;
+		auto rate = data.toDouble(&ok);
+		if (success && ok && (rate > 0))
+			updateSampleRate(rate);
+		m_ioSampleRateFromSource = false;
+	}
+	completeRequest("get-source", param, success, data);
+	runOnClientThread([this, param, success, data]() -> void {
+				emit getSourceResponse(param, success, data);
+			});
+}
+
+void BldsClient::handleStartRecordingResponse(quint32 size)
+{
+	QString msg;
+	bool success = parseSuccessAndStringMessage(size, msg);
+	if (success)
+		m_dataCache.clear(); // times restart with the recording
+	completeRequest("recording-started", QString(), success, msg);
+	runOnClientThread([this, success, msg]() -> void {
+				emit recordingStarted(success, msg);
+			});
+}
+
+void BldsClient::handleStopRecordingResponse(quint32 size)
+{
+	QString msg;
+	bool success = parseSuccessAndStringMessage(size, msg);
+	completeRequest("recording-stopped", QString(), success, msg);
+	runOnClientThread([this, success, msg]() -> void {
+				emit recordingStopped(success, msg);
+			});
+}
+
+void BldsClient::handleRequestAllDataResponse(quint32 size)
+{
+	QString msg;
+	bool success = parseSuccessAndStringMessage(size, msg);
+	if (!completeRequest("get-all-data", QString(), success, msg))
+		return;
+	runOnClientThread([this, success, msg]() -> void {
+				emit requestAllDataResponse(success, msg);
+			});
+}
+
+void BldsClient::beginDataFrame()
+{
+	/* Read the header directly, rather than buffering the whole
+	 * message and deserializing it, so that the samples can be read
+	 * exactly once, from the socket into storage recycled from the
+	 * client's frame pool.
+	 */
+	m_frameStartTime = m_statistics.now();
+	auto& header = m_frameHeader;
+	quint32 headerSize = sizeof(header);
+	bool valid = (m_socket->read(reinterpret_cast<char*>(&header), sizeof(header)) ==
+			static_cast<qint64>(sizeof(header)));
+	m_frameEncoding = codec::RawEncoding;
+	if (valid && (m_messageType == EncodedDataMessage)) {
+		quint32 encoding;
+		valid = (m_socket->read(reinterpret_cast<char*>(&encoding), sizeof(encoding)) ==
+				static_cast<qint64>(sizeof(encoding)));
+		headerSize += sizeof(encoding);
+		m_frameEncoding = static_cast<codec::Encoding>(encoding);
+		if (valid && !codec::isSupported(m_frameEncoding)) {
+			reportError(QString("Received data frame in unsupported encoding %1").arg(encoding));
+			m_messageSize -= qMin(m_messageSize, headerSize);
+			m_readState = DiscardingBody;
+			return;
+		}
+	}
+
+	/* The header is not trusted, so the size of the samples is bounded
+	 * before any storage is acquired for them. The size of compressed
+	 * samples is only known once decompressed, so it is bounded by the
+	 * most to which the rest of the message could decompress.
+	 */
+	const quint64 nvalues = static_cast<quint64>(header.nsamples) * header.nchannels;
+	const quint64 nbytes = nvalues * sizeof(DataFrame::Samples::elem_type);
+	const quint64 payload = (m_messageSize > headerSize) ? m_messageSize - headerSize : 0;
+	const bool compressed = codec::isCompressed(m_frameEncoding);
+	if ( !valid || (m_messageSize < headerSize) ||
+			(nvalues > MaxFrameSize / sizeof(DataFrame::Samples::elem_type)) ||
+			(compressed ? (nbytes > codec::maxDecompressedSize(m_frameEncoding, payload)) :
+			 (nbytes != payload)) ) {
+		reportError("Received malformed data frame from BLDS");
+		m_messageSize -= qMin(m_messageSize, headerSize);
+		m_readState = DiscardingBody;
+		return;
+	}
+	m_messageSize -= headerSize;
+
+	/* Map each received channel to its column in the decoded frame,
+	 * if only a subset of channels is selected. The map is only rebuilt
+	 * between frames, so that changing the selection never affects a
+	 * partially-read frame.
+	 */
+	arma::uword nchannels = header.nchannels;
+	if (m_channelMapDirty) {
+		m_dataCache.clear(); // cached frames have the old channels
+		m_preprocessor.reset();
+		m_spikeDetector.reset();
+		m_scalingDirty = true;
+	}
+	if (m_ioChannelSelection.isEmpty()) {
+		m_channelMap.clear();
+		m_channelMapDirty = false;
+	} else {
+		if (m_channelMapDirty || (m_channelMap.size() != static_cast<int>(nchannels))) {
+			m_scalingDirty = true;
+			m_channelMap.fill(-1, nchannels);
+			m_selectedChannelCount = 0;
+			for (auto channel : m_ioChannelSelection) {
+				if (channel < static_cast<int>(nchannels))
+					m_channelMap[channel] = m_selectedChannelCount++;
+			}
+			m_channelMapDirty = false;
+		}
+		nchannels = m_selectedChannelCount;
+	}
+
+	const bool toFloat = m_ioScaling.enabled || m_preprocessor.isEnabled() ||
+		m_spikeDetector.settings().enabled;
+	if (toFloat)
+		updateColumnScaling(nchannels);
+	int extra = FramePool::NoExtraStorage;
+	if (toFloat)
+		extra |= FramePool::FloatStorage;
+	if (m_ioSampleLayout == SampleMajor)
+		extra |= FramePool::SampleMajorStorage;
+	m_pendingFrame = m_framePool.acquire(header.start, header.stop,
+			header.nsamples, nchannels, extra);
+	m_convertedSamples = 0;
+	m_transposedChannels = 0;
+	m_readState = (m_messageType == EncodedDataMessage) ?
+		ReadingEncodedFrame : ReadingFrameSamples;
+}
+
+bool BldsClient::readDataFrame()
+{
+	using Sample = DataFrame::Samples::elem_type;
+	auto& samples = m_pendingFrame.frame().data();
+
+	if (m_channelMap.isEmpty()) {
+		/* All channels are contiguous, so read whatever is available. */
+		const qint64 nbytes = static_cast<qint64>(samples.n_elem * sizeof(Sample));
+		auto offset = nbytes - m_messageSize;
+		auto nread = m_socket->read(reinterpret_cast<char*>(samples.memptr()) + offset,
+				m_messageSize);
+		if (nread > 0) {
+			m_messageSize -= nread;
+			processPendingSamples((offset + nread) / sizeof(Sample));
+		}
+	} else {
+		/* Read selected channels into their columns, and skip the rest,
+		 * one contiguous channel at a time.
+		 */
+		const qint64 channelBytes = static_cast<qint64>(m_frameHeader.nsamples) *
+			sizeof(Sample);
+		const qint64 nbytes = channelBytes * m_frameHeader.nchannels;
+		while (m_messageSize > 0) {
+			auto offset = nbytes - m_messageSize;
+			auto channel = offset / channelBytes;
+			auto within = offset % channelBytes;
+			auto column = m_channelMap.at(channel);
+			auto chunk = channelBytes - within;
+			qint64 nread;
+			if (column < 0) {
+				nread = m_socket->skip(chunk);
+			} else {
+				nread = m_socket->read(
+						reinterpret_cast<char*>(samples.colptr(column)) + within, chunk);
+			}
+			if (nread <= 0)
+				break;
+			m_messageSize -= nread;
+			if (column >= 0) {
+				processPendingSamples(column * m_frameHeader.nsamples +
+						(within + nread) / sizeof(Sample));
+			}
+			if (nread < chunk)
+				break;
+		}
+	}
+	if (m_messageSize > 0)
+		return false;
+
+	PooledFrame frame;
+	frame.swap(m_pendingFrame);
+	handleDataFrame(frame);
+	return true;
+}
+
+bool BldsClient::readEncodedDataFrame()
+{
+	using Sample = DataFrame::Samples::elem_type;
+
+	/* Compressed samples can only be decoded as a whole, so wait for
+	 * the rest of the message.
+	 */
+	if (m_socket->bytesAvailable() < static_cast<qint64>(m_messageSize))
+		return false;
+	m_encodedSamples.resize(m_messageSize);
+	const bool complete = (m_socket->read(m_encodedSamples.data(), m_messageSize) ==
+			static_cast<qint64>(m_messageSize));
+	m_messageSize = 0;
+	if (!complete) {
+		reportError("Could not read data frame from BLDS");
+		m_pendingFrame.reset();
+		return true;
+	}
+
+	const auto nsamples = m_frameHeader.nsamples;
+	const qint64 nbytes = static_cast<qint64>(nsamples) *
+		m_frameHeader.nchannels * sizeof(Sample);
+	const char* decoded = m_encodedSamples.constData();
+	if (codec::isCompressed(m_frameEncoding)) {
+		m_decompressedSamples.resize(nbytes);
+		if (!codec::decompress(m_frameEncoding, m_encodedSamples.constData(),
+					m_encodedSamples.size(), m_decompressedSamples.data(), nbytes)) {
+			reportError("Could not decompress data frame from BLDS");
+			m_pendingFrame.reset();
+			return true;
+		}
+		decoded = m_decompressedSamples.constData();
+	}
+
+	/* Undo the delta encoding of each selected channel as it is
+	 * written into its column, so that each sample is written once.
+	 */
+	auto& samples = m_pendingFrame.frame().data();
+	for (quint32 channel = 0; channel < m_frameHeader.nchannels; channel++) {
+		auto column = m_channelMap.isEmpty() ?
+			static_cast<int>(channel) : m_channelMap.at(channel);
+		if (column < 0)
+			continue;
+		auto* input = reinterpret_cast<const Sample*>(decoded) +
+			static_cast<qint64>(channel) * nsamples;
+		if (m_frameEncoding == codec::RawEncoding)
+			std::memcpy(samples.colptr(column), input, nsamples * sizeof(Sample));
+		else
+			codec::integrate(input, samples.colptr(column), nsamples);
+	}
+	processPendingSamples(samples.n_elem);
+
+	PooledFrame frame;
+	frame.swap(m_pendingFrame);
+	handleDataFrame(frame);
+	return true;
+}
+
+void BldsClient::updateColumnScaling(arma::uword nchannels)
+{
+	if (!m_scalingDirty && (m_columnGains.size() == static_cast<int>(nchannels)))
+		return;
+
+	/* Columns hold the selected channels in ascending order. */
+	QVector<int> channels;
+	if (m_channelMap.isEmpty()) {
+		for (arma::uword i = 0; i < nchannels; i++)
+			channels.append(i);
+	} else {
+		for (int i = 0; i < m_channelMap.size(); i++) {
+			if (m_channelMap.at(i) >= 0)
+				channels.append(i);
+		}
+	}
+	m_columnGains.resize(channels.size());
+	m_columnOffsets.resize(channels.size());
+	for (int i = 0; i < channels.size(); i++) {
+		auto channel = channels.at(i);
+		m_columnGains[i] = m_ioScaling.gains.value(channel, m_ioScaling.gain);
+		m_columnOffsets[i] = m_ioScaling.offsets.value(channel, m_ioScaling.offset);
+	}
+	m_scalingDirty = false;
+}
+
+void BldsClient::processPendingSamples(arma::uword count)
+{
+	const auto nsamples = m_pendingFrame->nsamples();
+	const auto nchannels = m_pendingFrame->nchannels();
+	if (nsamples == 0)
+		return;
+	const auto* input = m_pendingFrame->data().memptr();
+
+	/* Convert one column at a time, as each has its own scaling. */
+	if (m_pendingFrame.hasFloatData()) {
+		auto* output = m_pendingFrame.floatData().memptr();
+		while (m_convertedSamples < count) {
+			const auto column = m_convertedSamples / nsamples;
+			const auto end = qMin<arma::uword>(count, (column + 1) * nsamples);
+			conversion::convert(input + m_convertedSamples, output + m_convertedSamples,
+					end - m_convertedSamples, m_columnGains.at(column),
+					m_columnOffsets.at(column));
+			m_convertedSamples = end;
+		}
+	}
+
+	/* Transpose whole groups of channels once each is complete, so that
+	 * they are still in cache, or the remainder once the frame is.
+	 */
+	if (m_pendingFrame.hasSampleMajorData()) {
+		const arma::uword group = 32;
+		const auto complete = count / nsamples;
+		auto* output = m_pendingFrame.sampleMajorData().memptr();
+		while ( (m_transposedChannels + group <= complete) ||
+				((complete == nchannels) && (m_transposedChannels < nchannels)) ) {
+			const auto n = qMin(group, complete - m_transposedChannels);
+			conversion::transpose(input, output, nsamples, nchannels,
+					m_transposedChannels, n);
+			m_transposedChannels += n;
+		}
+	}
+}
+
+void BldsClient::processFrame(PooledFrame& frame)
+{
+	if (frame.isNull())
+		return;
+	const auto nsamples = frame->nsamples();
+	const auto nchannels = frame->nchannels();
+	if (m_ioScaling.enabled) {
+		updateColumnScaling(nchannels);
+		if (m_columnGains.size() == static_cast<int>(nchannels)) {
+			auto& output = frame.floatData();
+			output.set_size(nsamples, nchannels);
+			for (arma::uword column = 0; column < nchannels; column++) {
+				conversion::convert(frame->data().colptr(column), output.colptr(column),
+						nsamples, m_columnGains.at(column), m_columnOffsets.at(column));
+			}
+		}
+	}
+	if (m_ioSampleLayout == SampleMajor) {
+		auto& output = frame.sampleMajorData();
+		output.set_size(nchannels, nsamples);
+		conversion::transpose(frame->data().memptr(), output.memptr(),
+				nsamples, nchannels, 0, nchannels);
+	}
+}
+
+void BldsClient::publishFrame(const PooledFrame& frame)
+{
+	emit data(*frame);
+	emit frameReceived(frame);
+	if (m_frameRing) {
+		const auto dropped = m_frameRing->droppedCount();
+		m_frameRing->push(frame);
+		m_statistics.addDropped(m_frameRing->droppedCount() - dropped);
+		m_statistics.setRingOccupancy(m_frameRing->size());
+	}
+}
+
+void BldsClient::handleError(quint32 size)
+{
+	QString msg = QString::fromUtf8(m_socket->read(size));
+
+	/* Requests for data are the only ones answered with a bare error,
+	 * and since the BLDS answers in order, attribute the error to the
+	 * oldest outstanding request if it is for data.
+	 */
+	if (!m_pendingRequests.isEmpty() &&
+			(m_pendingRequests.first().responseType == "data")) {
+		finishRequest(m_pendingRequests.takeFirst(), false, msg);
+	}
+	reportError(msg);
+}
+
+QString BldsClient::address() const
+{
+	return QString("%1:%2").arg(m_hostname).arg(m_port);
+}
+
+QString BldsClient::hostname() const
+{
+	return m_hostname;
+}
+
+quint16 BldsClient::port() const
+{
+	return m_port;
+}
+
+int BldsClient::framePoolCapacity() const
+{
+	return m_framePool.capacity();
+}
+
+void BldsClient::setFramePoolCapacity(int capacity)
+{
+	m_framePool.setCapacity(capacity);
+}
+
+quint64 BldsClient::frameAllocationCount() const
+{
+	return m_framePool.allocationCount();
+}
+
+bool BldsClient::lowLatencyMode() const
+{
+	return m_lowLatency;
+}
+
+void BldsClient::setLowLatencyMode(bool enable)
+{
+	m_lowLatency = enable;
+	runOnIoThread([this, enable]() -> void {
+				m_ioSocketOptions.lowLatency = enable;
+				applySocketOptions();
+			});
+}
+
+void BldsClient::setSocketBufferSizes(int sendSize, int receiveSize)
+{
+	runOnIoThread([this, sendSize, receiveSize]() -> void {
+				m_ioSocketOptions.sendBufferSize = sendSize;
+				m_ioSocketOptions.receiveBufferSize = receiveSize;
+				applySocketOptions();
+			});
+}
+
+void BldsClient::applySocketOptions()
+{
+	/* Options only take effect on a connected socket, so these are
+	 * applied again each time the connection is made.
+	 */
+	if (m_socket->state() != QAbstractSocket::ConnectedState)
+		return;
+	m_socket->setSocketOption(QAbstractSocket::LowDelayOption,
+			m_ioSocketOptions.lowLatency ? 1 : 0);
+	if (m_ioSocketOptions.sendBufferSize > 0) {
+		m_socket->setSocketOption(QAbstractSocket::SendBufferSizeSocketOption,
+				m_ioSocketOptions.sendBufferSize);
+	}
+	if (m_ioSocketOptions.receiveBufferSize > 0) {
+		m_socket->setSocketOption(QAbstractSocket::ReceiveBufferSizeSocketOption,
+				m_ioSocketOptions.receiveBufferSize);
+	}
+}
+
+QVector<int> BldsClient::channelSelection() const
+{
+	return m_channelSelection;
+}
+
+void BldsClient::setChannelSelection(const QVector<int>& channels)
+{
+	QVector<int> selection;
+	for (auto channel : channels) {
+		if (channel >= 0)
+			selection.append(channel);
+	}
+	std::sort(selection.begin(), selection.end());
+	selection.erase(std::unique(selection.begin(), selection.end()), selection.end());
+	m_channelSelection = selection;
+	runOnIoThread([this, selection]() -> void {
+				m_ioChannelSelection = selection;
+				m_channelMapDirty = true;
+			});
+}
+
+void BldsClient::clearChannelSelection()
+{
+	setChannelSelection(QVector<int>());
+}
+
+float BldsClient::dataCacheDuration() const
+{
+	return m_dataCacheDuration;
+}
+
+void BldsClient::setDataCacheDuration(float seconds)
+{
+	m_dataCacheDuration = qMax(seconds, 0.f);
+	runOnIoThread([this, seconds]() -> void {
+				m_dataCache.setMaxDuration(seconds);
+			});
+}
+
+qint64 BldsClient::dataCacheSize() const
+{
+	return m_dataCacheSize;
+}
+
+void BldsClient::setDataCacheSize(qint64 bytes)
+{
+	m_dataCacheSize = qMax<qint64>(bytes, 0);
+	runOnIoThread([this, bytes]() -> void {
+				m_dataCache.setMaxSize(bytes);
+			});
+}
+
+void BldsClient::clearDataCache()
+{
+	runOnIoThread([this]() -> void { m_dataCache.clear(); });
+}
+
+BldsClient::SampleLayout BldsClient::sampleLayout() const
+{
+	return m_sampleLayout;
+}
+
+void BldsClient::setSampleLayout(SampleLayout layout)
+{
+	m_sampleLayout = layout;
+	runOnIoThread([this, layout]() -> void { m_ioSampleLayout = layout; });
+}
+
+Preprocessor::Settings BldsClient::preprocessing() const
+{
+	return m_preprocessing;
+}
+
+void BldsClient::setPreprocessing(const Preprocessor::Settings& settings)
+{
+	m_preprocessing = settings;
+	runOnIoThread([this, settings]() -> void {
+				m_preprocessor.setSettings(settings);
+				m_scalingDirty = true;
+			});
+}
+
+SpikeDetector::Settings BldsClient::spikeDetection() const
+{
+	return m_spikeDetection;
+}
+
+void BldsClient::setSpikeDetection(const SpikeDetector::Settings& settings)
+{
+	m_spikeDetection = settings;
+	runOnIoThread([this, settings]() -> void {
+				m_spikeDetector.setSettings(settings);
+				m_scalingDirty = true;
+			});
+}
+
+bool BldsClient::frameDelivery() const
+{
+	return m_frameDelivery;
+}
+
+void BldsClient::setFrameDelivery(bool enable)
+{
+	m_frameDelivery = enable;
+	runOnIoThread([this, enable]() -> void { m_ioFrameDelivery = enable; });
+}
+
+int BldsClient::addChannelHook(const ChannelHook& hook)
+{
+	auto id = ++m_nextChannelHookId;
+	runOnIoThread([this, id, hook]() -> void {
+				m_channelHooks.append(qMakePair(id, hook));
+			});
+	return id;
+}
+
+void BldsClient::removeChannelHook(int id)
+{
+	runOnIoThread([this, id]() -> void {
+				for (int i = 0; i < m_channelHooks.size(); i++) {
+					if (m_channelHooks.at(i).first == id) {
+						m_channelHooks.remove(i);
+						return;
+					}
+				}
+			});
+}
+
+int BldsClient::channelHookThreads() const
+{
+	return (m_channelHookThreads > 0) ? m_channelHookThreads :
+		qMax(QThread::idealThreadCount(), 1);
+}
+
+void BldsClient::setChannelHookThreads(int threads)
+{
+	m_channelHookThreads = qMax(threads, 0);
+	runOnIoThread([this, threads]() -> void {
+				m_channelProcessor.setThreadCount(threads);
+			});
+}
+
+void BldsClient::setChannelHookGrain(int channels)
+{
+	runOnIoThread([this, channels]() -> void {
+				m_channelHookGrain = qMax(channels, 0);
+			});
+}
+
+bool BldsClient::floatConversion() const
+{
+	return m_floatConversion;
+}
+
+void BldsClient::setFloatConversion(bool enable)
+{
+	m_floatConversion = enable;
+	runOnIoThread([this, enable]() -> void {
+				m_ioScaling.enabled = enable;
+				m_scalingDirty = true;
+			});
+}
+
+void BldsClient::setScaling(float gain, float offset)
+{
+	runOnIoThread([this, gain, offset]() -> void {
+				m_ioScaling.gain = gain;
+				m_ioScaling.offset = offset;
+				m_scalingDirty = true;
+			});
+}
+
+void BldsClient::setChannelScaling(const QVector<float>& gains,
+		const QVector<float>& offsets)
+{
+	runOnIoThread([this, gains, offsets]() -> void {
+				m_ioScaling.gains = gains;
+				m_ioScaling.offsets = offsets;
+				m_scalingDirty = true;
+			});
+}
+
+quint64 BldsClient::requestSourceScaling()
+{
+	runOnIoThread([this]() -> void { m_ioScaling.fromSource = true; });
+	return getSource("adc-range");
+}
+
+double BldsClient::sampleRate() const
+{
+	return m_sampleRate;
+}
+
+void BldsClient::setSampleRate(double rate)
+{
+	m_sampleRate = qMax(rate, 0.);
+	runOnIoThread([this, rate]() -> void { updateSampleRate(rate); });
+}
+
+quint64 BldsClient::requestSourceSampleRate()
+{
+	runOnIoThread([this]() -> void { m_ioSampleRateFromSource = true; });
+	return getSource("sample-rate");
+}
+
+void BldsClient::updateSampleRate(double rate)
+{
+	if (rate == m_ioClock.rate())
+		return;
+	m_ioClock.setRate(rate);
+	m_lastStreamedSample = -1;
+	m_dataCache.clear(); // cached frames are indexed at the old rate
+	runOnClientThread([this, rate]() -> void { m_sampleRate = qMax(rate, 0.); });
+}
+
+quint64 BldsClient::requestDataEncoding(codec::Encoding encoding)
+{
+	if (!codec::isSupported(encoding)) {
+		reportError(QString("Data encoding %1 is not supported by this client").arg(
+					static_cast<int>(encoding)));
+		return 0;
+	}
+	return set("data-encoding", QByteArray(codec::encodingName(encoding)));
+}
+
+QSharedPointer<FrameRing> BldsClient::openFrameRing(int depth,
+		FrameRing::OverflowPolicy policy)
+{
+	closeFrameRing();
+	auto ring = QSharedPointer<FrameRing>::create(qMax(depth, 1), policy);
+	m_openFrameRing = ring;
+	runOnIoThread([this, ring]() -> void { m_frameRing = ring; });
+	return ring;
+}
+
+void BldsClient::closeFrameRing()
+{
+	/* Close the ring first, in case the reader is blocked pushing into it. */
+	auto ring = m_openFrameRing.toStrongRef();
+	if (ring)
+		ring->close();
+	m_openFrameRing.clear();
+	runOnIoThread([this, ring]() -> void {
+				if (m_frameRing == ring)
+					m_frameRing.clear();
+			});
+}
+
+QSharedPointer<FrameRecorder> BldsClient::openFrameRecorder(const QString& path,
+		qint64 segmentSize)
+{
+	closeFrameRecorder();
+	auto recorder = QSharedPointer<FrameRecorder>::create(path, segmentSize);
+	if (!recorder->open()) {
+		reportError(recorder->errorString());
+		return QSharedPointer<FrameRecorder>();
+	}
+	m_openFrameRecorder = recorder;
+	runOnIoThread([this, recorder]() -> void { m_frameRecorder = recorder; });
+	return recorder;
+}
+
+void BldsClient::closeFrameRecorder()
+{
+	auto recorder = m_openFrameRecorder.toStrongRef();
+	m_openFrameRecorder.clear();
+	if (!recorder)
+		return;
+	runOnIoThread([this, recorder]() -> void {
+				if (m_frameRecorder == recorder)
+					m_frameRecorder.clear();
+				recorder->close();
+			});
+}
+
+void BldsClient::requestServerStatus()
+{
+	if (m_serverReply)
+		return; // answered by the reply in flight
+	m_serverReply = m_manager->get(m_serverRequest);
+	QObject::connect(m_serverReply, &QNetworkReply::finished,
+			this, &BldsClient::handleServerStatusReply);
+}
+
+void BldsClient::requestSourceStatus()
+{
+	if (m_sourceReply)
+		return;
+	m_sourceReply = m_manager->get(m_sourceRequest);
+	QObject::connect(m_sourceReply, &QNetworkReply::finished,
+			this, &BldsClient::handleSourceStatusReply);
+}
+
+int BldsClient::statusPollInterval() const
+{
+	return m_statusTimer->isActive() ? m_statusTimer->interval() : 0;
+}
+
+void BldsClient::setStatusPollInterval(int msec)
+{
+	if (msec <= 0) {
+		m_statusTimer->stop();
+		return;
+	}
+	m_statusTimer->start(msec);
+	requestServerStatus();
+	requestSourceStatus();
+}
+
+ClientStatistics::Snapshot BldsClient::statistics() const
+{
+	return m_statistics.snapshot();
+}
+
+void BldsClient::resetStatistics()
+{
+	m_statistics.reset();
+	m_reportedStatistics = ClientStatistics::Snapshot();
+}
+
+int BldsClient::statisticsInterval() const
+{
+	return m_statisticsTimer->isActive() ? m_statisticsTimer->interval() : 0;
+}
+
+void BldsClient::setStatisticsInterval(int msec)
+{
+	if (msec <= 0) {
+		m_statisticsTimer->stop();
+		return;
+	}
+	m_statisticsTimer->start(msec);
+}
+
+void BldsClient::reportStatistics()
+{
+	auto current = m_statistics.snapshot();
+
+	/* Measure the interval from the start if reset since the last report. */
+	auto previous = m_reportedStatistics;
+	if ( (current.elapsed < previous.elapsed) ||
+			(current.bytesReceived < previous.bytesReceived) ||
+			(current.framesReceived < previous.framesReceived) ) {
+		previous = ClientStatistics::Snapshot();
+	}
+	const double elapsed = current.elapsed - previous.elapsed;
+	QJsonObject interval;
+	interval.insert("elapsed", elapsed);
+	interval.insert("bytes-per-second", (elapsed > 0) ?
+			(current.bytesReceived - previous.bytesReceived) / elapsed : 0.);
+	interval.insert("frames-per-second", (elapsed > 0) ?
+			(current.framesReceived - previous.framesReceived) / elapsed : 0.);
+	interval.insert("frames-dropped", static_cast<double>(
+				current.framesDropped - qMin(current.framesDropped, previous.framesDropped)));
+	m_reportedStatistics = current;
+
+	auto json = current.toJson();
+	json.insert("interval", interval);
+	emit statisticsReported(json);
+}
+
+void BldsClient::handleServerStatusReply()
+{
+	auto reply = m_serverReply;
+	m_serverReply = nullptr;
+	QObject::disconnect(reply, &QNetworkReply::finished,
+			this, &BldsClient::handleServerStatusReply);
+	const auto replyError = reply->error();
+	const auto errorString = reply->errorString();
+	auto body = reply->readAll();
+	reply->deleteLater();
+
+	/* A failed or empty reply says nothing about the status, so it is
+	 * reported rather than treated as a status with every field removed.
+	 */
+	if (replyError != QNetworkReply::NoError) {
+		emit error("Could not request server status: " + errorString);
+		return;
+	}
+	if (body.isEmpty()) {
+		emit error("Could not request server status: empty reply");
+		return;
+	}
+
+	/* Only parse a status which differs from the last. */
+	if (!m_hasServerStatus || (body != m_serverStatusBody)) {
+		QJsonParseError parseError;
+		auto document = QJsonDocument::fromJson(body, &parseError);
+		if ( (parseError.error != QJsonParseError::NoError) || !document.isObject() ) {
+			emit error("Received invalid server status from BLDS");
+			return;
+		}
+		auto status = document.object();
+		auto changed = changedFields(m_serverStatus, status);
+		const bool first = !m_hasServerStatus;
+		m_hasServerStatus = true;
+		m_serverStatusBody = body;
+		m_serverStatus = status;
+		if (first || !changed.isEmpty())
+			emit serverStatusChanged(changed);
+	}
+	emit serverStatus(m_serverStatus);
+}
+
+void BldsClient::handleSourceStatusReply()
+{
+	auto reply = m_sourceReply;
+	m_sourceReply = nullptr;
+	QObject::disconnect(reply, &QNetworkReply::finished,
+			this, &BldsClient::handleSourceStatusReply);
+	const auto httpStatus = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
+	const bool exists = (httpStatus.toInt() == 200);
+	const auto errorString = reply->errorString();
+	auto body = reply->readAll();
+	reply->deleteLater();
+
+	/* A reply without an HTTP status failed before reaching the server.
+	 * A reply that the source does not exist has no status to parse, but
+	 * the status of an existing source must be a non-empty object.
+	 */
+	if (!httpStatus.isValid()) {
+		emit error("Could not request source status: " + errorString);
+		return;
+	}
+	if (exists && body.isEmpty()) {
+		emit error("Could not request source status: empty reply");
+		return;
+	}
+
+	/* Only parse a status which differs from the last. */
+	if (!m_hasSourceStatus || (exists != m_sourceExists) ||
+			(body != m_sourceStatusBody)) {
+		QJsonObject status;
+		if (exists) {
+			QJsonParseError parseError;
+			auto document = QJsonDocument::fromJson(body, &parseError);
+			if ( (parseError.error != QJsonParseError::NoError) || !document.isObject() ) {
+				emit error("Received invalid source status from BLDS");
+				return;
+			}
+			status = document.object();
+		}
+		auto changed = changedFields(m_sourceStatus, status);
+		const bool first = !m_hasSourceStatus;
+		const bool existenceChanged = (exists != m_sourceExists);
+		m_hasSourceStatus = true;
+		m_sourceExists = exists;
+		m_sourceStatusBody = body;
+		m_sourceStatus = status;
+		if (first || existenceChanged || !changed.isEmpty())
+			emit sourceStatusChanged(exists, changed);
+	}
+	emit sourceStatus(exists, m_sourceStatus);
 }
 
@@ -0,0 +1,296 @@
+/*! \file bulk-fetcher.cc
+ *
+ * Implementation of the BulkFetcher class.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#include "bulk-fetcher.h"
+
+#include <cmath>
+
+BulkFetcher::BulkFetcher(const QString& hostname, quint16 port, QObject* parent) :
+	QObject(parent),
+	m_hostname(hostname),
+	m_port(port)
+{
+}
+
+BulkFetcher::~BulkFetcher()
+{
+	/* The clients are children, and so are deleted with the fetcher. */
+	m_active = false;
+	if (m_recorder)
+		m_recorder->close();
+}
+
+float BulkFetcher::chunkDuration() const
+{
+	return m_chunkDuration;
+}
+
+void BulkFetcher::setChunkDuration(float seconds)
+{
+	if (seconds > 0)
+		m_chunkDuration = seconds;
+}
+
+int BulkFetcher::connectionCount() const
+{
+	return m_connectionCount;
+}
+
+void BulkFetcher::setConnectionCount(int count)
+{
+	m_connectionCount = qMax(count, 1);
+}
+
+int BulkFetcher::maxInFlight() const
+{
+	return m_maxInFlight;
+}
+
+void BulkFetcher::setMaxInFlight(int count)
+{
+	m_maxInFlight = qMax(count, 1);
+}
+
+int BulkFetcher::maxRetries() const
+{
+	return m_maxRetries;
+}
+
+void BulkFetcher::setMaxRetries(int count)
+{
+	m_maxRetries = qMax(count, 0);
+}
+
+double BulkFetcher::sampleRate() const
+{
+	return m_sampleRate;
+}
+
+void BulkFetcher::setSampleRate(double rate)
+{
+	m_sampleRate = qMax(rate, 0.);
+}
+
+QString BulkFetcher::outputFile() const
+{
+	return m_outputFile;
+}
+
+void BulkFetcher::setOutputFile(const QString& path)
+{
+	m_outputFile = path;
+}
+
+bool BulkFetcher::isActive() const
+{
+	return m_active;
+}
+
+bool BulkFetcher::fetch(float start, float stop)
+{
+	if (m_active || (stop <= start))
+		return false;
+
+	m_clock.setRate(m_sampleRate);
+	if (m_clock.isValid()) {
+		const auto samples = m_clock.toSample(stop) - m_clock.toSample(start);
+		const auto perChunk = qMax<qint64>(1, m_clock.toSample(m_chunkDuration));
+		m_chunkCount = static_cast<int>((samples + perChunk - 1) / perChunk);
+	} else {
+		m_chunkCount = static_cast<int>(std::ceil((stop - start) / m_chunkDuration));
+	}
+	if (m_chunkCount <= 0)
+		return false;
+
+	if (!m_outputFile.isEmpty()) {
+		m_recorder.reset(new FrameRecorder(m_outputFile));
+		if (!m_recorder->open()) {
+			auto msg = m_recorder->errorString();
+			m_recorder.reset();
+			emit finished(false, msg);
+			return false;
+		}
+	}
+
+	m_active = true;
+	m_start = start;
+	m_stop = stop;
+	m_nextRequest = 0;
+	m_nextDelivery = 0;
+	m_retryQueue.clear();
+	m_chunks.clear();
+
+	/* Each connection decodes in its own I/O thread, so that chunks
+	 * arriving on different connections are decoded concurrently.
+	 */
+	m_connections.resize(m_connectionCount);
+	for (int i = 0; i < m_connections.size(); i++) {
+		auto* client = new BldsClient(m_hostname, m_port, this);
+		client->setUseIoThread(true);
+		client->setFramePoolCapacity(m_maxInFlight + 2);
+		if (m_clock.isValid())
+			client->setSampleRate(m_clock.rate());
+		m_connections[i].client = client;
+		QObject::connect(client, &BldsClient::connected, this, [this, i](bool made) -> void {
+					if (!m_active)
+						return;
+					if (!made) {
+						finish(false, "Could not connect to BLDS");
+						return;
+					}
+					m_connections[i].ready = true;
+					requestChunks();
+				});
+		QObject::connect(client, &BldsClient::disconnected, this, [this]() -> void {
+					if (m_active)
+						finish(false, "Disconnected from BLDS");
+				});
+		QObject::connect(client, &BldsClient::error, this, [this, i]() -> void {
+					if (m_active && m_connections[i].ready &&
+							!m_connections[i].client->isConnected()) {
+						finish(false, "Lost connection to BLDS");
+					}
+				});
+		QObject::connect(client, &BldsClient::requestFinished, this,
+				[this, i](quint64 id, bool success, const QVariant& data) -> void {
+					handleResponse(i, id, success, data);
+				});
+		client->connect();
+	}
+	return true;
+}
+
+void BulkFetcher::cancel()
+{
+	finish(false, "Fetch cancelled");
+}
+
+void BulkFetcher::requestChunks()
+{
+	/* Spread requests across connections, one at a time, and never
+	 * request further ahead than the chunks which may be held.
+	 */
+	const int window = m_connectionCount * m_maxInFlight;
+	bool issued = true;
+	while (m_active && issued) {
+		issued = false;
+		for (auto& connection : m_connections) {
+			if (!connection.ready || (connection.requests.size() >= m_maxInFlight))
+				continue;
+			int index;
+			if (!m_retryQueue.isEmpty()) {
+				index = m_retryQueue.takeFirst();
+			} else if ( (m_nextRequest < m_chunkCount) &&
+					(m_nextRequest < m_nextDelivery + window) ) {
+				index = m_nextRequest++;
+			} else {
+				return;
+			}
+			if (!requestChunk(connection, index)) {
+				finish(false, QString("Could not request chunk %1").arg(index));
+				return;
+			}
+			issued = true;
+		}
+	}
+}
+
+bool BulkFetcher::requestChunk(Connection& connection, int index)
+{
+	quint64 id;
+	if (m_clock.isValid()) {
+		const auto first = m_clock.toSample(m_start);
+		const auto perChunk = qMax<qint64>(1, m_clock.toSample(m_chunkDuration));
+		const auto start = first + index * perChunk;
+		const auto stop = qMin(start + perChunk, m_clock.toSample(m_stop));
+		id = connection.client->getDataSamples(start, stop);
+	} else {
+		const float start = m_start + index * m_chunkDuration;
+		const float stop = qMin(m_start + (index + 1) * m_chunkDuration, m_stop);
+		id = connection.client->getData(start, stop);
+	}
+	if (id == 0)
+		return false;
+	m_chunks[index];
+	connection.requests.insert(id, index);
+	return true;
+}
+
+void BulkFetcher::handleResponse(int connection, quint64 id, bool success,
+		const QVariant& data)
+{
+	if (!m_active || (connection >= m_connections.size()))
+		return;
+	auto& requests = m_connections[connection].requests;
+	auto it = requests.find(id);
+	if (it == requests.end())
+		return;
+	const int index = it.value();
+	requests.erase(it);
+
+	auto& chunk = m_chunks[index];
+	auto frame = data.value<PooledFrame>();
+	if (success && !frame.isNull()) {
+		chunk.received = true;
+		chunk.frame = frame;
+		deliverChunks();
+	} else if (!m_connections[connection].client->isConnected()) {
+		/* The connection was lost, and with it every request on it, so
+		 * retrying on the same client would only fail again.
+		 */
+		finish(false, "Lost connection to BLDS");
+		return;
+	} else if (chunk.retries++ < m_maxRetries) {
+		m_retryQueue.append(index);
+	} else {
+		finish(false, QString("Could not fetch chunk %1: %2").arg(index).arg(data.toString()));
+		return;
+	}
+	requestChunks();
+}
+
+void BulkFetcher::deliverChunks()
+{
+	while (m_active) {
+		auto it = m_chunks.find(m_nextDelivery);
+		if ( (it == m_chunks.end()) || !it->received )
+			return;
+		auto frame = it->frame;
+		m_chunks.erase(it);
+		if (m_recorder && !m_recorder->append(*frame)) {
+			finish(false, m_recorder->errorString());
+			return;
+		}
+		const int index = m_nextDelivery++;
+		emit chunkReady(index, frame);
+		emit progress(m_nextDelivery, m_chunkCount);
+		if (m_nextDelivery == m_chunkCount)
+			finish(true, QString());
+	}
+}
+
+void BulkFetcher::finish(bool success, const QString& msg)
+{
+	if (!m_active)
+		return;
+	m_active = false;
+
+	/* The clients may be emitting the signal being handled. */
+	for (auto& connection : m_connections) {
+		QObject::disconnect(connection.client, nullptr, this, nullptr);
+		connection.client->deleteLater();
+	}
+	m_connections.clear();
+	m_chunks.clear();
+	m_retryQueue.clear();
+	if (m_recorder) {
+		m_recorder->close();
+		m_recorder.reset();
+	}
+	emit finished(success, msg);
+}
+
@@ -0,0 +1,96 @@
+/*! \file channel-processor.cc
+ *
+ * Implementation of the ChannelProcessor class.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#include "channel-processor.h"
+
+namespace {
+
+/* State shared by all threads taking part in one call to run(). */
+struct ChannelWork {
+	const ChannelProcessor::Function* function;
+	quint32 nchannels;
+	quint32 grain;
+	quint32 nranges;
+	QAtomicInteger<quint32> next;
+	QSemaphore done;
+
+	/* Claim and process ranges until none remain. */
+	void process()
+	{
+		while (true) {
+			auto range = next.fetchAndAddRelaxed(1);
+			if (range >= nranges)
+				return;
+			auto first = range * grain;
+			(*function)(first, qMin(grain, nchannels - first));
+		}
+	}
+};
+
+class ChannelWorker : public QRunnable {
+	public:
+		ChannelWorker(ChannelWork* work) : m_work(work) {}
+
+		void run() override
+		{
+			m_work->process();
+			m_work->done.release();
+		}
+
+	private:
+		ChannelWork* m_work;
+};
+
+} // end anonymous namespace
+
+ChannelProcessor::ChannelProcessor(int threads)
+{
+	setThreadCount(threads);
+}
+
+ChannelProcessor::~ChannelProcessor()
+{
+	m_pool.waitForDone();
+}
+
+int ChannelProcessor::threadCount() const
+{
+	return m_threads;
+}
+
+void ChannelProcessor::setThreadCount(int threads)
+{
+	m_threads = (threads > 0) ? threads : qMax(QThread::idealThreadCount(), 1);
+	m_pool.setMaxThreadCount(qMax(m_threads - 1, 1));
+}
+
+void ChannelProcessor::run(quint32 nchannels, quint32 grain, const Function& function)
+{
+	if (nchannels == 0)
+		return;
+	if (grain == 0)
+		grain = qMax<quint32>(1, nchannels / (4 * m_threads));
+
+	ChannelWork work;
+	work.function = &function;
+	work.nchannels = nchannels;
+	work.grain = grain;
+	work.nranges = (nchannels + grain - 1) / grain;
+	work.next.store(0);
+
+	/* Start no more workers than there are ranges for them to claim,
+	 * and take part in the work from the calling thread.
+	 */
+	const int workers = qMin<int>(m_threads - 1, work.nranges - 1);
+	for (int i = 0; i < workers; i++) {
+		auto worker = new ChannelWorker(&work);
+		worker->setAutoDelete(true);
+		m_pool.start(worker);
+	}
+	work.process();
+	work.done.acquire(workers);
+}
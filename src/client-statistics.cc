@@ -0,0 +1,234 @@
+/*! \file client-statistics.cc
+ *
+ * Implementation of the LatencyHistogram and ClientStatistics classes.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#include "client-statistics.h"
+
+#include <cmath>
+
+namespace {
+
+/* Return the upper bound of a bucket of a histogram, in microseconds. */
+double bucketBound(int bucket)
+{
+	return static_cast<double>(quint64(1) << bucket);
+}
+
+/* Estimate a percentile from the buckets of a histogram. */
+double percentile(const LatencyHistogram::Summary& summary, double fraction)
+{
+	if (summary.count == 0)
+		return 0.;
+	/* Rank of the percentile, guarding against rounding up an exact rank. */
+	const quint64 rank = qMax<quint64>(1, std::ceil(fraction * summary.count - 1e-9));
+	quint64 cumulative = 0;
+	for (int i = 0; i < summary.buckets.size(); i++) {
+		cumulative += summary.buckets.at(i);
+		if (cumulative >= rank)
+			return qMin(bucketBound(i), summary.max);
+	}
+	return summary.max;
+}
+
+} // end anonymous namespace
+
+QJsonObject LatencyHistogram::Summary::toJson() const
+{
+	QJsonObject json;
+	json.insert("count", static_cast<double>(count));
+	json.insert("mean", mean);
+	json.insert("max", max);
+	json.insert("p50", p50);
+	json.insert("p99", p99);
+	return json;
+}
+
+LatencyHistogram::LatencyHistogram() :
+	m_count(0),
+	m_total(0),
+	m_max(0)
+{
+	for (auto& bucket : m_buckets)
+		bucket.store(0);
+}
+
+void LatencyHistogram::record(qint64 nsec)
+{
+	const quint64 ns = qMax<qint64>(nsec, 0);
+	const quint64 us = ns / 1000;
+	const int bucket = (us == 0) ? 0 :
+		qMin(BucketCount - 1, 64 - static_cast<int>(qCountLeadingZeroBits(us)));
+	m_buckets[bucket].fetchAndAddRelaxed(1);
+	m_count.fetchAndAddRelaxed(1);
+	m_total.fetchAndAddRelaxed(ns);
+	auto max = m_max.load();
+	while ( (ns > max) && !m_max.testAndSetRelaxed(max, ns) )
+		max = m_max.load();
+}
+
+LatencyHistogram::Summary LatencyHistogram::summary() const
+{
+	Summary summary;
+	summary.buckets.resize(BucketCount);
+	for (int i = 0; i < BucketCount; i++) {
+		summary.buckets[i] = m_buckets[i].load();
+		summary.count += summary.buckets[i];
+	}
+	if (summary.count > 0)
+		summary.mean = m_total.load() / 1e3 / summary.count;
+	summary.max = m_max.load() / 1e3;
+	summary.p50 = percentile(summary, 0.5);
+	summary.p99 = percentile(summary, 0.99);
+	return summary;
+}
+
+void LatencyHistogram::reset()
+{
+	for (auto& bucket : m_buckets)
+		bucket.store(0);
+	m_count.store(0);
+	m_total.store(0);
+	m_max.store(0);
+}
+
+double ClientStatistics::Snapshot::bytesPerSecond() const
+{
+	return (elapsed > 0) ? bytesReceived / elapsed : 0.;
+}
+
+double ClientStatistics::Snapshot::framesPerSecond() const
+{
+	return (elapsed > 0) ? framesReceived / elapsed : 0.;
+}
+
+QJsonObject ClientStatistics::Snapshot::toJson() const
+{
+	QJsonObject json;
+	json.insert("elapsed", elapsed);
+	json.insert("bytes-received", static_cast<double>(bytesReceived));
+	json.insert("bytes-per-second", bytesPerSecond());
+	json.insert("messages-received", static_cast<double>(messagesReceived));
+	json.insert("frames-received", static_cast<double>(framesReceived));
+	json.insert("frames-per-second", framesPerSecond());
+	json.insert("frames-dropped", static_cast<double>(framesDropped));
+	json.insert("decode-time", decodeTime.toJson());
+	json.insert("socket-backlog", static_cast<double>(socketBacklog));
+	json.insert("max-socket-backlog", static_cast<double>(maxSocketBacklog));
+	json.insert("ring-occupancy", static_cast<double>(ringOccupancy));
+	json.insert("max-ring-occupancy", static_cast<double>(maxRingOccupancy));
+	QJsonObject requests;
+	for (auto it = requestTime.constBegin(); it != requestTime.constEnd(); ++it)
+		requests.insert(it.key(), it.value().toJson());
+	json.insert("request-time", requests);
+	return json;
+}
+
+ClientStatistics::ClientStatistics() :
+	m_resetTime(0),
+	m_bytes(0),
+	m_messages(0),
+	m_frames(0),
+	m_dropped(0),
+	m_backlog(0),
+	m_maxBacklog(0),
+	m_ring(0),
+	m_maxRing(0)
+{
+	m_clock.start();
+}
+
+ClientStatistics::Snapshot ClientStatistics::snapshot() const
+{
+	Snapshot snapshot;
+	snapshot.elapsed = (now() - m_resetTime.load()) / 1e9;
+	snapshot.bytesReceived = m_bytes.load();
+	snapshot.messagesReceived = m_messages.load();
+	snapshot.framesReceived = m_frames.load();
+	snapshot.framesDropped = m_dropped.load();
+	snapshot.decodeTime = m_decodeTime.summary();
+	snapshot.socketBacklog = m_backlog.load();
+	snapshot.maxSocketBacklog = m_maxBacklog.load();
+	snapshot.ringOccupancy = m_ring.load();
+	snapshot.maxRingOccupancy = m_maxRing.load();
+	QMutexLocker lock(&m_lock);
+	for (auto it = m_requestTime.constBegin(); it != m_requestTime.constEnd(); ++it)
+		snapshot.requestTime.insert(it.key(), it.value()->summary());
+	return snapshot;
+}
+
+void ClientStatistics::reset()
+{
+	m_resetTime.store(now());
+	m_bytes.store(0);
+	m_messages.store(0);
+	m_frames.store(0);
+	m_dropped.store(0);
+	m_decodeTime.reset();
+	m_backlog.store(0);
+	m_maxBacklog.store(0);
+	m_ring.store(0);
+	m_maxRing.store(0);
+	QMutexLocker lock(&m_lock);
+	for (auto& histogram : m_requestTime)
+		histogram->reset();
+}
+
+qint64 ClientStatistics::now() const
+{
+	return m_clock.nsecsElapsed();
+}
+
+void ClientStatistics::addBytes(qint64 count, qint64 backlog)
+{
+	if (count > 0)
+		m_bytes.fetchAndAddRelaxed(count);
+	m_backlog.store(backlog);
+	raise(m_maxBacklog, backlog);
+}
+
+void ClientStatistics::addMessage()
+{
+	m_messages.fetchAndAddRelaxed(1);
+}
+
+void ClientStatistics::addFrame(qint64 nsec)
+{
+	m_frames.fetchAndAddRelaxed(1);
+	m_decodeTime.record(nsec);
+}
+
+void ClientStatistics::addDropped(quint64 count)
+{
+	if (count > 0)
+		m_dropped.fetchAndAddRelaxed(count);
+}
+
+void ClientStatistics::setRingOccupancy(qint64 count)
+{
+	m_ring.store(count);
+	raise(m_maxRing, count);
+}
+
+void ClientStatistics::addRequest(const QString& type, qint64 nsec)
+{
+	QSharedPointer<LatencyHistogram> histogram;
+	{
+		QMutexLocker lock(&m_lock);
+		auto& entry = m_requestTime[type];
+		if (!entry)
+			entry = QSharedPointer<LatencyHistogram>::create();
+		histogram = entry;
+	}
+	histogram->record(nsec);
+}
+
+void ClientStatistics::raise(QAtomicInteger<qint64>& max, qint64 value)
+{
+	auto current = max.load();
+	while ( (value > current) && !max.testAndSetRelaxed(current, value) )
+		current = max.load();
+}
+
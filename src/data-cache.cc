@@ -0,0 +1,356 @@
+/*! \file data-cache.cc
+ *
+ * Implementation of the DataCache class.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#include "data-cache.h"
+
+#include <cmath>
+#include <limits>
+
+namespace {
+
+/* Return the size of the samples of a frame, in bytes. */
+qint64 frameBytes(const DataFrame& frame)
+{
+	return static_cast<qint64>(frame.data().n_elem) *
+		sizeof(DataFrame::Samples::elem_type);
+}
+
+} // end anonymous namespace
+
+DataCache::DataCache() :
+	m_maxDuration(0.),
+	m_maxSize(0),
+	m_size(0),
+	m_latestStop(-std::numeric_limits<float>::max())
+{
+}
+
+float DataCache::maxDuration() const
+{
+	return m_maxDuration;
+}
+
+void DataCache::setMaxDuration(float seconds)
+{
+	m_maxDuration = qMax(seconds, 0.f);
+	if (isEnabled())
+		evict();
+	else
+		clear();
+}
+
+qint64 DataCache::maxSize() const
+{
+	return m_maxSize;
+}
+
+void DataCache::setMaxSize(qint64 bytes)
+{
+	m_maxSize = qMax<qint64>(bytes, 0);
+	if (isEnabled())
+		evict();
+	else
+		clear();
+}
+
+bool DataCache::isEnabled() const
+{
+	return (m_maxDuration > 0) || (m_maxSize > 0);
+}
+
+qint64 DataCache::size() const
+{
+	return m_size;
+}
+
+int DataCache::frameCount() const
+{
+	return m_frames.size();
+}
+
+void DataCache::clear()
+{
+	m_frames.clear();
+	m_size = 0;
+	m_latestStop = -std::numeric_limits<float>::max();
+}
+
+void DataCache::insert(const PooledFrame& frame)
+{
+	if (!isEnabled() || frame.isNull() || (frame->nsamples() == 0))
+		return;
+
+	/* Frames of a different shape or rate cannot be assembled with
+	 * those already cached, e.g. after the channel selection changes.
+	 */
+	if (!m_frames.isEmpty()) {
+		const auto& first = *m_frames.first();
+		auto period = samplePeriod(first);
+		if ( (first.nchannels() != frame->nchannels()) ||
+				(std::abs(samplePeriod(*frame) - period) > 1e-3 * period) ) {
+			clear();
+		}
+	}
+
+	auto it = m_frames.find(frame->start());
+	if (it != m_frames.end()) {
+		m_size -= frameBytes(**it);
+		*it = frame;
+	} else {
+		m_frames.insert(frame->start(), frame);
+	}
+	m_size += frameBytes(*frame);
+	m_latestStop = qMax(m_latestStop, frame->stop());
+	evict();
+}
+
+DataCache::Coverage DataCache::coverage(float start, float stop,
+		float& gapStart, float& gapStop) const
+{
+	if (m_frames.isEmpty() || (stop <= start))
+		return NotCovered;
+
+	/* Walk the frames in order of start time, advancing a cursor
+	 * through the range, and note the first and last uncovered times.
+	 */
+	const double tolerance = 0.5 * samplePeriod(*m_frames.first());
+	double cursor = start;
+	bool hasGap = false;
+	double firstGap = 0., lastGap = 0.;
+	for (const auto& frame : m_frames) {
+		if (frame->start() >= stop - tolerance)
+			break;
+		if (frame->stop() <= cursor + tolerance)
+			continue;
+		if (frame->start() > cursor + tolerance) {
+			if (!hasGap)
+				firstGap = cursor;
+			hasGap = true;
+			lastGap = frame->start();
+		}
+		cursor = frame->stop();
+	}
+	if (cursor < stop - tolerance) {
+		if (!hasGap)
+			firstGap = cursor;
+		hasGap = true;
+		lastGap = stop;
+	}
+
+	if (!hasGap)
+		return Covered;
+	if ( (firstGap <= start + tolerance) && (lastGap >= stop - tolerance) )
+		return NotCovered;
+	gapStart = firstGap;
+	gapStop = lastGap;
+	return PartiallyCovered;
+}
+
+PooledFrame DataCache::extract(float start, float stop, FramePool& pool,
+		const PooledFrame& extra) const
+{
+	auto overlaps = [start, stop](const DataFrame& frame) -> bool {
+		return (frame.nsamples() > 0) && (frame.start() < stop) && (frame.stop() > start);
+	};
+
+	/* Align the assembled frame to the samples of the first frame
+	 * overlapping the range. Cached frames are only used if they
+	 * match the shape of the extra frame, if one is given.
+	 */
+	const bool hasExtra = !extra.isNull() && overlaps(*extra);
+	bool useCache = !m_frames.isEmpty();
+	if (useCache && hasExtra) {
+		const auto& first = *m_frames.first();
+		auto period = samplePeriod(first);
+		useCache = (first.nchannels() == extra->nchannels()) &&
+			(std::abs(samplePeriod(*extra) - period) <= 1e-3 * period);
+	}
+	const DataFrame* reference = nullptr;
+	if (useCache) {
+		for (const auto& frame : m_frames) {
+			if (frame->start() >= stop)
+				break;
+			if (overlaps(*frame)) {
+				reference = &(*frame);
+				break;
+			}
+		}
+	}
+	if (!reference && hasExtra)
+		reference = &(*extra);
+	if (!reference)
+		return PooledFrame();
+
+	const double period = samplePeriod(*reference);
+	const double alignedStart = reference->start() +
+		std::round((start - reference->start()) / period) * period;
+	const auto nsamples = static_cast<arma::sword>(std::round((stop - start) / period));
+	if (nsamples <= 0)
+		return PooledFrame();
+
+	auto result = pool.acquire(alignedStart, alignedStart + nsamples * period,
+			nsamples, reference->nchannels());
+	auto& assembled = result.frame();
+	assembled.data().zeros();
+	if (useCache) {
+		for (const auto& frame : m_frames) {
+			if (frame->start() >= stop)
+				break;
+			if (overlaps(*frame))
+				copyOverlap(*frame, assembled, period);
+		}
+	}
+	if (hasExtra)
+		copyOverlap(*extra, assembled, period);
+	return result;
+}
+
+DataCache::Coverage DataCache::coverage(qint64 start, qint64 stop,
+		qint64& gapStart, qint64& gapStop) const
+{
+	if (m_frames.isEmpty() || (stop <= start))
+		return NotCovered;
+
+	/* As for a range of time, but exactly, and without tolerance. */
+	qint64 cursor = start;
+	bool hasGap = false;
+	qint64 firstGap = 0, lastGap = 0;
+	for (const auto& frame : m_frames) {
+		if (!frame.hasSampleIndex())
+			return NotCovered;
+		if (frame.firstSample() >= stop)
+			break;
+		if (frame.stopSample() <= cursor)
+			continue;
+		if (frame.firstSample() > cursor) {
+			if (!hasGap)
+				firstGap = cursor;
+			hasGap = true;
+			lastGap = frame.firstSample();
+		}
+		cursor = qMax(cursor, frame.stopSample());
+	}
+	if (cursor < stop) {
+		if (!hasGap)
+			firstGap = cursor;
+		hasGap = true;
+		lastGap = stop;
+	}
+
+	if (!hasGap)
+		return Covered;
+	if ( (firstGap <= start) && (lastGap >= stop) )
+		return NotCovered;
+	gapStart = firstGap;
+	gapStop = lastGap;
+	return PartiallyCovered;
+}
+
+PooledFrame DataCache::extractSamples(qint64 start, qint64 stop,
+		const SampleClock& clock, FramePool& pool, const PooledFrame& extra) const
+{
+	auto overlaps = [start, stop](const PooledFrame& frame) -> bool {
+		return frame.hasSampleIndex() && (frame->nsamples() > 0) &&
+			(frame.firstSample() < stop) && (frame.stopSample() > start);
+	};
+	if (stop <= start)
+		return PooledFrame();
+
+	/* Cached frames are only used if they match the shape of the
+	 * extra frame, if one is given, as for a range of time.
+	 */
+	const bool hasExtra = !extra.isNull() && overlaps(extra);
+	bool useCache = !m_frames.isEmpty();
+	if (useCache && hasExtra) {
+		const auto& first = *m_frames.first();
+		auto period = samplePeriod(first);
+		useCache = (first.nchannels() == extra->nchannels()) &&
+			(std::abs(samplePeriod(*extra) - period) <= 1e-3 * period);
+	}
+	const PooledFrame* reference = nullptr;
+	if (useCache) {
+		for (const auto& frame : m_frames) {
+			if (frame.firstSample() >= stop)
+				break;
+			if (overlaps(frame)) {
+				reference = &frame;
+				break;
+			}
+		}
+	}
+	if (!reference && hasExtra)
+		reference = &extra;
+	if (!reference)
+		return PooledFrame();
+
+	auto result = pool.acquire(clock.toSeconds(start), clock.toSeconds(stop),
+			stop - start, (*reference)->nchannels());
+	result.setFirstSample(start);
+	result.frame().data().zeros();
+	if (useCache) {
+		for (const auto& frame : m_frames) {
+			if (frame.firstSample() >= stop)
+				break;
+			if (overlaps(frame))
+				copySampleOverlap(frame, result);
+		}
+	}
+	if (hasExtra)
+		copySampleOverlap(extra, result);
+	return result;
+}
+
+double DataCache::samplePeriod(const DataFrame& frame)
+{
+	return (static_cast<double>(frame.stop()) - frame.start()) / frame.nsamples();
+}
+
+void DataCache::copyOverlap(const DataFrame& source, DataFrame& dest,
+		double period)
+{
+	/* Offset of the source's first sample in the destination. */
+	const auto offset = static_cast<arma::sword>(
+			std::round((source.start() - dest.start()) / period));
+	const auto sourceSamples = static_cast<arma::sword>(source.nsamples());
+	const auto destSamples = static_cast<arma::sword>(dest.nsamples());
+	const auto first = qMax<arma::sword>(0, -offset);
+	const auto last = qMin<arma::sword>(sourceSamples, destSamples - offset);
+	if (last <= first)
+		return;
+	dest.data().rows(first + offset, last + offset - 1) =
+		source.data().rows(first, last - 1);
+}
+
+void DataCache::copySampleOverlap(const PooledFrame& source, PooledFrame& dest)
+{
+	const auto first = qMax(source.firstSample(), dest.firstSample());
+	const auto last = qMin(source.stopSample(), dest.stopSample());
+	if (last <= first)
+		return;
+	dest.frame().data().rows(first - dest.firstSample(), last - dest.firstSample() - 1) =
+		source->data().rows(first - source.firstSample(), last - source.firstSample() - 1);
+}
+
+void DataCache::evict()
+{
+	if (m_maxDuration > 0) {
+		while (!m_frames.isEmpty() &&
+				(m_frames.first()->stop() < m_latestStop - m_maxDuration)) {
+			m_size -= frameBytes(*m_frames.first());
+			m_frames.erase(m_frames.begin());
+		}
+	}
+	if (m_maxSize > 0) {
+		while (!m_frames.isEmpty() && (m_size > m_maxSize)) {
+			m_size -= frameBytes(*m_frames.first());
+			m_frames.erase(m_frames.begin());
+		}
+	}
+	if (m_frames.isEmpty())
+		clear();
+}
+
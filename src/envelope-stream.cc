@@ -0,0 +1,180 @@
+/*! \file envelope-stream.cc
+ *
+ * Implementation of the EnvelopeDecimator and EnvelopeStream classes.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#include "envelope-stream.h"
+#include "sample-conversion.h"
+
+#include <cmath>
+#include <limits>
+
+EnvelopeDecimator::EnvelopeDecimator(int binSize) :
+	m_binSize(qMax(binSize, 1))
+{
+}
+
+int EnvelopeDecimator::binSize() const
+{
+	return m_binSize;
+}
+
+void EnvelopeDecimator::setBinSize(int binSize)
+{
+	m_binSize = qMax(binSize, 1);
+	reset();
+}
+
+void EnvelopeDecimator::reset()
+{
+	m_filled = 0;
+	m_minima.clear();
+	m_maxima.clear();
+}
+
+bool EnvelopeDecimator::decimate(const DataFrame& frame, Envelope& envelope)
+{
+	const arma::uword nsamples = frame.nsamples();
+	const arma::uword nchannels = frame.nchannels();
+	if (nsamples == 0)
+		return false;
+	const double period = (static_cast<double>(frame.stop()) - frame.start()) / nsamples;
+
+	/* Start binning again if the frame does not follow the last. */
+	if ( (m_minima.size() != static_cast<int>(nchannels)) ||
+			(std::abs(frame.start() - m_nextStart) > 0.5 * period) ) {
+		m_filled = 0;
+		m_minima.resize(nchannels);
+		m_maxima.resize(nchannels);
+	}
+	if (m_filled == 0)
+		m_binStart = frame.start();
+	m_nextStart = frame.stop();
+
+	const arma::uword bin = m_binSize;
+	const arma::uword nbins = (m_filled + nsamples) / bin;
+	const arma::uword head = qMin<arma::uword>(bin - m_filled, nsamples);
+	envelope.minima.set_size(nbins, nchannels);
+	envelope.maxima.set_size(nbins, nchannels);
+
+	for (arma::uword c = 0; c < nchannels; c++) {
+		const qint16* column = frame.data().colptr(c);
+		qint16* minima = envelope.minima.colptr(c);
+		qint16* maxima = envelope.maxima.colptr(c);
+		arma::uword row = 0, offset = 0;
+
+		/* Complete the bin left over from the previous frame. */
+		qint16 lo = std::numeric_limits<qint16>::max();
+		qint16 hi = std::numeric_limits<qint16>::min();
+		if (m_filled > 0) {
+			lo = m_minima[c];
+			hi = m_maxima[c];
+			conversion::minMax(column, head, lo, hi);
+			offset = head;
+			if (m_filled + head == bin) {
+				minima[row] = lo;
+				maxima[row] = hi;
+				row++;
+			}
+		}
+
+		/* Whole bins within the frame. */
+		for (; offset + bin <= nsamples; offset += bin, row++) {
+			lo = std::numeric_limits<qint16>::max();
+			hi = std::numeric_limits<qint16>::min();
+			conversion::minMax(column + offset, bin, lo, hi);
+			minima[row] = lo;
+			maxima[row] = hi;
+		}
+
+		/* Start the next incomplete bin with the remainder. */
+		if (offset < nsamples) {
+			if ( (m_filled == 0) || (m_filled + head == bin) ) {
+				lo = std::numeric_limits<qint16>::max();
+				hi = std::numeric_limits<qint16>::min();
+			}
+			conversion::minMax(column + offset, nsamples - offset, lo, hi);
+		}
+		m_minima[c] = lo;
+		m_maxima[c] = hi;
+	}
+
+	envelope.start = m_binStart;
+	envelope.stop = m_binStart + nbins * bin * period;
+	m_filled = (m_filled + nsamples) % bin;
+	m_binStart += nbins * bin * period;
+	return nbins > 0;
+}
+
+EnvelopeStream::EnvelopeStream(BldsClient* client, float outputRate, QObject* parent) :
+	QObject(parent),
+	m_client(client),
+	m_outputRate(qMax(outputRate, 0.f)),
+	m_guard(new Guard)
+{
+	qRegisterMetaType<Envelope>();
+
+	/* Frames are delivered through the guard, rather than to the stream
+	 * itself, so that the stream may be destroyed while a frame is
+	 * being decoded in another thread.
+	 */
+	m_guard->stream = this;
+	auto guard = m_guard;
+	m_frameConnection = QObject::connect(m_client, &BldsClient::streamedFrameReceived,
+			[guard](const PooledFrame& frame) -> void {
+				QMutexLocker lock(&guard->lock);
+				if (guard->stream)
+					guard->stream->handleFrame(frame);
+			});
+}
+
+EnvelopeStream::~EnvelopeStream()
+{
+	/* Wait for any frame being decimated, and ignore those after. */
+	{
+		QMutexLocker lock(&m_guard->lock);
+		m_guard->stream = nullptr;
+	}
+	QObject::disconnect(m_frameConnection);
+}
+
+BldsClient* EnvelopeStream::client() const
+{
+	return m_client;
+}
+
+float EnvelopeStream::outputRate() const
+{
+	QMutexLocker lock(&m_lock);
+	return m_outputRate;
+}
+
+void EnvelopeStream::setOutputRate(float rate)
+{
+	QMutexLocker lock(&m_lock);
+	m_outputRate = qMax(rate, 0.f);
+	m_sampleRate = 0.; // choose the bin size again with the next frame
+}
+
+void EnvelopeStream::handleFrame(const PooledFrame& frame)
+{
+	if (frame.isNull() || (frame->nsamples() == 0) || (frame->stop() <= frame->start()))
+		return;
+
+	Envelope envelope;
+	{
+		QMutexLocker lock(&m_lock);
+		const float rate = frame->nsamples() / (frame->stop() - frame->start());
+		if (std::abs(rate - m_sampleRate) > 1e-3 * rate) {
+			m_sampleRate = rate;
+			m_decimator.setBinSize((m_outputRate > 0) ?
+					static_cast<int>(std::round(rate / m_outputRate)) : 1);
+		}
+		if (!m_decimator.decimate(*frame, envelope))
+			return;
+	}
+	emit envelopeReady(envelope);
+}
+
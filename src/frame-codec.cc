@@ -0,0 +1,227 @@
+/*! \file frame-codec.cc
+ *
+ * Implementation of the frame encoding functions.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#include "frame-codec.h"
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#  define BLDS_CLIENT_HAVE_SSE2
+#  include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  define BLDS_CLIENT_HAVE_NEON
+#  include <arm_neon.h>
+#endif
+
+#ifdef BLDS_CLIENT_HAVE_LZ4
+#  include <lz4.h>
+#endif
+#ifdef BLDS_CLIENT_HAVE_ZSTD
+#  include <zstd.h>
+#endif
+
+namespace codec {
+
+namespace {
+
+/* Compression level used when encoding with zstd. Low levels are
+ * nearly as effective on delta-encoded samples, and much faster.
+ */
+const int ZstdLevel = 1;
+
+/* Delta-encode the samples of each channel of a frame. */
+QByteArray differenceColumns(const DataFrame::Samples& samples)
+{
+	QByteArray buffer(samples.n_elem * sizeof(qint16), Qt::Uninitialized);
+	auto* output = reinterpret_cast<qint16*>(buffer.data());
+	for (arma::uword c = 0; c < samples.n_cols; c++)
+		difference(samples.colptr(c), output + c * samples.n_rows, samples.n_rows);
+	return buffer;
+}
+
+} // end anonymous namespace
+
+const char* encodingName(Encoding encoding)
+{
+	switch (encoding) {
+		case RawEncoding:
+			return "raw";
+		case DeltaEncoding:
+			return "delta";
+		case DeltaLz4Encoding:
+			return "delta-lz4";
+		case DeltaZstdEncoding:
+			return "delta-zstd";
+		default:
+			return "";
+	}
+}
+
+bool isSupported(Encoding encoding)
+{
+	switch (encoding) {
+		case RawEncoding:
+		case DeltaEncoding:
+			return true;
+#ifdef BLDS_CLIENT_HAVE_LZ4
+		case DeltaLz4Encoding:
+			return true;
+#endif
+#ifdef BLDS_CLIENT_HAVE_ZSTD
+		case DeltaZstdEncoding:
+			return true;
+#endif
+		default:
+			return false;
+	}
+}
+
+bool isCompressed(Encoding encoding)
+{
+	return (encoding == DeltaLz4Encoding) || (encoding == DeltaZstdEncoding);
+}
+
+QByteArray encode(const DataFrame::Samples& samples, Encoding encoding)
+{
+	if (!isSupported(encoding))
+		return QByteArray();
+	if (encoding == RawEncoding) {
+		return QByteArray(reinterpret_cast<const char*>(samples.memptr()),
+				samples.n_elem * sizeof(qint16));
+	}
+	auto deltas = differenceColumns(samples);
+	QByteArray buffer;
+	switch (encoding) {
+#ifdef BLDS_CLIENT_HAVE_LZ4
+		case DeltaLz4Encoding: {
+			buffer.resize(LZ4_compressBound(deltas.size()));
+			auto size = LZ4_compress_default(deltas.constData(), buffer.data(),
+					deltas.size(), buffer.size());
+			buffer.resize(qMax(size, 0));
+			break;
+		}
+#endif
+#ifdef BLDS_CLIENT_HAVE_ZSTD
+		case DeltaZstdEncoding: {
+			buffer.resize(ZSTD_compressBound(deltas.size()));
+			auto size = ZSTD_compress(buffer.data(), buffer.size(),
+					deltas.constData(), deltas.size(), ZstdLevel);
+			buffer.resize(ZSTD_isError(size) ? 0 : size);
+			break;
+		}
+#endif
+		default:
+			buffer = deltas;
+			break;
+	}
+	return buffer;
+}
+
+bool decompress(Encoding encoding, const char* input, std::size_t size,
+		char* output, std::size_t outputSize)
+{
+	switch (encoding) {
+		case RawEncoding:
+		case DeltaEncoding:
+			if (size != outputSize)
+				return false;
+			std::memcpy(output, input, size);
+			return true;
+#ifdef BLDS_CLIENT_HAVE_LZ4
+		case DeltaLz4Encoding:
+			return LZ4_decompress_safe(input, output, size, outputSize) ==
+				static_cast<int>(outputSize);
+#endif
+#ifdef BLDS_CLIENT_HAVE_ZSTD
+		case DeltaZstdEncoding: {
+			auto n = ZSTD_decompress(output, outputSize, input, size);
+			return !ZSTD_isError(n) && (n == outputSize);
+		}
+#endif
+		default:
+			return false;
+	}
+}
+
+quint64 maxDecompressedSize(Encoding encoding, quint64 size)
+{
+	switch (encoding) {
+		case RawEncoding:
+		case DeltaEncoding:
+			return size;
+#ifdef BLDS_CLIENT_HAVE_LZ4
+		case DeltaLz4Encoding:
+			/* Each byte of a match length encodes at most 255 bytes. */
+			return size * 255;
+#endif
+#ifdef BLDS_CLIENT_HAVE_ZSTD
+		case DeltaZstdEncoding:
+			/* The densest block is a 4-byte run filling a whole
+			 * block, of at most 128 KiB.
+			 */
+			return size * (128 * 1024 / 4);
+#endif
+		default:
+			return 0;
+	}
+}
+
+void integrate(const qint16* input, qint16* output, std::size_t count)
+{
+	std::size_t i = 0;
+	quint16 sum = 0;
+#if defined(BLDS_CLIENT_HAVE_SSE2)
+	/* Compute the prefix sum of each vector of 8 differences in
+	 * log2(8) shifted adds, then add the running total so far.
+	 */
+	__m128i carry = _mm_setzero_si128();
+	for (; i + 8 <= count; i += 8) {
+		__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+		x = _mm_add_epi16(x, _mm_slli_si128(x, 2));
+		x = _mm_add_epi16(x, _mm_slli_si128(x, 4));
+		x = _mm_add_epi16(x, _mm_slli_si128(x, 8));
+		x = _mm_add_epi16(x, carry);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), x);
+		carry = _mm_shufflehi_epi16(x, _MM_SHUFFLE(3, 3, 3, 3));
+		carry = _mm_unpackhi_epi64(carry, carry);
+	}
+	if (i > 0)
+		sum = output[i - 1];
+#elif defined(BLDS_CLIENT_HAVE_NEON)
+	int16x8_t carry = vdupq_n_s16(0);
+	const int16x8_t zero = vdupq_n_s16(0);
+	for (; i + 8 <= count; i += 8) {
+		int16x8_t x = vld1q_s16(input + i);
+		x = vaddq_s16(x, vextq_s16(zero, x, 7));
+		x = vaddq_s16(x, vextq_s16(zero, x, 6));
+		x = vaddq_s16(x, vextq_s16(zero, x, 4));
+		x = vaddq_s16(x, carry);
+		vst1q_s16(output + i, x);
+		carry = vdupq_n_s16(vgetq_lane_s16(x, 7));
+	}
+	if (i > 0)
+		sum = output[i - 1];
+#endif
+	for (; i < count; i++) {
+		sum += static_cast<quint16>(input[i]);
+		output[i] = static_cast<qint16>(sum);
+	}
+}
+
+void difference(const qint16* input, qint16* output, std::size_t count)
+{
+	/* Work backwards, so that the output may be the same as the input. */
+	for (std::size_t i = count; i > 1; i--) {
+		output[i - 1] = static_cast<qint16>(static_cast<quint16>(input[i - 1]) -
+				static_cast<quint16>(input[i - 2]));
+	}
+	if (count > 0)
+		output[0] = input[0];
+}
+
+} // end codec namespace
+
@@ -0,0 +1,316 @@
+/*! \file frame-pool.cc
+ *
+ * Implementation of the FramePool and PooledFrame classes.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#include "frame-pool.h"
+
+#include <utility>
+
+namespace {
+
+/* Resize a matrix, returning true if its storage was reallocated,
+ * which happens whenever its number of elements changes.
+ */
+template <typename Matrix>
+bool resize(Matrix& matrix, arma::uword nrows, arma::uword ncols)
+{
+	const bool reallocated = (matrix.n_elem != nrows * ncols) && (nrows * ncols > 0);
+	matrix.set_size(nrows, ncols);
+	return reallocated;
+}
+
+/* Provide or withdraw a frame's extra storage. Withdrawn storage is
+ * kept aside rather than freed, so that a frame alternately acquired
+ * with and without it is not reallocated each time.
+ */
+template <typename Matrix>
+bool provide(bool requested, Matrix& matrix, Matrix& spare,
+		arma::uword nrows, arma::uword ncols)
+{
+	if (!requested) {
+		if (!matrix.is_empty())
+			matrix.swap(spare);
+		return false;
+	}
+	if (matrix.is_empty() && !spare.is_empty())
+		matrix.swap(spare);
+	return resize(matrix, nrows, ncols);
+}
+
+} // end anonymous namespace
+
+/* A single frame managed by a pool. The reference count includes
+ * all handles to the frame; the slot is returned to the pool when
+ * it drops to zero.
+ */
+struct FramePoolSlot {
+	FramePoolSlot(FramePoolPrivate* p) :
+		frame(0., 0., DataFrame::Samples()),
+		ref(0),
+		pool(p)
+	{
+	}
+
+	DataFrame frame;
+	arma::fmat floatData;
+	DataFrame::Samples sampleMajorData;
+
+	/* Extra storage kept while the frame is acquired without it. */
+	arma::fmat spareFloatData;
+	DataFrame::Samples spareSampleMajorData;
+
+	qint64 firstSample = -1;
+	QAtomicInt ref;
+	FramePoolPrivate* pool;
+};
+
+/* State shared between a pool and all of its outstanding frames.
+ * The reference count includes the pool itself and each slot that
+ * has been acquired but not yet released.
+ */
+struct FramePoolPrivate {
+	FramePoolPrivate(int cap) :
+		capacity(cap),
+		closed(false),
+		allocations(0),
+		ref(1)
+	{
+		free.reserve(capacity);
+	}
+
+	~FramePoolPrivate()
+	{
+		qDeleteAll(free);
+	}
+
+	void release(FramePoolSlot* slot)
+	{
+		{
+			QMutexLocker lock(&mutex);
+			if (closed || (free.size() >= capacity)) {
+				delete slot;
+			} else {
+				free.append(slot);
+			}
+		}
+		deref();
+	}
+
+	void deref()
+	{
+		if (!ref.deref())
+			delete this;
+	}
+
+	mutable QMutex mutex;
+	QVector<FramePoolSlot*> free;
+	int capacity;
+	bool closed;
+	quint64 allocations;
+	QAtomicInt ref;
+};
+
+PooledFrame::PooledFrame() :
+	m_slot(nullptr)
+{
+}
+
+PooledFrame::PooledFrame(FramePoolSlot* slot) :
+	m_slot(slot)
+{
+}
+
+PooledFrame::PooledFrame(const PooledFrame& other) :
+	m_slot(other.m_slot)
+{
+	if (m_slot)
+		m_slot->ref.ref();
+}
+
+PooledFrame::PooledFrame(PooledFrame&& other) :
+	m_slot(other.m_slot)
+{
+	other.m_slot = nullptr;
+}
+
+PooledFrame& PooledFrame::operator=(PooledFrame other)
+{
+	swap(other);
+	return *this;
+}
+
+PooledFrame::~PooledFrame()
+{
+	reset();
+}
+
+void PooledFrame::reset()
+{
+	if (m_slot && !m_slot->ref.deref())
+		m_slot->pool->release(m_slot);
+	m_slot = nullptr;
+}
+
+bool PooledFrame::isNull() const
+{
+	return m_slot == nullptr;
+}
+
+int PooledFrame::useCount() const
+{
+	return m_slot ? m_slot->ref.load() : 0;
+}
+
+const DataFrame& PooledFrame::frame() const
+{
+	Q_ASSERT(m_slot);
+	return m_slot->frame;
+}
+
+DataFrame& PooledFrame::frame()
+{
+	Q_ASSERT(m_slot);
+	return m_slot->frame;
+}
+
+bool PooledFrame::hasFloatData() const
+{
+	return m_slot && !m_slot->floatData.is_empty();
+}
+
+const arma::fmat& PooledFrame::floatData() const
+{
+	Q_ASSERT(m_slot);
+	return m_slot->floatData;
+}
+
+arma::fmat& PooledFrame::floatData()
+{
+	Q_ASSERT(m_slot);
+	return m_slot->floatData;
+}
+
+bool PooledFrame::hasSampleMajorData() const
+{
+	return m_slot && !m_slot->sampleMajorData.is_empty();
+}
+
+const DataFrame::Samples& PooledFrame::sampleMajorData() const
+{
+	Q_ASSERT(m_slot);
+	return m_slot->sampleMajorData;
+}
+
+DataFrame::Samples& PooledFrame::sampleMajorData()
+{
+	Q_ASSERT(m_slot);
+	return m_slot->sampleMajorData;
+}
+
+bool PooledFrame::hasSampleIndex() const
+{
+	return m_slot && (m_slot->firstSample >= 0);
+}
+
+qint64 PooledFrame::firstSample() const
+{
+	return m_slot ? m_slot->firstSample : -1;
+}
+
+qint64 PooledFrame::stopSample() const
+{
+	return hasSampleIndex() ?
+		m_slot->firstSample + static_cast<qint64>(m_slot->frame.nsamples()) : -1;
+}
+
+void PooledFrame::setFirstSample(qint64 index)
+{
+	Q_ASSERT(m_slot);
+	m_slot->firstSample = qMax<qint64>(index, -1);
+}
+
+void PooledFrame::swap(PooledFrame& other)
+{
+	std::swap(m_slot, other.m_slot);
+}
+
+FramePool::FramePool(int capacity) :
+	d(new FramePoolPrivate(qMax(capacity, 0)))
+{
+}
+
+FramePool::~FramePool()
+{
+	{
+		QMutexLocker lock(&d->mutex);
+		d->closed = true;
+		qDeleteAll(d->free);
+		d->free.clear();
+	}
+	d->deref();
+}
+
+PooledFrame FramePool::acquire(float start, float stop,
+		arma::uword nsamples, arma::uword nchannels, int extra)
+{
+	FramePoolSlot* slot = nullptr;
+	{
+		QMutexLocker lock(&d->mutex);
+		if (!d->free.isEmpty())
+			slot = d->free.takeLast();
+	}
+	quint64 allocations = 0;
+	if (!slot) {
+		slot = new FramePoolSlot(d);
+		allocations++;
+	}
+	d->ref.ref();
+	slot->ref.store(1);
+
+	/* Move the existing storage into the new frame, so that it is
+	 * only reallocated if the requested shape differs.
+	 */
+	auto& samples = slot->frame.data();
+	allocations += resize(samples, nsamples, nchannels);
+	slot->frame = DataFrame(start, stop, std::move(samples));
+	slot->firstSample = -1;
+	allocations += provide(extra & FloatStorage, slot->floatData,
+			slot->spareFloatData, nsamples, nchannels);
+	allocations += provide(extra & SampleMajorStorage, slot->sampleMajorData,
+			slot->spareSampleMajorData, nchannels, nsamples);
+	if (allocations > 0) {
+		QMutexLocker lock(&d->mutex);
+		d->allocations += allocations;
+	}
+	return PooledFrame(slot);
+}
+
+int FramePool::capacity() const
+{
+	QMutexLocker lock(&d->mutex);
+	return d->capacity;
+}
+
+void FramePool::setCapacity(int capacity)
+{
+	QMutexLocker lock(&d->mutex);
+	d->capacity = qMax(capacity, 0);
+	d->free.reserve(d->capacity);
+	while (d->free.size() > d->capacity)
+		delete d->free.takeLast();
+}
+
+int FramePool::idleCount() const
+{
+	QMutexLocker lock(&d->mutex);
+	return d->free.size();
+}
+
+quint64 FramePool::allocationCount() const
+{
+	QMutexLocker lock(&d->mutex);
+	return d->allocations;
+}
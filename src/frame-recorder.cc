@@ -0,0 +1,340 @@
+/*! \file frame-recorder.cc
+ *
+ * Implementation of the FrameRecorder and RecordingReader classes.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#include "frame-recorder.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+/* Identifies an index file, and the version of its format. */
+const char IndexMagic[8] = { 'B', 'L', 'D', 'S', 'I', 'D', 'X', '\0' };
+const quint32 IndexVersion = 1;
+
+using Sample = DataFrame::Samples::elem_type;
+
+/* Return the size of the samples of an indexed frame, in bytes. */
+qint64 entryBytes(const FrameRecorder::IndexEntry& entry)
+{
+	return static_cast<qint64>(entry.nsamples) * entry.nchannels * sizeof(Sample);
+}
+
+} // end anonymous namespace
+
+FrameRecorder::FrameRecorder(const QString& path, qint64 segmentSize) :
+	m_path(path),
+	m_segmentSize(qMax<qint64>(segmentSize, 1)),
+	m_offset(0),
+	m_frameCount(0)
+{
+}
+
+FrameRecorder::~FrameRecorder()
+{
+	close();
+}
+
+QString FrameRecorder::indexPath(const QString& path)
+{
+	return path + ".index";
+}
+
+QString FrameRecorder::path() const
+{
+	return m_path;
+}
+
+bool FrameRecorder::open()
+{
+	close();
+	m_offset.store(0);
+	m_frameCount.store(0);
+	m_nchannels = 0;
+
+	/* The data file must be readable as well, to be mapped shared. */
+	m_data.setFileName(m_path);
+	if (!m_data.open(QIODevice::ReadWrite | QIODevice::Truncate))
+		return fail("Could not open recording: " + m_data.errorString());
+	m_index.setFileName(indexPath(m_path));
+	if (!m_index.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered))
+		return fail("Could not open recording index: " + m_index.errorString());
+
+	IndexHeader header;
+	std::memcpy(header.magic, IndexMagic, sizeof(header.magic));
+	header.version = IndexVersion;
+	header.sampleSize = sizeof(Sample);
+	if (m_index.write(reinterpret_cast<const char*>(&header), sizeof(header)) !=
+			static_cast<qint64>(sizeof(header))) {
+		return fail("Could not write recording index: " + m_index.errorString());
+	}
+	m_error.clear();
+	return true;
+}
+
+void FrameRecorder::close()
+{
+	if (m_segment) {
+		m_data.unmap(m_segment);
+		m_segment = nullptr;
+	}
+	m_segmentOffset = 0;
+	m_segmentLength = 0;
+	if (m_data.isOpen()) {
+		m_data.resize(m_offset.load()); // drop the unused part of the last segment
+		m_data.close();
+	}
+	if (m_index.isOpen())
+		m_index.close();
+}
+
+bool FrameRecorder::isOpen() const
+{
+	return m_data.isOpen() && m_index.isOpen();
+}
+
+QString FrameRecorder::errorString() const
+{
+	return m_error;
+}
+
+bool FrameRecorder::append(const DataFrame& frame)
+{
+	if (!isOpen())
+		return false;
+
+	/* Frames are read back with the layout of the first, so a frame
+	 * with different channels is rejected, leaving the recording open.
+	 */
+	const quint32 nchannels = static_cast<quint32>(frame.nchannels());
+	if (m_frameCount.load() == 0) {
+		m_nchannels = nchannels;
+	} else if (nchannels != m_nchannels) {
+		m_error = QString("Frame has %1 channels, but the recording has %2").arg(
+				nchannels).arg(m_nchannels);
+		return false;
+	}
+
+	const qint64 nbytes = static_cast<qint64>(frame.data().n_elem) * sizeof(Sample);
+	const qint64 offset = m_offset.load();
+	if (nbytes > 0) {
+		if ( (offset + nbytes > m_segmentOffset + m_segmentLength) &&
+				!mapSegment(nbytes) ) {
+			return false;
+		}
+		std::memcpy(m_segment + (offset - m_segmentOffset),
+				frame.data().memptr(), nbytes);
+	}
+
+	/* The entry is written after the samples, so that a concurrent
+	 * reader never sees an entry for a frame not yet written.
+	 */
+	IndexEntry entry;
+	entry.start = frame.start();
+	entry.stop = frame.stop();
+	entry.nsamples = frame.nsamples();
+	entry.nchannels = nchannels;
+	entry.offset = offset;
+	if (m_index.write(reinterpret_cast<const char*>(&entry), sizeof(entry)) !=
+			static_cast<qint64>(sizeof(entry))) {
+		return fail("Could not write recording index: " + m_index.errorString());
+	}
+	m_offset.store(offset + nbytes);
+	m_frameCount.fetchAndAddRelaxed(1);
+	return true;
+}
+
+int FrameRecorder::frameCount() const
+{
+	return m_frameCount.load();
+}
+
+qint64 FrameRecorder::bytesWritten() const
+{
+	return m_offset.load();
+}
+
+bool FrameRecorder::mapSegment(qint64 minBytes)
+{
+	if (m_segment) {
+		m_data.unmap(m_segment);
+		m_segment = nullptr;
+	}
+	const qint64 offset = m_offset.load();
+	const qint64 length = qMax(m_segmentSize, minBytes);
+	if (!m_data.resize(offset + length))
+		return fail("Could not grow recording: " + m_data.errorString());
+	m_segment = m_data.map(offset, length);
+	if (!m_segment)
+		return fail("Could not map recording: " + m_data.errorString());
+	m_segmentOffset = offset;
+	m_segmentLength = length;
+	return true;
+}
+
+bool FrameRecorder::fail(const QString& msg)
+{
+	m_error = msg;
+	close();
+	return false;
+}
+
+RecordingReader::RecordingReader(const QString& path) :
+	m_data(path),
+	m_index(FrameRecorder::indexPath(path))
+{
+}
+
+RecordingReader::~RecordingReader()
+{
+	close();
+}
+
+bool RecordingReader::open()
+{
+	close();
+	if (!m_data.open(QIODevice::ReadOnly)) {
+		m_error = "Could not open recording: " + m_data.errorString();
+		return false;
+	}
+	if (!m_index.open(QIODevice::ReadOnly)) {
+		m_error = "Could not open recording index: " + m_index.errorString();
+		close();
+		return false;
+	}
+
+	FrameRecorder::IndexHeader header;
+	if ( (m_index.read(reinterpret_cast<char*>(&header), sizeof(header)) !=
+				static_cast<qint64>(sizeof(header))) ||
+			(std::memcmp(header.magic, IndexMagic, sizeof(header.magic)) != 0) ||
+			(header.version != IndexVersion) ||
+			(header.sampleSize != static_cast<quint32>(sizeof(Sample))) ) {
+		m_error = "Invalid recording index";
+		close();
+		return false;
+	}
+	if (!refresh()) {
+		close();
+		return false;
+	}
+	m_error.clear();
+	return true;
+}
+
+void RecordingReader::close()
+{
+	if (m_mapping) {
+		m_data.unmap(m_mapping);
+		m_mapping = nullptr;
+	}
+	m_mappingLength = 0;
+	m_entries.clear();
+	if (m_data.isOpen())
+		m_data.close();
+	if (m_index.isOpen())
+		m_index.close();
+}
+
+bool RecordingReader::isOpen() const
+{
+	return m_data.isOpen() && m_index.isOpen();
+}
+
+QString RecordingReader::errorString() const
+{
+	return m_error;
+}
+
+bool RecordingReader::refresh()
+{
+	if (!isOpen())
+		return false;
+
+	/* Read only whole entries, as the last may be partially written. */
+	const qint64 available = m_index.size() - m_index.pos();
+	const int count = static_cast<int>(available /
+			static_cast<qint64>(sizeof(FrameRecorder::IndexEntry)));
+	if (count > 0) {
+		const int oldCount = m_entries.size();
+		m_entries.resize(oldCount + count);
+		const qint64 nbytes = static_cast<qint64>(count) *
+			static_cast<qint64>(sizeof(FrameRecorder::IndexEntry));
+		if (m_index.read(reinterpret_cast<char*>(m_entries.data() + oldCount),
+					nbytes) != nbytes) {
+			m_entries.resize(oldCount);
+			m_error = "Could not read recording index: " + m_index.errorString();
+			return false;
+		}
+	}
+	return mapData();
+}
+
+bool RecordingReader::mapData()
+{
+	if (m_entries.isEmpty())
+		return true;
+	const auto& last = m_entries.last();
+	const qint64 required = last.offset + entryBytes(last);
+	if (required <= m_mappingLength)
+		return true;
+
+	if (m_mapping) {
+		m_data.unmap(m_mapping);
+		m_mapping = nullptr;
+		m_mappingLength = 0;
+	}
+	const qint64 length = m_data.size();
+	if (length < required) {
+		m_error = "Recording is shorter than its index";
+		return false;
+	}
+	m_mapping = m_data.map(0, length);
+	if (!m_mapping) {
+		m_error = "Could not map recording: " + m_data.errorString();
+		return false;
+	}
+	m_mappingLength = length;
+	return true;
+}
+
+int RecordingReader::frameCount() const
+{
+	return m_entries.size();
+}
+
+const FrameRecorder::IndexEntry& RecordingReader::entry(int index) const
+{
+	return m_entries.at(index);
+}
+
+int RecordingReader::findFrame(float time) const
+{
+	/* Frames are appended in order, so search by start time. */
+	auto it = std::upper_bound(m_entries.begin(), m_entries.end(), time,
+			[](float t, const FrameRecorder::IndexEntry& entry) -> bool {
+				return t < entry.start;
+			});
+	if (it == m_entries.begin())
+		return -1;
+	--it;
+	return (time < it->stop) ? static_cast<int>(it - m_entries.begin()) : -1;
+}
+
+const DataFrame::Samples::elem_type* RecordingReader::samples(int index) const
+{
+	return reinterpret_cast<const Sample*>(m_mapping + m_entries.at(index).offset);
+}
+
+DataFrame RecordingReader::frame(int index) const
+{
+	const auto& e = m_entries.at(index);
+	DataFrame::Samples data(e.nsamples, e.nchannels);
+	if (data.n_elem > 0)
+		std::memcpy(data.memptr(), samples(index), entryBytes(e));
+	return DataFrame(e.start, e.stop, std::move(data));
+}
+
@@ -0,0 +1,159 @@
+/*! \file preprocessor.cc
+ *
+ * Implementation of the Preprocessor class.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#include "preprocessor.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+/* Relative change in the sample rate beyond which the filter sections
+ * are redesigned. Rates estimated from the single-precision times of
+ * frames differ slightly from frame to frame, but by far less.
+ */
+const double RateTolerance = 1e-3;
+
+} // end anonymous namespace
+
+Preprocessor::Preprocessor(const Settings& settings) :
+	m_settings(settings)
+{
+}
+
+const Preprocessor::Settings& Preprocessor::settings() const
+{
+	return m_settings;
+}
+
+void Preprocessor::setSettings(const Settings& settings)
+{
+	m_settings = settings;
+	m_sampleRate = 0.;
+	reset();
+}
+
+bool Preprocessor::isEnabled() const
+{
+	return (m_settings.reference != NoReference) ||
+		(m_settings.lowCutoff > 0) || (m_settings.highCutoff > 0);
+}
+
+void Preprocessor::reset()
+{
+	m_state.fill(0.);
+}
+
+void Preprocessor::process(arma::fmat& samples, float sampleRate)
+{
+	if (samples.is_empty())
+		return;
+	if (m_settings.reference != NoReference)
+		subtractReference(samples);
+
+	if ( (m_sampleRate <= 0) ||
+			(std::fabs(sampleRate - m_sampleRate) > RateTolerance * m_sampleRate) ) {
+		design(sampleRate);
+	}
+	if (m_sections.isEmpty())
+		return;
+	const int stateSize = 2 * m_sections.size() * samples.n_cols;
+	if ( (samples.n_cols != m_nchannels) || (m_state.size() != stateSize) ) {
+		m_nchannels = samples.n_cols;
+		m_state.fill(0., stateSize);
+	}
+	for (arma::uword c = 0; c < samples.n_cols; c++) {
+		filter(samples.colptr(c), samples.n_rows,
+				m_state.data() + 2 * m_sections.size() * c);
+	}
+}
+
+void Preprocessor::subtractReference(arma::fmat& samples)
+{
+	const auto nsamples = samples.n_rows;
+	const auto nchannels = samples.n_cols;
+	m_reference.fill(0., nsamples);
+	float* reference = m_reference.data();
+
+	if (m_settings.reference == MeanReference) {
+		/* Accumulate whole channels, so that each pass is contiguous. */
+		for (arma::uword c = 0; c < nchannels; c++) {
+			const float* column = samples.colptr(c);
+			for (arma::uword i = 0; i < nsamples; i++)
+				reference[i] += column[i];
+		}
+		const float scale = 1.f / nchannels;
+		for (arma::uword i = 0; i < nsamples; i++)
+			reference[i] *= scale;
+	} else {
+		m_scratch.resize(nchannels);
+		for (arma::uword i = 0; i < nsamples; i++) {
+			for (arma::uword c = 0; c < nchannels; c++)
+				m_scratch[c] = samples.colptr(c)[i];
+			auto middle = m_scratch.begin() + nchannels / 2;
+			std::nth_element(m_scratch.begin(), middle, m_scratch.end());
+			reference[i] = *middle;
+		}
+	}
+
+	for (arma::uword c = 0; c < nchannels; c++) {
+		float* column = samples.colptr(c);
+		for (arma::uword i = 0; i < nsamples; i++)
+			column[i] -= reference[i];
+	}
+}
+
+void Preprocessor::design(float sampleRate)
+{
+	/* Butterworth sections, from the bilinear transform of the
+	 * analog prototypes with Q = 1 / sqrt(2).
+	 */
+	m_sampleRate = sampleRate;
+	m_sections.clear();
+	const double nyquist = 0.5 * sampleRate;
+	const double q = 1. / std::sqrt(2.);
+	if ( (m_settings.lowCutoff > 0) && (m_settings.lowCutoff < nyquist) ) {
+		const double w = 2 * M_PI * m_settings.lowCutoff / sampleRate;
+		const double alpha = std::sin(w) / (2 * q), cosw = std::cos(w);
+		const double a0 = 1 + alpha;
+		m_sections.append({
+				static_cast<float>((1 + cosw) / 2 / a0),
+				static_cast<float>(-(1 + cosw) / a0),
+				static_cast<float>((1 + cosw) / 2 / a0),
+				static_cast<float>(-2 * cosw / a0),
+				static_cast<float>((1 - alpha) / a0) });
+	}
+	if ( (m_settings.highCutoff > 0) && (m_settings.highCutoff < nyquist) ) {
+		const double w = 2 * M_PI * m_settings.highCutoff / sampleRate;
+		const double alpha = std::sin(w) / (2 * q), cosw = std::cos(w);
+		const double a0 = 1 + alpha;
+		m_sections.append({
+				static_cast<float>((1 - cosw) / 2 / a0),
+				static_cast<float>((1 - cosw) / a0),
+				static_cast<float>((1 - cosw) / 2 / a0),
+				static_cast<float>(-2 * cosw / a0),
+				static_cast<float>((1 - alpha) / a0) });
+	}
+}
+
+void Preprocessor::filter(float* samples, arma::uword nsamples, float* state)
+{
+	/* Transposed direct form II, one section at a time. */
+	for (const auto& s : m_sections) {
+		float z1 = state[0], z2 = state[1];
+		for (arma::uword i = 0; i < nsamples; i++) {
+			const float x = samples[i];
+			const float y = s.b0 * x + z1;
+			z1 = s.b1 * x - s.a1 * y + z2;
+			z2 = s.b2 * x - s.a2 * y;
+			samples[i] = y;
+		}
+		state[0] = z1;
+		state[1] = z2;
+		state += 2;
+	}
+}
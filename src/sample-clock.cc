@@ -0,0 +1,65 @@
+/*! \file sample-clock.cc
+ *
+ * Implementation of the SampleClock class.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#include "sample-clock.h"
+
+#include <cmath>
+#include <limits>
+
+SampleClock::SampleClock(double rate) :
+	m_rate(qMax(rate, 0.))
+{
+}
+
+bool SampleClock::isValid() const
+{
+	return m_rate > 0;
+}
+
+double SampleClock::rate() const
+{
+	return m_rate;
+}
+
+void SampleClock::setRate(double rate)
+{
+	m_rate = qMax(rate, 0.);
+}
+
+qint64 SampleClock::toSample(double seconds) const
+{
+	if (!isValid())
+		return -1;
+	return std::llround(seconds * m_rate);
+}
+
+double SampleClock::toSeconds(qint64 index) const
+{
+	return isValid() ? index / m_rate : 0.;
+}
+
+double SampleClock::tolerance(float seconds) const
+{
+	/* Half a sample, plus the spacing of floats around the time, in
+	 * which the BLDS rounded the exact time of the sample.
+	 */
+	const float magnitude = std::abs(seconds);
+	const float ulp = std::nextafter(magnitude, std::numeric_limits<float>::infinity()) -
+		magnitude;
+	return 0.5 + ulp * m_rate;
+}
+
+qint64 SampleClock::resolve(float start, qint64 expected) const
+{
+	if (!isValid())
+		return -1;
+	const double exact = start * m_rate;
+	if ( (expected >= 0) && (std::abs(exact - expected) <= tolerance(start)) )
+		return expected;
+	return qMax<qint64>(std::llround(exact), 0);
+}
+
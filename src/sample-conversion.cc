@@ -0,0 +1,201 @@
+/*! \file sample-conversion.cc
+ *
+ * Implementation of the sample conversion kernels.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#include "sample-conversion.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#  define BLDS_CLIENT_HAVE_SSE2
+#  include <emmintrin.h>
+#  if defined(__GNUC__) && defined(__x86_64__)
+#    define BLDS_CLIENT_HAVE_AVX2
+#    include <immintrin.h>
+#  endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  define BLDS_CLIENT_HAVE_NEON
+#  include <arm_neon.h>
+#endif
+
+namespace conversion {
+
+namespace {
+
+typedef void (*Kernel)(const qint16*, float*, std::size_t, float, float);
+
+void convertScalar(const qint16* input, float* output,
+		std::size_t count, float gain, float offset)
+{
+	for (std::size_t i = 0; i < count; i++)
+		output[i] = gain * input[i] + offset;
+}
+
+#ifdef BLDS_CLIENT_HAVE_SSE2
+void convertSse2(const qint16* input, float* output,
+		std::size_t count, float gain, float offset)
+{
+	const __m128 g = _mm_set1_ps(gain);
+	const __m128 o = _mm_set1_ps(offset);
+	std::size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		/* Sign-extend by unpacking each sample into the high half of a
+		 * 32-bit lane, then shifting it back down arithmetically.
+		 */
+		__m128i raw = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(raw, raw), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(raw, raw), 16);
+		_mm_storeu_ps(output + i, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(lo), g), o));
+		_mm_storeu_ps(output + i + 4, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(hi), g), o));
+	}
+	convertScalar(input + i, output + i, count - i, gain, offset);
+}
+#endif
+
+#ifdef BLDS_CLIENT_HAVE_AVX2
+__attribute__((target("avx2")))
+void convertAvx2(const qint16* input, float* output,
+		std::size_t count, float gain, float offset)
+{
+	const __m256 g = _mm256_set1_ps(gain);
+	const __m256 o = _mm256_set1_ps(offset);
+	std::size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m256i lo = _mm256_cvtepi16_epi32(
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i)));
+		__m256i hi = _mm256_cvtepi16_epi32(
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i + 8)));
+		_mm256_storeu_ps(output + i,
+				_mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(lo), g), o));
+		_mm256_storeu_ps(output + i + 8,
+				_mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(hi), g), o));
+	}
+	convertSse2(input + i, output + i, count - i, gain, offset);
+}
+#endif
+
+#ifdef BLDS_CLIENT_HAVE_NEON
+void convertNeon(const qint16* input, float* output,
+		std::size_t count, float gain, float offset)
+{
+	const float32x4_t o = vdupq_n_f32(offset);
+	std::size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		int16x8_t raw = vld1q_s16(input + i);
+		float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(raw)));
+		float32x4_t hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(raw)));
+		vst1q_f32(output + i, vmlaq_n_f32(o, lo, gain));
+		vst1q_f32(output + i + 4, vmlaq_n_f32(o, hi, gain));
+	}
+	convertScalar(input + i, output + i, count - i, gain, offset);
+}
+#endif
+
+struct KernelChoice {
+	Kernel kernel;
+	const char* name;
+};
+
+KernelChoice chooseKernel()
+{
+#if defined(BLDS_CLIENT_HAVE_AVX2)
+	if (__builtin_cpu_supports("avx2"))
+		return { convertAvx2, "avx2" };
+#endif
+#if defined(BLDS_CLIENT_HAVE_SSE2)
+	return { convertSse2, "sse2" };
+#elif defined(BLDS_CLIENT_HAVE_NEON)
+	return { convertNeon, "neon" };
+#else
+	return { convertScalar, "scalar" };
+#endif
+}
+
+const KernelChoice& kernel()
+{
+	static const KernelChoice choice = chooseKernel();
+	return choice;
+}
+
+} // end anonymous namespace
+
+void convert(const qint16* input, float* output,
+		std::size_t count, float gain, float offset)
+{
+	kernel().kernel(input, output, count, gain, offset);
+}
+
+const char* kernelName()
+{
+	return kernel().name;
+}
+
+void transpose(const qint16* input, qint16* output,
+		std::size_t nsamples, std::size_t nchannels,
+		std::size_t first, std::size_t count)
+{
+	/* A block of 32 x 32 samples occupies 2 KiB in each layout. */
+	const std::size_t block = 32;
+	const std::size_t last = first + count;
+	for (std::size_t s0 = 0; s0 < nsamples; s0 += block) {
+		const std::size_t s1 = qMin(s0 + block, nsamples);
+		for (std::size_t c0 = first; c0 < last; c0 += block) {
+			const std::size_t c1 = qMin(c0 + block, last);
+			for (std::size_t c = c0; c < c1; c++) {
+				const qint16* in = input + c * nsamples;
+				for (std::size_t s = s0; s < s1; s++)
+					output[s * nchannels + c] = in[s];
+			}
+		}
+	}
+}
+
+void minMax(const qint16* input, std::size_t count, qint16& min, qint16& max)
+{
+	std::size_t i = 0;
+#if defined(BLDS_CLIENT_HAVE_SSE2)
+	if (count >= 8) {
+		__m128i lo = _mm_set1_epi16(min);
+		__m128i hi = _mm_set1_epi16(max);
+		for (; i + 8 <= count; i += 8) {
+			__m128i raw = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+			lo = _mm_min_epi16(lo, raw);
+			hi = _mm_max_epi16(hi, raw);
+		}
+		/* Reduce across lanes by folding the registers in half. */
+		lo = _mm_min_epi16(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(1, 0, 3, 2)));
+		lo = _mm_min_epi16(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 3, 0, 1)));
+		lo = _mm_min_epi16(lo, _mm_srli_epi32(lo, 16));
+		hi = _mm_max_epi16(hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(1, 0, 3, 2)));
+		hi = _mm_max_epi16(hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(2, 3, 0, 1)));
+		hi = _mm_max_epi16(hi, _mm_srli_epi32(hi, 16));
+		min = static_cast<qint16>(_mm_cvtsi128_si32(lo));
+		max = static_cast<qint16>(_mm_cvtsi128_si32(hi));
+	}
+#elif defined(BLDS_CLIENT_HAVE_NEON)
+	if (count >= 8) {
+		int16x8_t lo = vdupq_n_s16(min);
+		int16x8_t hi = vdupq_n_s16(max);
+		for (; i + 8 <= count; i += 8) {
+			int16x8_t raw = vld1q_s16(input + i);
+			lo = vminq_s16(lo, raw);
+			hi = vmaxq_s16(hi, raw);
+		}
+		int16x4_t l = vpmin_s16(vget_low_s16(lo), vget_high_s16(lo));
+		int16x4_t h = vpmax_s16(vget_low_s16(hi), vget_high_s16(hi));
+		l = vpmin_s16(l, l);
+		h = vpmax_s16(h, h);
+		l = vpmin_s16(l, l);
+		h = vpmax_s16(h, h);
+		min = vget_lane_s16(l, 0);
+		max = vget_lane_s16(h, 0);
+	}
+#endif
+	for (; i < count; i++) {
+		min = qMin(min, input[i]);
+		max = qMax(max, input[i]);
+	}
+}
+
+} // end conversion namespace
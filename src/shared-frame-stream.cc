@@ -0,0 +1,117 @@
+/*! \file shared-frame-stream.cc
+ *
+ * Implementation of the SharedFrameStream class.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#include "shared-frame-stream.h"
+
+SharedFrameStream::SharedFrameStream(BldsClient* client, QObject* parent) :
+	QObject(parent),
+	m_client(client)
+{
+	QObject::connect(m_client, &BldsClient::streamedFrameReceived,
+			this, &SharedFrameStream::handleFrame, Qt::DirectConnection);
+}
+
+SharedFrameStream::~SharedFrameStream()
+{
+	/* Stop receiving frames before the subscribers are released. */
+	QObject::disconnect(m_client, &BldsClient::streamedFrameReceived,
+			this, &SharedFrameStream::handleFrame);
+	QMutexLocker lock(&m_lock);
+	for (const auto& subscriber : m_subscribers) {
+		auto ring = subscriber.toStrongRef();
+		if (ring)
+			ring->close();
+	}
+	m_subscribers.clear();
+	if (m_requested) {
+		m_client->requestAllData(false);
+		m_requested = false;
+	}
+}
+
+BldsClient* SharedFrameStream::client() const
+{
+	return m_client;
+}
+
+QSharedPointer<FrameRing> SharedFrameStream::subscribe(int depth,
+		FrameRing::OverflowPolicy policy)
+{
+	/* A blocked subscriber would stall the client, and so every other. */
+	if (policy == FrameRing::Block)
+		return QSharedPointer<FrameRing>();
+	auto ring = QSharedPointer<FrameRing>::create(qMax(depth, 1), policy);
+	QMutexLocker lock(&m_lock);
+	pruneSubscribers();
+	m_subscribers.append(ring);
+	if (!m_requested) {
+		m_client->requestAllData(true);
+		m_requested = true;
+	}
+	return ring;
+}
+
+void SharedFrameStream::unsubscribe(const QSharedPointer<FrameRing>& ring)
+{
+	if (!ring)
+		return;
+	ring->close();
+	QMutexLocker lock(&m_lock);
+	for (int i = 0; i < m_subscribers.size(); i++) {
+		if (m_subscribers.at(i).toStrongRef() == ring) {
+			m_subscribers.remove(i);
+			break;
+		}
+	}
+	pruneSubscribers();
+}
+
+int SharedFrameStream::subscriberCount() const
+{
+	QMutexLocker lock(&m_lock);
+	int count = 0;
+	for (const auto& subscriber : m_subscribers) {
+		if (!subscriber.isNull())
+			count++;
+	}
+	return count;
+}
+
+void SharedFrameStream::handleFrame(const PooledFrame& frame)
+{
+	/* Push outside the lock, so that subscribing never waits on the
+	 * pushes. Each subscriber shares the same decoded frame.
+	 */
+	{
+		QMutexLocker lock(&m_lock);
+		bool released = false;
+		for (const auto& subscriber : m_subscribers) {
+			auto ring = subscriber.toStrongRef();
+			if (ring)
+				m_rings.append(ring);
+			else
+				released = true;
+		}
+		if (released)
+			pruneSubscribers();
+	}
+	for (const auto& ring : m_rings)
+		ring->push(frame);
+	m_rings.clear(); // keeps its capacity, but releases the rings
+}
+
+void SharedFrameStream::pruneSubscribers()
+{
+	for (int i = m_subscribers.size() - 1; i >= 0; i--) {
+		if (m_subscribers.at(i).isNull())
+			m_subscribers.remove(i);
+	}
+	if (m_subscribers.isEmpty() && m_requested) {
+		m_client->requestAllData(false);
+		m_requested = false;
+	}
+}
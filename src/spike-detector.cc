@@ -0,0 +1,146 @@
+/*! \file spike-detector.cc
+ *
+ * Implementation of the SpikeDetector class.
+ *
+ * (C) 2017 Benjamin Naecker bnaecker@stanford.edu
+ */
+
+#include "spike-detector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+SpikeDetector::SpikeDetector(const Settings& settings) :
+	m_settings(settings)
+{
+}
+
+const SpikeDetector::Settings& SpikeDetector::settings() const
+{
+	return m_settings;
+}
+
+void SpikeDetector::setSettings(const Settings& settings)
+{
+	m_settings = settings;
+	m_settings.preSamples = qMax(m_settings.preSamples, 0);
+	m_settings.postSamples = qMax(m_settings.postSamples, 1);
+	reset();
+}
+
+void SpikeDetector::reset()
+{
+	m_channels.clear();
+	m_noise.clear();
+	m_nextSample = 0;
+}
+
+const QVector<float>& SpikeDetector::noise() const
+{
+	return m_noise;
+}
+
+float SpikeDetector::estimateNoise(const float* samples, arma::uword nsamples)
+{
+	/* The median absolute value of Gaussian noise is 0.6745 sigma. */
+	m_magnitudes.resize(nsamples);
+	for (arma::uword i = 0; i < nsamples; i++)
+		m_magnitudes[i] = std::fabs(samples[i]);
+	auto middle = m_magnitudes.begin() + nsamples / 2;
+	std::nth_element(m_magnitudes.begin(), middle, m_magnitudes.end());
+	return *middle / 0.6745f;
+}
+
+void SpikeDetector::detect(const arma::fmat& samples, float start, float stop,
+		SpikeBatch& batch)
+{
+	batch.start = start;
+	batch.stop = stop;
+	batch.events.clear();
+	batch.snippets.clear();
+	batch.snippetLength = m_settings.snippets ?
+		(m_settings.preSamples + m_settings.postSamples) : 0;
+
+	const auto nsamples = samples.n_rows;
+	const auto nchannels = samples.n_cols;
+	if (nsamples == 0)
+		return;
+	if (m_channels.size() != static_cast<int>(nchannels)) {
+		m_channels = QVector<Channel>(nchannels);
+		m_noise.fill(0., nchannels);
+	}
+
+	const int pre = m_settings.preSamples;
+	const int post = m_settings.postSamples;
+	const int keep = pre + post;
+	const double period = (static_cast<double>(stop) - start) / nsamples;
+	const bool negative = (m_settings.polarity != Positive);
+	const bool positive = (m_settings.polarity != Negative);
+
+	for (arma::uword c = 0; c < nchannels; c++) {
+		auto& channel = m_channels[c];
+		const float* column = samples.colptr(c);
+
+		/* Update the smoothed noise estimate. */
+		auto estimate = estimateNoise(column, nsamples);
+		channel.noise = (channel.noise > 0) ?
+			(1 - m_settings.noiseAdaptation) * channel.noise +
+				m_settings.noiseAdaptation * estimate :
+			estimate;
+		m_noise[c] = channel.noise;
+		const float threshold = m_settings.threshold * channel.noise;
+
+		/* Search the retained samples followed by the frame, skipping any
+		 * searched with the previous frame, and those too close to the
+		 * end for a complete snippet, which are searched with the next.
+		 */
+		const int carried = channel.carry.size();
+		const int total = carried + nsamples;
+		m_signal.resize(total);
+		if (carried > 0)
+			std::memcpy(m_signal.data(), channel.carry.constData(), carried * sizeof(float));
+		std::memcpy(m_signal.data() + carried, column, nsamples * sizeof(float));
+		const float* signal = m_signal.constData();
+		const qint64 firstSample = static_cast<qint64>(m_nextSample) - carried;
+
+		for (int i = qMax(qMax(pre, carried - post), 1); i < total - post; i++) {
+			const bool below = negative && (signal[i] < -threshold) &&
+				(signal[i - 1] >= -threshold);
+			const bool above = positive && (signal[i] > threshold) &&
+				(signal[i - 1] <= threshold);
+			if (!(below || above) || (threshold <= 0))
+				continue;
+			const qint64 index = firstSample + i;
+			if ( (channel.lastEvent >= 0) &&
+					(index - channel.lastEvent < m_settings.refractorySamples) ) {
+				continue;
+			}
+			channel.lastEvent = index;
+
+			float amplitude = signal[i];
+			for (int j = i; j < i + post; j++) {
+				if (below ? (signal[j] < amplitude) : (signal[j] > amplitude))
+					amplitude = signal[j];
+			}
+
+			SpikeEvent event;
+			event.channel = c;
+			event.sample = index;
+			event.time = start + (i - carried) * period;
+			event.amplitude = amplitude;
+			batch.events.append(event);
+			if (m_settings.snippets) {
+				for (int j = i - pre; j < i + post; j++)
+					batch.snippets.append(signal[j]);
+			}
+		}
+
+		/* Retain the end of the signal for the next frame. */
+		const int retained = qMin(keep, total);
+		channel.carry.resize(retained);
+		std::memcpy(channel.carry.data(), signal + total - retained,
+				retained * sizeof(float));
+	}
+	m_nextSample += nsamples;
+}
@@ -1,4 +1,117 @@
 #include "test-libblds-client.h"
+#include "envelope-stream.h"
+#include "sample-conversion.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+/* Frame a message as the BLDS does, prefixed with its 32-bit length. */
+QByteArray bldsMessage(const QByteArray& type, const QByteArray& body = QByteArray())
+{
+	const QByteArray message = type + "\n" + body;
+	QByteArray framed(sizeof(quint32), 0);
+	qToLittleEndian<quint32>(message.size(), framed.data());
+	return framed + message;
+}
+
+/* Encode a raw data message with the given header and samples. */
+QByteArray dataMessage(float start, float stop, quint32 nsamples, quint32 nchannels,
+		const QByteArray& samples)
+{
+	QByteArray body(2 * sizeof(float) + 2 * sizeof(quint32), 0);
+	std::memcpy(body.data(), &start, sizeof(start));
+	std::memcpy(body.data() + sizeof(float), &stop, sizeof(stop));
+	std::memcpy(body.data() + 2 * sizeof(float), &nsamples, sizeof(nsamples));
+	std::memcpy(body.data() + 2 * sizeof(float) + sizeof(quint32),
+			&nchannels, sizeof(nchannels));
+	return bldsMessage("data", body + samples);
+}
+
+/* Encode a frame of samples as a raw data message. */
+QByteArray dataMessage(float start, float stop, const DataFrame::Samples& samples)
+{
+	return dataMessage(start, stop, samples.n_rows, samples.n_cols,
+			QByteArray(reinterpret_cast<const char*>(samples.memptr()),
+				samples.n_elem * sizeof(DataFrame::Samples::elem_type)));
+}
+
+/* Encode a successful response to a request for an unsigned parameter. */
+QByteArray getResponse(const QByteArray& param, quint32 value)
+{
+	QByteArray body(1, 1);
+	body.append(param + "\n");
+	body.append(reinterpret_cast<const char*>(&value), sizeof(value));
+	return bldsMessage("get", body);
+}
+
+/* Return samples whose values identify their sample and channel. */
+DataFrame::Samples testSamples(arma::uword nsamples, arma::uword nchannels, int offset = 0)
+{
+	DataFrame::Samples samples(nsamples, nchannels);
+	for (arma::uword c = 0; c < nchannels; c++) {
+		for (arma::uword i = 0; i < nsamples; i++)
+			samples(i, c) = offset + 100 * c + i;
+	}
+	return samples;
+}
+
+/* Return true if two matrices of samples are identical. */
+bool sameSamples(const DataFrame::Samples& a, const DataFrame::Samples& b)
+{
+	return (a.n_rows == b.n_rows) && (a.n_cols == b.n_cols) &&
+		(std::memcmp(a.memptr(), b.memptr(),
+				a.n_elem * sizeof(DataFrame::Samples::elem_type)) == 0);
+}
+
+/* A server on the loopback interface standing in for the BLDS, whose
+ * end of the connection is driven byte by byte by a test.
+ */
+struct LocalBlds {
+	QTcpServer server;
+	QTcpSocket* socket = nullptr;
+
+	bool listen() { return server.listen(QHostAddress::LocalHost); }
+	quint16 port() const { return server.serverPort(); }
+
+	/* Take a pending connection from a client, if any. */
+	bool accept()
+	{
+		if (!server.hasPendingConnections())
+			return false;
+		socket = server.nextPendingConnection();
+		return true;
+	}
+
+	/* Write bytes to the client in a single write. */
+	void send(const QByteArray& bytes)
+	{
+		socket->write(bytes);
+		socket->flush();
+	}
+
+	/* Return true if a whole message from the client has arrived. */
+	bool hasMessage() const
+	{
+		quint32 size = 0;
+		if (socket->peek(reinterpret_cast<char*>(&size), sizeof(size)) !=
+				static_cast<qint64>(sizeof(size))) {
+			return false;
+		}
+		return socket->bytesAvailable() >= static_cast<qint64>(sizeof(size) + size);
+	}
+
+	/* Read a whole message from the client, without its length. */
+	QByteArray takeMessage()
+	{
+		quint32 size = 0;
+		socket->read(reinterpret_cast<char*>(&size), sizeof(size));
+		return socket->read(size);
+	}
+};
+
+} // end anonymous namespace
 
 void TestLibBldsClient::testConnectDisconnect()
 {
@@ -78,6 +191,32 @@ void TestLibBldsClient::testServerGetSet()
 	QVERIFY(args.at(2).canConvert(QVariant::String));
 }
 
+void TestLibBldsClient::testAsyncRequests()
+{
+	/* Futures are resolved from the I/O thread, so they may be waited
+	 * on here without spinning an event loop.
+	 */
+	BldsClient client;
+	client.setUseIoThread(true);
+	QSignalSpy connectSpy(&client, &BldsClient::connected);
+	client.connect();
+	QVERIFY(connectSpy.wait(1000));
+
+	auto interval = client.getAsync("read-interval");
+	auto invalid = client.getAsync("invalid-parameter");
+	auto result = interval.result();
+	QVERIFY(result.success);
+	QVERIFY(result.data.toUInt() == 10);
+	result = invalid.result();
+	QVERIFY(!result.success);
+	QVERIFY(result.data.canConvert(QVariant::String));
+
+	auto many = client.getManyAsync({ "read-interval", "recording-length" });
+	result = many.result();
+	QVERIFY(result.success);
+	QVERIFY(result.data.toMap().size() == 2);
+}
+
 void TestLibBldsClient::testStartStop()
 {
 	BldsClient client;
@@ -129,5 +268,598 @@ void TestLibBldsClient::testStartStop()
 	QVERIFY(deleteSpy.wait(1000));
 }
 
-QTEST_MAIN(TestLibBldsClient);
+void TestLibBldsClient::testRingBuffer()
+{
+	RingBuffer<int> oldest(3, RingBuffer<int>::DropOldest);
+	QVERIFY(oldest.capacity() == 4);
+	for (int i = 0; i < 6; i++)
+		QVERIFY(oldest.push(i));
+	QVERIFY(oldest.droppedCount() == 2);
+	int value = -1;
+	QVERIFY(oldest.tryPop(value));
+	QVERIFY(value == 2);
+
+	RingBuffer<int> newest(4, RingBuffer<int>::DropNewest);
+	for (int i = 0; i < 4; i++)
+		QVERIFY(newest.push(i));
+	QVERIFY(!newest.push(4));
+	QVERIFY(newest.droppedCount() == 1);
+	QVERIFY(newest.tryPop(value));
+	QVERIFY(value == 0);
+
+	RingBuffer<int> block(1, RingBuffer<int>::Block);
+	QVERIFY(block.push(0));
+	block.close();
+	QVERIFY(!block.push(1));
+	QVERIFY(block.pop(value, 0));
+	QVERIFY(value == 0);
+	QVERIFY(!block.pop(value, 0));
+}
+
+void TestLibBldsClient::testDataCache()
+{
+	FramePool pool;
+	DataCache cache;
+	QVERIFY(!cache.isEnabled());
+	cache.setMaxDuration(1.0);
+
+	/* Two adjacent frames of 10 samples at 100 Hz, each sample holding its index. */
+	for (int i = 0; i < 2; i++) {
+		auto frame = pool.acquire(0.1 * i, 0.1 * (i + 1), 10, 2);
+		for (int j = 0; j < 10; j++)
+			frame.frame().data()(j, 0) = frame.frame().data()(j, 1) = 10 * i + j;
+		cache.insert(frame);
+	}
+	QVERIFY(cache.frameCount() == 2);
+
+	float gapStart = 0., gapStop = 0.;
+	QVERIFY(cache.coverage(0.05, 0.15, gapStart, gapStop) == DataCache::Covered);
+	QVERIFY(cache.coverage(0.5, 0.6, gapStart, gapStop) == DataCache::NotCovered);
+	QVERIFY(cache.coverage(0.15, 0.3, gapStart, gapStop) == DataCache::PartiallyCovered);
+	QVERIFY(qAbs(gapStart - 0.2) < 1e-4);
+	QVERIFY(qAbs(gapStop - 0.3) < 1e-4);
+
+	auto frame = cache.extract(0.05, 0.15, pool);
+	QVERIFY(!frame.isNull());
+	QVERIFY(frame->nsamples() == 10);
+	QVERIFY(frame->data()(0, 1) == 5);
+	QVERIFY(frame->data()(9, 1) == 14);
+
+	/* Frames ending more than the duration before the latest are evicted. */
+	cache.insert(pool.acquire(1.5, 1.6, 10, 2));
+	QVERIFY(cache.frameCount() == 1);
+	cache.setMaxDuration(0.);
+	QVERIFY(cache.frameCount() == 0);
+}
+
+void TestLibBldsClient::testFrameRecorder()
+{
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	auto path = dir.filePath("recording.bin");
+
+	/* Use a small segment size, so that frames span several segments. */
+	FrameRecorder recorder(path, 100);
+	QVERIFY(recorder.open());
+	for (int i = 0; i < 4; i++) {
+		DataFrame::Samples samples(10, 2);
+		samples.fill(i);
+		QVERIFY(recorder.append(DataFrame(0.1 * i, 0.1 * (i + 1), std::move(samples))));
+	}
+	QVERIFY(recorder.frameCount() == 4);
+	QVERIFY(!recorder.append(DataFrame(0.4, 0.5, DataFrame::Samples(10, 3))));
+	QVERIFY(recorder.isOpen());
+	QVERIFY(recorder.frameCount() == 4);
+
+	RecordingReader reader(path);
+	QVERIFY(reader.open());
+	QVERIFY(reader.frameCount() == 4);
+	QVERIFY(reader.findFrame(0.25) == 2);
+	QVERIFY(reader.findFrame(1.0) == -1);
+	QVERIFY(reader.samples(3)[19] == 3);
+
+	recorder.close();
+	QVERIFY(QFileInfo(path).size() == 4 * 10 * 2 * sizeof(DataFrame::Samples::elem_type));
+	QVERIFY(reader.refresh());
+	QVERIFY(reader.frame(1).data()(0, 0) == 1);
+}
+
+void TestLibBldsClient::testSampleConversion()
+{
+	/* Use an odd length, to exercise both vector and scalar loops. */
+	const int count = 1003;
+	QVector<qint16> input(count);
+	QVector<float> output(count);
+	for (int i = 0; i < count; i++)
+		input[i] = static_cast<qint16>(37 * i - 16000);
+	conversion::convert(input.constData(), output.data(), count, 0.5, 1.0);
+	for (int i = 0; i < count; i++)
+		QVERIFY(qAbs(output[i] - (0.5f * input[i] + 1.0f)) < 1e-3);
+
+	/* Transpose 17 samples of 40 channels, in two ranges of channels. */
+	const int nsamples = 17, nchannels = 40;
+	QVector<qint16> channelMajor(nsamples * nchannels), sampleMajor(nsamples * nchannels);
+	for (int i = 0; i < channelMajor.size(); i++)
+		channelMajor[i] = i;
+	conversion::transpose(channelMajor.constData(), sampleMajor.data(),
+			nsamples, nchannels, 0, 32);
+	conversion::transpose(channelMajor.constData(), sampleMajor.data(),
+			nsamples, nchannels, 32, 8);
+	for (int c = 0; c < nchannels; c++) {
+		for (int t = 0; t < nsamples; t++)
+			QVERIFY(sampleMajor[t * nchannels + c] == channelMajor[c * nsamples + t]);
+	}
+}
+
+void TestLibBldsClient::testPreprocessor()
+{
+	Preprocessor::Settings settings;
+	settings.reference = Preprocessor::MedianReference;
+	Preprocessor preprocessor(settings);
+	QVERIFY(preprocessor.isEnabled());
+
+	arma::fmat samples(4, 3);
+	for (arma::uword i = 0; i < samples.n_rows; i++) {
+		samples(i, 0) = i;
+		samples(i, 1) = 10.;
+		samples(i, 2) = 20. + i;
+	}
+	preprocessor.process(samples, 20000.);
+	for (arma::uword i = 0; i < samples.n_rows; i++) {
+		QVERIFY(qAbs(samples(i, 0) - (i - 10.)) < 1e-4);
+		QVERIFY(qAbs(samples(i, 1)) < 1e-4);
+	}
+
+	/* A high-pass filter removes a constant offset, across frames. */
+	settings.reference = Preprocessor::NoReference;
+	settings.lowCutoff = 300.;
+	preprocessor.setSettings(settings);
+	for (int frame = 0; frame < 50; frame++) {
+		samples.fill(1.);
+		preprocessor.process(samples, 20000.);
+	}
+	QVERIFY(qAbs(samples(3, 0)) < 1e-2);
+
+	/* Two consecutive frames are filtered as their concatenation, even
+	 * if the rate estimated for each differs slightly.
+	 */
+	settings.highCutoff = 3000.;
+	arma::fmat whole(200, 2);
+	for (arma::uword i = 0; i < whole.n_rows; i++) {
+		whole(i, 0) = std::sin(0.05 * i);
+		whole(i, 1) = (i % 7) - 3.;
+	}
+	arma::fmat first = whole.rows(0, 99), second = whole.rows(100, 199);
+	Preprocessor reference(settings);
+	reference.process(whole, 20000.);
+	preprocessor.setSettings(settings);
+	preprocessor.process(first, 20000.);
+	preprocessor.process(second, 20000.01);
+	for (arma::uword i = 0; i < 100; i++) {
+		for (arma::uword c = 0; c < 2; c++) {
+			QVERIFY(qAbs(first(i, c) - whole(i, c)) < 1e-4);
+			QVERIFY(qAbs(second(i, c) - whole(100 + i, c)) < 1e-4);
+		}
+	}
+}
+
+void TestLibBldsClient::testChannelProcessor()
+{
+	ChannelProcessor processor(4);
+	QVERIFY(processor.threadCount() == 4);
+
+	/* Every channel is processed exactly once. */
+	const quint32 nchannels = 1027;
+	QVector<int> counts(nchannels, 0);
+	processor.run(nchannels, 10, [&counts](quint32 first, quint32 count) -> void {
+				for (quint32 c = first; c < first + count; c++)
+					counts[c]++;
+			});
+	for (auto count : counts)
+		QVERIFY(count == 1);
+}
+
+void TestLibBldsClient::testSpikeDetector()
+{
+	SpikeDetector::Settings settings;
+	settings.enabled = true;
+	settings.snippets = true;
+	SpikeDetector detector(settings);
+
+	/* Alternating noise of unit amplitude, with one large negative
+	 * spike on the second channel just before the end of the first
+	 * frame, so that its snippet spans both frames.
+	 */
+	arma::fmat samples(100, 2);
+	for (arma::uword i = 0; i < samples.n_rows; i++) {
+		samples(i, 0) = (i % 2) ? 1. : -1.;
+		samples(i, 1) = samples(i, 0);
+	}
+	samples(95, 1) = -50.;
+
+	SpikeBatch batch;
+	detector.detect(samples, 0., 0.1, batch);
+	QVERIFY(batch.events.isEmpty());
+	samples(95, 1) = 1.;
+	detector.detect(samples, 0.1, 0.2, batch);
+	QVERIFY(batch.events.size() == 1);
+	QVERIFY(batch.events[0].channel == 1);
+	QVERIFY(batch.events[0].sample == 95);
+	QVERIFY(batch.snippetLength == settings.preSamples + settings.postSamples);
+	QVERIFY(batch.snippets.size() == batch.snippetLength);
+	QVERIFY(batch.snippets[settings.preSamples] == -50.);
+}
+
+void TestLibBldsClient::testEnvelopeDecimator()
+{
+	/* A ramp split into frames which do not align with the bins. */
+	const arma::uword nsamples = 100, nchannels = 2, bin = 8;
+	DataFrame::Samples ramp(nsamples, nchannels);
+	for (arma::uword i = 0; i < nsamples; i++) {
+		ramp(i, 0) = i;
+		ramp(i, 1) = -static_cast<qint16>(i);
+	}
+
+	EnvelopeDecimator decimator(bin);
+	arma::uword row = 0;
+	for (arma::uword first = 0; first < nsamples; first += 30) {
+		const arma::uword last = qMin(first + 30, nsamples);
+		DataFrame frame(first * 1e-3, last * 1e-3, ramp.rows(first, last - 1));
+		Envelope envelope;
+		if (!decimator.decimate(frame, envelope))
+			continue;
+		QVERIFY(qAbs(envelope.start - row * bin * 1e-3) < 1e-5);
+		for (arma::uword i = 0; i < envelope.minima.n_rows; i++, row++) {
+			QVERIFY(envelope.minima(i, 0) == static_cast<qint16>(row * bin));
+			QVERIFY(envelope.maxima(i, 0) == static_cast<qint16>((row + 1) * bin - 1));
+			QVERIFY(envelope.minima(i, 1) == -envelope.maxima(i, 0));
+		}
+	}
+	QVERIFY(row == nsamples / bin);
+}
+
+void TestLibBldsClient::testFrameCodec()
+{
+	DataFrame::Samples samples(1001, 3);
+	for (arma::uword i = 0; i < samples.n_elem; i++)
+		samples.memptr()[i] = static_cast<qint16>((i * 7919) % 65536);
 
+	const codec::Encoding encodings[] = { codec::RawEncoding, codec::DeltaEncoding,
+			codec::DeltaLz4Encoding, codec::DeltaZstdEncoding };
+	for (auto encoding : encodings) {
+		if (!codec::isSupported(encoding))
+			continue;
+		auto encoded = codec::encode(samples, encoding);
+		QVERIFY(!encoded.isEmpty());
+		QVERIFY(codec::maxDecompressedSize(encoding, encoded.size()) >=
+				samples.n_elem * sizeof(qint16));
+
+		DataFrame::Samples decoded(samples.n_rows, samples.n_cols);
+		QVERIFY(codec::decompress(encoding, encoded.constData(), encoded.size(),
+					reinterpret_cast<char*>(decoded.memptr()),
+					decoded.n_elem * sizeof(qint16)));
+		if (encoding != codec::RawEncoding) {
+			for (arma::uword c = 0; c < decoded.n_cols; c++)
+				codec::integrate(decoded.colptr(c), decoded.colptr(c), decoded.n_rows);
+		}
+		for (arma::uword i = 0; i < samples.n_elem; i++)
+			QVERIFY(decoded.memptr()[i] == samples.memptr()[i]);
+	}
+}
+
+void TestLibBldsClient::testClientStatistics()
+{
+	LatencyHistogram histogram;
+	for (int i = 0; i < 99; i++)
+		histogram.record(10000); // 10 us
+	histogram.record(5000000); // 5 ms
+	auto summary = histogram.summary();
+	QVERIFY(summary.count == 100);
+	QVERIFY(qAbs(summary.max - 5000.) < 1e-6);
+	QVERIFY((summary.p50 >= 10.) && (summary.p50 < 20.));
+	QVERIFY((summary.p99 >= 10.) && (summary.p99 < 20.));
+	QVERIFY(qAbs(summary.mean - (99 * 10. + 5000.) / 100) < 1e-6);
+	histogram.reset();
+	QVERIFY(histogram.summary().count == 0);
+
+	ClientStatistics statistics;
+	statistics.addBytes(1000, 200);
+	statistics.addBytes(500, 100);
+	statistics.addFrame(20000);
+	statistics.addDropped(2);
+	statistics.setRingOccupancy(3);
+	statistics.addRequest("get", 1000000);
+	auto snapshot = statistics.snapshot();
+	QVERIFY(snapshot.bytesReceived == 1500);
+	QVERIFY(snapshot.socketBacklog == 100);
+	QVERIFY(snapshot.maxSocketBacklog == 200);
+	QVERIFY(snapshot.framesReceived == 1);
+	QVERIFY(snapshot.framesDropped == 2);
+	QVERIFY(snapshot.maxRingOccupancy == 3);
+	QVERIFY(snapshot.requestTime.value("get").count == 1);
+	QVERIFY(snapshot.toJson().contains("request-time"));
+
+	statistics.reset();
+	snapshot = statistics.snapshot();
+	QVERIFY(snapshot.bytesReceived == 0);
+	QVERIFY(snapshot.requestTime.value("get").count == 0);
+}
+
+void TestLibBldsClient::testSampleClock()
+{
+	SampleClock clock(20000.);
+	QVERIFY(clock.toSample(1.5) == 30000);
+	QVERIFY(clock.resolve(1.5f) == 30000);
+
+	/* Eight hours in, floats are tens of samples apart, and a frame's
+	 * index is resolved from the one expected, when consistent with it.
+	 */
+	const qint64 late = 8LL * 3600 * 20000 + 7;
+	const float start = static_cast<float>(clock.toSeconds(late));
+	QVERIFY(clock.tolerance(start) > 10.);
+	QVERIFY(clock.resolve(start, late) == late);
+	QVERIFY(clock.resolve(start, late + 1000) != late + 1000);
+
+	/* The cache covers ranges of samples exactly. */
+	FramePool pool;
+	DataCache cache;
+	cache.setMaxSize(1 << 20);
+	for (qint64 f = 0; f < 4; f++) {
+		const qint64 first = late + f * 100;
+		auto frame = pool.acquire(clock.toSeconds(first), clock.toSeconds(first + 100), 100, 2);
+		frame.setFirstSample(first);
+		for (arma::uword i = 0; i < frame->data().n_elem; i++)
+			frame.frame().data().memptr()[i] = static_cast<qint16>((first + i % 100) % 1000);
+		if (f != 2)
+			cache.insert(frame);
+	}
+	qint64 gapStart = 0, gapStop = 0;
+	QVERIFY(cache.coverage(late + 10, late + 190, gapStart, gapStop) == DataCache::Covered);
+	QVERIFY(cache.coverage(late + 150, late + 350, gapStart, gapStop) ==
+			DataCache::PartiallyCovered);
+	QVERIFY( (gapStart == late + 200) && (gapStop == late + 300) );
+
+	auto chunk = cache.extractSamples(late + 10, late + 190, clock, pool);
+	QVERIFY(chunk.firstSample() == late + 10);
+	QVERIFY(chunk->nsamples() == 180);
+	for (arma::uword i = 0; i < chunk->nsamples(); i++)
+		QVERIFY(chunk->data()(i, 1) == static_cast<qint16>((late + 10 + i) % 1000));
+}
+
+void TestLibBldsClient::testMessageFraming()
+{
+	LocalBlds blds;
+	QVERIFY(blds.listen());
+	BldsClient client("127.0.0.1", blds.port());
+	QSignalSpy frameSpy(&client, &BldsClient::frameReceived);
+	QSignalSpy errorSpy(&client, &BldsClient::error);
+	client.connect();
+	QTRY_VERIFY(blds.accept());
+	QTRY_VERIFY(client.isConnected());
+
+	/* A message split within its size, its type, its header and its samples. */
+	const auto first = testSamples(20, 3);
+	const auto split = dataMessage(0., 0.1, first);
+	int offset = 0;
+	for (int end : { 2, 6, 12, 40, split.size() }) {
+		blds.send(split.mid(offset, end - offset));
+		offset = end;
+		QTest::qWait(20);
+	}
+	QTRY_COMPARE(frameSpy.count(), 1);
+	auto frame = frameSpy.takeFirst().at(0).value<PooledFrame>();
+	QVERIFY(qAbs(frame->stop() - 0.1) < 1e-6);
+	QVERIFY(sameSamples(frame->data(), first));
+
+	/* Several messages in a single write, including an empty frame. */
+	const auto second = testSamples(20, 3, 1), third = testSamples(20, 3, 2);
+	blds.send(dataMessage(0.1, 0.2, second) +
+			dataMessage(0.2, 0.2, DataFrame::Samples(0, 3)) +
+			dataMessage(0.2, 0.3, third));
+	QTRY_COMPARE(frameSpy.count(), 3);
+	QVERIFY(sameSamples(frameSpy.at(0).at(0).value<PooledFrame>()->data(), second));
+	QVERIFY(frameSpy.at(1).at(0).value<PooledFrame>()->nsamples() == 0);
+	QVERIFY(sameSamples(frameSpy.at(2).at(0).value<PooledFrame>()->data(), third));
+	frameSpy.clear();
+	QVERIFY(errorSpy.isEmpty());
+
+	/* A frame claiming more than the largest accepted size is rejected
+	 * before any storage is acquired, and the stream continues after it.
+	 */
+	const auto fourth = testSamples(20, 3, 3);
+	blds.send(dataMessage(0.3, 0.4, 1 << 16, 1 << 15, QByteArray(16, 0)) +
+			dataMessage(0.3, 0.4, fourth));
+	QTRY_COMPARE(frameSpy.count(), 1);
+	QVERIFY(errorSpy.count() == 1);
+	QVERIFY(sameSamples(frameSpy.takeFirst().at(0).value<PooledFrame>()->data(), fourth));
+}
+
+void TestLibBldsClient::testChannelSelection()
+{
+	LocalBlds blds;
+	QVERIFY(blds.listen());
+	BldsClient client("127.0.0.1", blds.port());
+	QSignalSpy frameSpy(&client, &BldsClient::frameReceived);
+	client.connect();
+	QTRY_VERIFY(blds.accept());
+	QTRY_VERIFY(client.isConnected());
+
+	/* Check that a selection decodes the same samples as the full frame. */
+	const auto full = testSamples(50, 6);
+	const auto message = dataMessage(0., 0.05, full);
+	const auto checkSelection = [&](const QVector<int>& columns) -> bool {
+		const auto frame = frameSpy.takeFirst().at(0).value<PooledFrame>();
+		if (frame->nchannels() != static_cast<arma::uword>(columns.size()))
+			return false;
+		for (int c = 0; c < columns.size(); c++) {
+			for (arma::uword i = 0; i < full.n_rows; i++) {
+				if (frame->data()(i, c) != full(i, columns.at(c)))
+					return false;
+			}
+		}
+		return true;
+	};
+
+	blds.send(message);
+	QTRY_COMPARE(frameSpy.count(), 1);
+	QVERIFY(sameSamples(frameSpy.takeFirst().at(0).value<PooledFrame>()->data(), full));
+
+	/* A non-contiguous selection, arriving in pieces which split channels.
+	 * Channels not in the frame are ignored.
+	 */
+	client.setChannelSelection({ 5, 0, 2, 9 });
+	for (int offset = 0; offset < message.size(); offset += 37) {
+		blds.send(message.mid(offset, 37));
+		QTest::qWait(10);
+	}
+	QTRY_COMPARE(frameSpy.count(), 1);
+	QVERIFY(checkSelection({ 0, 2, 5 }));
+
+	/* A selection changed between frames applies to the next frame, and
+	 * one changed within a frame only from the frame after it.
+	 */
+	client.setChannelSelection({ 1, 4 });
+	blds.send(message);
+	QTRY_COMPARE(frameSpy.count(), 1);
+	QVERIFY(checkSelection({ 1, 4 }));
+
+	blds.send(message.left(message.size() / 2));
+	QTest::qWait(20);
+	client.setChannelSelection({ 3 });
+	blds.send(message.mid(message.size() / 2) + message);
+	QTRY_COMPARE(frameSpy.count(), 2);
+	QVERIFY(checkSelection({ 1, 4 }));
+	QVERIFY(checkSelection({ 3 }));
+
+	client.clearChannelSelection();
+	blds.send(message);
+	QTRY_COMPARE(frameSpy.count(), 1);
+	QVERIFY(sameSamples(frameSpy.takeFirst().at(0).value<PooledFrame>()->data(), full));
+}
+
+void TestLibBldsClient::testRequestMatching()
+{
+	LocalBlds blds;
+	QVERIFY(blds.listen());
+	BldsClient client("127.0.0.1", blds.port());
+	QSignalSpy finishedSpy(&client, &BldsClient::requestFinished);
+	QSignalSpy frameSpy(&client, &BldsClient::frameReceived);
+	client.connect();
+	QTRY_VERIFY(blds.accept());
+	QTRY_VERIFY(client.isConnected());
+
+	/* Requests are pipelined, including the messages of a batch. */
+	const auto single = client.get("read-interval");
+	const auto batch = client.getMany({ "read-interval", "recording-length" });
+	const auto data = client.getData(0.1007, 0.2007);
+	QVERIFY( (single != 0) && (batch != 0) && (data != 0) );
+	QList<QByteArray> sent;
+	for (int i = 0; i < 4; i++) {
+		QTRY_VERIFY(blds.hasMessage());
+		sent.append(blds.takeMessage());
+	}
+	QVERIFY( (sent.at(0) == "get\nread-interval\n") && (sent.at(1) == "get\nread-interval\n") &&
+			(sent.at(2) == "get\nrecording-length\n") && sent.at(3).startsWith("get-data\n") );
+
+	/* Responses are matched to requests in order. A streamed frame is
+	 * not taken for the response to the request for data, which may be
+	 * aligned to the boundaries of samples.
+	 */
+	blds.send(getResponse("read-interval", 10) + getResponse("read-interval", 20) +
+			getResponse("recording-length", 30) +
+			dataMessage(0.5, 0.6, testSamples(100, 2)) +
+			dataMessage(0.1, 0.2, testSamples(100, 2, 1)));
+	QTRY_COMPARE(finishedSpy.count(), 3);
+	QVERIFY(finishedSpy.at(0).at(0).toULongLong() == single);
+	QVERIFY(finishedSpy.at(0).at(2).toUInt() == 10);
+	QVERIFY(finishedSpy.at(1).at(0).toULongLong() == batch);
+	const auto values = finishedSpy.at(1).at(2).toMap();
+	QVERIFY( (values.value("read-interval").toUInt() == 20) &&
+			(values.value("recording-length").toUInt() == 30) );
+	QVERIFY(finishedSpy.at(2).at(0).toULongLong() == data);
+	QVERIFY(finishedSpy.at(2).at(1).toBool());
+	QVERIFY(qAbs(finishedSpy.at(2).at(2).value<PooledFrame>()->start() - 0.1) < 1e-6);
+	QVERIFY(frameSpy.count() == 2);
+	QVERIFY(qAbs(frameSpy.at(0).at(0).value<PooledFrame>()->start() - 0.5) < 1e-6);
+	finishedSpy.clear();
+
+	/* Requests outstanding when the connection is lost fail, as do those
+	 * made after it is lost, rather than waiting for ever.
+	 */
+	const auto lost = client.get("read-interval");
+	QTRY_VERIFY(blds.hasMessage());
+	blds.socket->abort();
+	QTRY_VERIFY(!client.isConnected());
+	QTRY_COMPARE(finishedSpy.count(), 1);
+	QVERIFY(finishedSpy.at(0).at(0).toULongLong() == lost);
+	QVERIFY(!finishedSpy.at(0).at(1).toBool());
+	const auto late = client.get("read-interval");
+	QTRY_COMPARE(finishedSpy.count(), 2);
+	QVERIFY(finishedSpy.at(1).at(0).toULongLong() == late);
+	QVERIFY(!finishedSpy.at(1).at(1).toBool());
+}
+
+void TestLibBldsClient::testReconnectSeam()
+{
+	LocalBlds blds;
+	QVERIFY(blds.listen());
+	BldsClient client("127.0.0.1", blds.port());
+	client.setSampleRate(1000);
+	client.setAutoReconnect(true, 10, 50);
+	QSignalSpy frameSpy(&client, &BldsClient::frameReceived);
+	QSignalSpy reconnectedSpy(&client, &BldsClient::reconnected);
+	client.connect();
+	QTRY_VERIFY(blds.accept());
+	QTRY_VERIFY(client.isConnected());
+
+	client.requestAllData(true);
+	QTRY_VERIFY(blds.hasMessage());
+	QVERIFY(blds.takeMessage().startsWith("get-all-data\n"));
+	blds.send(bldsMessage("get-all-data", QByteArray(1, 1)) +
+			dataMessage(0.00, 0.01, testSamples(10, 1, 0)) +
+			dataMessage(0.01, 0.02, testSamples(10, 1, 10)) +
+			dataMessage(0.02, 0.03, testSamples(10, 1, 20)));
+	QTRY_COMPARE(frameSpy.count(), 3);
+
+	/* Drop the connection mid-stream. On reconnecting, the client asks
+	 * how far the recording has got, fetches what it missed from the next
+	 * sample on, and only then streams again.
+	 */
+	blds.socket->abort();
+	QTRY_VERIFY(blds.accept());
+	QTRY_COMPARE(reconnectedSpy.count(), 1);
+	QTRY_VERIFY(blds.hasMessage());
+	QVERIFY(blds.takeMessage() == "get\nrecording-position\n");
+	QByteArray position(1, 1);
+	position.append("recording-position\n");
+	const float positionValue = 0.06;
+	position.append(reinterpret_cast<const char*>(&positionValue), sizeof(positionValue));
+	blds.send(bldsMessage("get", position));
+	QTRY_VERIFY(blds.hasMessage());
+	QVERIFY(blds.takeMessage().startsWith("get-data\n"));
+	QTRY_VERIFY(blds.hasMessage());
+	QVERIFY(blds.takeMessage().startsWith("get-all-data\n"));
+
+	/* The live stream resumes with frames overlapping the backfill: one
+	 * wholly within it, and one straddling its end.
+	 */
+	blds.send(dataMessage(0.03, 0.06, testSamples(30, 1, 30)) +
+			bldsMessage("get-all-data", QByteArray(1, 1)) +
+			dataMessage(0.04, 0.05, testSamples(10, 1, 40)) +
+			dataMessage(0.05, 0.07, testSamples(20, 1, 50)) +
+			dataMessage(0.07, 0.08, testSamples(10, 1, 70)));
+	QTRY_COMPARE(frameSpy.count(), 6);
+
+	/* Each sample is delivered exactly once, and in order. */
+	qint64 next = 0;
+	for (const auto& args : frameSpy) {
+		const auto frame = args.at(0).value<PooledFrame>();
+		QVERIFY(frame.firstSample() == next);
+		for (arma::uword i = 0; i < frame->nsamples(); i++)
+			QVERIFY(frame->data()(i, 0) == next + static_cast<qint64>(i));
+		next += frame->nsamples();
+	}
+	QVERIFY(next == 80);
+}
+
+QTEST_MAIN(TestLibBldsClient);
@@ -9,5 +9,21 @@ class TestLibBldsClient : public QObject {
 		void testConnectDisconnect();
 		void testCreateDelete();
 		void testServerGetSet();
+		void testAsyncRequests();
 		void testStartStop();
+		void testRingBuffer();
+		void testDataCache();
+		void testFrameRecorder();
+		void testSampleConversion();
+		void testPreprocessor();
+		void testChannelProcessor();
+		void testSpikeDetector();
+		void testEnvelopeDecimator();
+		void testFrameCodec();
+		void testClientStatistics();
+		void testSampleClock();
+		void testMessageFraming();
+		void testChannelSelection();
+		void testRequestMatching();
+		void testReconnectSeam();
 };